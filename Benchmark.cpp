@@ -0,0 +1,285 @@
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+#include "Benchmark.hpp"
+#include "PoissonDiskSampler.hpp"
+#include "SampleVerifier.hpp"
+
+SampleQuality measureQuality(const vector<float>& pts, const float& r){
+  SampleVerification v;
+  verifySamples(pts, r, 0, v);
+  SampleQuality q;
+  q.mindist = v.mindist;
+  q.coverage = v.coverage;
+  q.voids = v.voids;
+  return q;
+}
+
+size_t peakResidentMemory(){
+  //VmHWM follows clear_refs, ru_maxrss does not
+  FILE* f = fopen("/proc/self/status", "r");
+  if(f != NULL){
+    char line[256];
+    size_t kb = 0;
+    while(fgets(line, sizeof(line), f) != NULL){
+      if(sscanf(line, "VmHWM: %lu kB", &kb) == 1){
+        fclose(f);
+        return kb*1024;
+      }
+    }
+    fclose(f);
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (size_t)usage.ru_maxrss*1024;
+}
+
+void resetPeakResidentMemory(){
+  FILE* f = fopen("/proc/self/clear_refs", "w");
+  if(f != NULL){
+    fputs("5", f);
+    fclose(f);
+  }
+}
+
+//The averaged spectrum of the records from first on
+static void reportSpectrum(const BenchmarkSweep& sweep, const string& name,
+                           const SampleRunConfig& cfg,
+                           const PowerSpectrum& spectrum, FILE* logfile,
+                           vector<BenchmarkRecord>& records,
+                           const size_t& first){
+  SpectralQuality sq = spectrum.quality(cfg.radius);
+  for(size_t k=first; k < records.size(); k++){
+    records[k].spectral = sq;
+  }
+  if(logfile != NULL){
+    fprintf(logfile, "#spectrum %s\t%lu\t%lu\t%lu\t%f\t%lu\t%f\t%f\t"
+            "%f\t%f\n", name.c_str(), cfg.width, cfg.height, cfg.ndarts, cfg.radius,
+            sq.runs, sq.peakfreq, sq.peak, sq.lowpower, sq.anisotropy);
+    fflush(logfile);
+  }
+  if(!sweep.spectrumprefix.empty()){
+    char suffix[128];
+    snprintf(suffix, sizeof(suffix), "_%s_%lu_%lu_%g", name.c_str(),
+             cfg.width, cfg.ndarts, cfg.radius);
+    string base = sweep.spectrumprefix+suffix;
+    spectrum.savePeriodogram(base+".png");
+    spectrum.saveRadial(base+".txt", cfg.radius);
+  }
+}
+
+void runBenchmark(const BenchmarkSweep& sweep,
+                  const vector<SamplerBackend*>& backends,
+                  FILE* logfile, vector<BenchmarkRecord>& records){
+  for(size_t b=0; b < backends.size(); b++){
+    SamplerBackend* backend = backends[b];
+    for(size_t t=0; t < sweep.threads.size(); t++){
+      //a single thread count for backends that ignore it
+      if(!backend->threaded() && t > 0){
+        break;
+      }
+      for(size_t s=0; s < sweep.resolutions.size(); s++){
+        for(size_t ri=0; ri < sweep.radii.size(); ri++){
+          for(size_t d=0; d < sweep.darts.size(); d++){
+            SampleRunConfig cfg;
+            cfg.width = cfg.height = sweep.resolutions[s];
+            cfg.radius = sweep.radii[ri];
+            cfg.ndarts = max((size_t)(computeN(cfg.radius)*sweep.darts[d]),
+                             (size_t)1);
+            cfg.threads = backend->threaded() ? sweep.threads[t] : 1;
+
+            PowerSpectrum* spectrum = NULL;
+            if(sweep.spectrum > 0){
+              spectrum = new PowerSpectrum(sweep.spectrum,
+                  PowerSpectrum::windowsFor(sweep.spectrum, cfg.radius));
+            }
+            size_t first = records.size();
+            for(size_t rep=0; rep < sweep.warmup+sweep.reps; rep++){
+              cfg.seed = sweep.seed ? sweep.seed+rep : 0;
+              SampleRunResult res;
+              resetPeakResidentMemory();
+              backend->run(cfg, res);
+              if(rep < sweep.warmup){
+                continue;
+              }
+
+              BenchmarkRecord rec;
+              rec.backend = backend->name();
+              rec.cfg = cfg;
+              rec.rep = rep-sweep.warmup;
+              rec.peakmem = peakResidentMemory();
+              rec.npts = res.pts.size()/2;
+              rec.quality = measureQuality(res.pts, cfg.radius);
+              if(spectrum != NULL){
+                spectrum->add(res.pts);
+              }
+              rec.res = res;
+              rec.res.pts.clear();
+              records.push_back(rec);
+
+              if(logfile != NULL){
+                fprintf(logfile, "%s\t%lu\t%lu\t%lu\t%f\t%lu\t%lu",
+                        rec.backend.c_str(), cfg.width, cfg.height,
+                        cfg.ndarts, cfg.radius, rec.npts, res.iterations);
+                for(size_t i=0; i < MAXPHASES; i++){
+                  fprintf(logfile, "\t%f", res.phases[i]*1000);
+                }
+                fprintf(logfile, "\t%f\t%f\t%f\t%lu\t%f\t%f\t%lu\n",
+                        res.elapsed*1000, res.devicemem/1048576.0,
+                        rec.npts/res.elapsed, cfg.threads,
+                        rec.quality.mindist, rec.quality.coverage,
+                        rec.quality.voids);
+                fflush(logfile);
+              }
+            }
+            if(spectrum != NULL){
+              reportSpectrum(sweep, backend->name(), cfg, *spectrum, logfile,
+                             records, first);
+              delete spectrum;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+static SamplerBackend* findBackend(const vector<SamplerBackend*>& backends,
+                                   const string& name){
+  for(size_t i=0; i < backends.size(); i++){
+    if(backends[i]->name() == name){
+      return backends[i];
+    }
+  }
+  return NULL;
+}
+
+bool saveBenchmarkCSV(const string& filename,
+                      const vector<SamplerBackend*>& backends,
+                      const vector<BenchmarkRecord>& records){
+  FILE* f = fopen(filename.c_str(), "w");
+  if(f == NULL){
+    perror(filename.c_str());
+    return false;
+  }
+
+  //phases are numbered, their names depend on the backend
+  fprintf(f, "backend,width,height,radius,ndarts,threads,seed,rep,npts,"
+          "iterations,elapsed_ms,pts_per_sec");
+  for(size_t i=0; i < MAXPHASES; i++){
+    fprintf(f, ",phase%lu,phase%lu_ms", i, i);
+  }
+  fprintf(f, ",device_mb,peak_rss_mb,mindist,coverage,voids,spectrum_runs,"
+          "peakfreq,peak,lowpower,anisotropy_db\n");
+
+  for(size_t k=0; k < records.size(); k++){
+    const BenchmarkRecord& rec = records[k];
+    SamplerBackend* backend = findBackend(backends, rec.backend);
+    fprintf(f, "%s,%lu,%lu,%.9g,%lu,%lu,%u,%lu,%lu,%lu,%.6f,%.1f",
+            rec.backend.c_str(), rec.cfg.width, rec.cfg.height,
+            rec.cfg.radius, rec.cfg.ndarts, rec.cfg.threads, rec.cfg.seed,
+            rec.rep, rec.npts, rec.res.iterations, rec.res.elapsed*1000,
+            rec.npts/rec.res.elapsed);
+    for(size_t i=0; i < MAXPHASES; i++){
+      const char* name = backend ? backend->phaseName(i) : NULL;
+      fprintf(f, ",%s,%.6f", name ? name : "", rec.res.phases[i]*1000);
+    }
+    fprintf(f, ",%.3f,%.3f,%.6f,%.8f,%lu", rec.res.devicemem/1048576.0,
+            rec.peakmem/1048576.0, rec.quality.mindist,
+            rec.quality.coverage, rec.quality.voids);
+    const SpectralQuality& sq = rec.spectral;
+    if(sq.runs > 0){
+      fprintf(f, ",%lu,%.6f,%.6f,%.6f,%.4f\n", sq.runs, sq.peakfreq,
+              sq.peak, sq.lowpower, sq.anisotropy);
+    }
+    else{
+      fprintf(f, ",0,,,,\n");
+    }
+  }
+  return fclose(f) == 0;
+}
+
+bool saveBenchmarkJSON(const string& filename,
+                       const vector<SamplerBackend*>& backends,
+                       const vector<BenchmarkRecord>& records){
+  FILE* f = fopen(filename.c_str(), "w");
+  if(f == NULL){
+    perror(filename.c_str());
+    return false;
+  }
+
+  fprintf(f, "[\n");
+  for(size_t k=0; k < records.size(); k++){
+    const BenchmarkRecord& rec = records[k];
+    SamplerBackend* backend = findBackend(backends, rec.backend);
+    fprintf(f, "{\"backend\":\"%s\",\"width\":%lu,\"height\":%lu,"
+            "\"radius\":%.9g,\"ndarts\":%lu,\"threads\":%lu,\"seed\":%u,"
+            "\"rep\":%lu,\"npts\":%lu,\"iterations\":%lu,"
+            "\"elapsed_ms\":%.6f,\"pts_per_sec\":%.1f,\"phases_ms\":{",
+            rec.backend.c_str(), rec.cfg.width, rec.cfg.height,
+            rec.cfg.radius, rec.cfg.ndarts, rec.cfg.threads, rec.cfg.seed,
+            rec.rep, rec.npts, rec.res.iterations, rec.res.elapsed*1000,
+            rec.npts/rec.res.elapsed);
+    for(size_t i=0; backend != NULL && i < MAXPHASES; i++){
+      const char* name = backend->phaseName(i);
+      if(name == NULL) break;
+      fprintf(f, "%s\"%s\":%.6f", i ? "," : "", name, rec.res.phases[i]*1000);
+    }
+    //mindist is infinite for less than two samples, null in JSON
+    fprintf(f, "},\"device_mb\":%.3f,\"peak_rss_mb\":%.3f,",
+            rec.res.devicemem/1048576.0, rec.peakmem/1048576.0);
+    if(rec.quality.mindist <= numeric_limits<double>::max()){
+      fprintf(f, "\"mindist\":%.6f,", rec.quality.mindist);
+    }
+    else{
+      fprintf(f, "\"mindist\":null,");
+    }
+    fprintf(f, "\"coverage\":%.8f,\"voids\":%lu,", rec.quality.coverage,
+            rec.quality.voids);
+    const SpectralQuality& sq = rec.spectral;
+    if(sq.runs > 0){
+      fprintf(f, "\"spectrum\":{\"runs\":%lu,\"peakfreq\":%.6f,"
+              "\"peak\":%.6f,\"lowpower\":%.6f,\"anisotropy_db\":%.4f}",
+              sq.runs, sq.peakfreq, sq.peak, sq.lowpower, sq.anisotropy);
+    }
+    else{
+      fprintf(f, "\"spectrum\":null");
+    }
+    fprintf(f, "}%s\n", (k+1 < records.size()) ? "," : "");
+  }
+  fprintf(f, "]\n");
+  return fclose(f) == 0;
+}
+
+vector<size_t> parseSizeList(const string& s){
+  vector<size_t> values;
+  stringstream ss(s);
+  string item;
+  while(getline(ss, item, ',')){
+    values.push_back(strtoul(item.c_str(), NULL, 10));
+  }
+  return values;
+}
+
+vector<float> parseFloatList(const string& s){
+  vector<float> values;
+  stringstream ss(s);
+  string item;
+  while(getline(ss, item, ',')){
+    //a/b is accepted, radii are usually given in pixels of a resolution
+    size_t slash = item.find('/');
+    double v = atof(item.c_str());
+    if(slash != string::npos){
+      v /= atof(item.c_str()+slash+1);
+    }
+    values.push_back(v);
+  }
+  return values;
+}
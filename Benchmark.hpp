@@ -0,0 +1,112 @@
+#ifndef __BENCHMARK__
+#define __BENCHMARK__
+
+#include <cstdio>
+#include <vector>
+#include <string>
+using namespace std;
+
+#include "Spectrum.hpp"
+
+#define MAXPHASES 4
+
+// One sampling run
+struct SampleRunConfig{
+  size_t width,height;  // resolution of the sampler grid
+  float radius;         // in the unit square
+  size_t ndarts;        // darts per iteration
+  size_t threads;
+  unsigned int seed;    // 0 for a time based seed
+};
+
+struct SampleRunResult{
+  vector<float> pts;    // interleaved (x,y) in the unit square
+  size_t iterations;
+  double elapsed;       // seconds, sampling only
+  double phases[MAXPHASES];
+  size_t devicemem;     // bytes on the GPU, 0 for host samplers
+
+  SampleRunResult():iterations(0),elapsed(0),devicemem(0){
+    for(size_t i=0; i < MAXPHASES; i++) phases[i] = 0;
+  }
+};
+
+// A sampler the benchmark driver can run. Backends own whatever state
+// they keep between runs; the GL one builds its sampler on every run,
+// outside the timed sampling.
+class SamplerBackend{
+ public:
+  virtual ~SamplerBackend(){}
+  virtual string name() const = 0;
+  // Name of phase i, NULL past the last one
+  virtual const char* phaseName(const size_t& i) const = 0;
+  // Whether the thread count changes anything
+  virtual bool threaded() const = 0;
+  virtual void run(const SampleRunConfig& cfg, SampleRunResult& res) = 0;
+};
+
+// Distance and maximality of a sample set with radius r: the smallest
+// distance between two samples relative to r, the fraction of the
+// square within r of a sample and the uncovered vertices of the union
+// of the disks, 0 for a maximal set (see SampleVerifier.hpp)
+struct SampleQuality{
+  double mindist;
+  double coverage;
+  size_t voids;
+};
+SampleQuality measureQuality(const vector<float>& pts, const float& r);
+
+// Host resident memory high-water mark in bytes, and its reset (Linux
+// clear_refs, silently ignored where unsupported)
+size_t peakResidentMemory();
+void resetPeakResidentMemory();
+
+// Every combination of the values is run warmup times unmeasured then
+// reps times measured. ndarts are fractions of computeN(radius). With
+// spectrum > 0 the periodograms (spectrum x spectrum frequencies) of
+// the measured runs of a combination are averaged, and saved under
+// spectrumprefix if it is set.
+struct BenchmarkSweep{
+  vector<size_t> resolutions;
+  vector<float> radii;
+  vector<float> darts;
+  vector<size_t> threads;
+  size_t warmup;
+  size_t reps;
+  unsigned int seed;
+  size_t spectrum;
+  string spectrumprefix;
+
+  BenchmarkSweep():warmup(0),reps(1),seed(0),spectrum(0){}
+};
+
+// One measured run
+struct BenchmarkRecord{
+  string backend;
+  SampleRunConfig cfg;
+  size_t rep;
+  SampleRunResult res;  // pts are dropped after the quality check
+  size_t npts;
+  size_t peakmem;
+  SampleQuality quality;
+  SpectralQuality spectral; // of all the reps of the combination
+};
+
+// Run the sweep on every backend. Each measured run is printed as a
+// tab separated line on logfile (if not NULL) and kept in records.
+void runBenchmark(const BenchmarkSweep& sweep,
+                  const vector<SamplerBackend*>& backends,
+                  FILE* logfile, vector<BenchmarkRecord>& records);
+
+bool saveBenchmarkCSV(const string& filename,
+                      const vector<SamplerBackend*>& backends,
+                      const vector<BenchmarkRecord>& records);
+bool saveBenchmarkJSON(const string& filename,
+                       const vector<SamplerBackend*>& backends,
+                       const vector<BenchmarkRecord>& records);
+
+// Comma separated lists of command line sweeps, floats may be a/b
+vector<size_t> parseSizeList(const string& s);
+vector<float> parseFloatList(const string& s);
+
+#endif
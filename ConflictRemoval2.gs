@@ -11,7 +11,11 @@ uniform sampler2D impTex;
 //Output triangle
 layout (triangle_strip,max_vertices=3) out;
 out vec2 cirCoord; // Normalized circle coord of vertex
+#ifdef PACKED_FEEDBACK
+flat out uint feedbackPos; // Captured dart, the packed unorm16 x,y
+#else
 out vec2 feedbackPos; // Captured dart position
+#endif
 
 #define SQRT3 (1.7320508075688772935274463415059)
 
@@ -24,6 +28,12 @@ void emitTri(vec3 p, float r){
   gl_Position = vec4(p+vec3(SQRT3,-1,0)*r,1); EmitVertex();
 }
 void main(){
+#ifdef COVERAGE_REJECTION
+  // Darts on covered pixels were marked when they were generated
+  if(dart[0] == 0xffffffffu)
+    return;
+#endif
+
   // Make 3D coordinate in (0,1), z is the gl_PrimitiveIDIn in 24bits
   vec3 p = vec3(unpackUnorm2x16(dart[0]),float(gl_PrimitiveIDIn)/float(0x00ffffff));
 
@@ -32,7 +42,11 @@ void main(){
     return;
 
   // Capture the accepted dart by the transform feedback buffer
+#ifdef PACKED_FEEDBACK
+  feedbackPos = dart[0];
+#else
   feedbackPos = p.xy;
+#endif
 
   // Sample for importance
   //float imp = texture(impTex,p.xy).x;
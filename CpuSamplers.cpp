@@ -0,0 +1,477 @@
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+
+#include "CpuSamplers.hpp"
+#include "Parallel.hpp"
+#include "Timer.hpp"
+
+#define TILECELLS 16
+
+namespace{
+
+// xorshift64*, one stream per tile and pass
+class TileRandom{
+ public:
+  TileRandom(const uint64_t& seed, const uint64_t& stream){
+    s_ = (seed+1)*0x9E3779B97F4A7C15ull ^ (stream+1)*0xD1B54A32D192ED03ull;
+    if(s_ == 0) s_ = 1;
+    for(int i=0; i < 4; i++) next();
+  }
+
+  uint32_t next(){
+    s_ ^= s_ >> 12;
+    s_ ^= s_ << 25;
+    s_ ^= s_ >> 27;
+    return (uint32_t)((s_*0x2545F4914F6CDD1Dull) >> 32);
+  }
+
+  // [0,1)
+  float uniform(){
+    return (next() >> 8)*(1.0f/16777216.0f);
+  }
+
+  // [0,n)
+  size_t below(const size_t& n){
+    return (size_t)(((uint64_t)next()*n) >> 32);
+  }
+
+ private:
+  uint64_t s_;
+};
+
+// Background grid of the unit square, n x n cells of side 1/n <= r/sqrt(2)
+// holding at most one sample each (x < 0 when empty), cut in tiles of
+// tilecells x tilecells cells
+class DiskGrid{
+ public:
+  void init(const float& r){
+    r2_ = r*r;
+    n_ = max((size_t)1, (size_t)ceil(sqrt(2.0)/r));
+    cell_ = 1.0/n_;
+    reach_ = (size_t)ceil(r*n_);
+    //a tile must be wider than the neighbourhood of its samples' samples
+    tilecells_ = max((size_t)TILECELLS, 2*reach_);
+    ntiles_ = (n_+tilecells_-1)/tilecells_;
+    x_.assign(n_*n_, -1.0f);
+    y_.assign(n_*n_, -1.0f);
+  }
+
+  size_t cells() const {return n_;}
+  double cellSize() const {return cell_;}
+  size_t reach() const {return reach_;}
+  size_t tilesPerSide() const {return ntiles_;}
+
+  size_t cellOf(const float& v) const{
+    if(!(v > 0.0f)) return 0;
+    return min((size_t)(v*n_), n_-1);
+  }
+
+  bool occupied(const size_t& cx, const size_t& cy) const{
+    return x_[cy*n_+cx] >= 0.0f;
+  }
+
+  void insert(const float& x, const float& y){
+    size_t c = cellOf(y)*n_ + cellOf(x);
+    x_[c] = x;
+    y_[c] = y;
+  }
+
+  // Cells [cx0,cx1) x [cy0,cy1) of tile t
+  void tileCells(const size_t& t, size_t& cx0, size_t& cy0,
+                 size_t& cx1, size_t& cy1) const{
+    cx0 = (t % ntiles_)*tilecells_;
+    cy0 = (t / ntiles_)*tilecells_;
+    cx1 = min(cx0+tilecells_, n_);
+    cy1 = min(cy0+tilecells_, n_);
+  }
+
+  bool inTile(const size_t& t, const float& x, const float& y) const{
+    if(!(x >= 0.0f && x < 1.0f && y >= 0.0f && y < 1.0f)){
+      return false;
+    }
+    size_t cx0,cy0,cx1,cy1;
+    tileCells(t, cx0, cy0, cx1, cy1);
+    size_t cx = cellOf(x), cy = cellOf(y);
+    return cx >= cx0 && cx < cx1 && cy >= cy0 && cy < cy1;
+  }
+
+  // A sample closer than r to (x,y)
+  bool conflict(const float& x, const float& y) const{
+    size_t cx = cellOf(x), cy = cellOf(y);
+    size_t x0 = cx > reach_ ? cx-reach_ : 0, x1 = min(cx+reach_, n_-1);
+    size_t y0 = cy > reach_ ? cy-reach_ : 0, y1 = min(cy+reach_, n_-1);
+    for(size_t j=y0; j <= y1; j++){
+      for(size_t i=x0; i <= x1; i++){
+        size_t c = j*n_+i;
+        float dx = x_[c]-x, dy = y_[c]-y;
+        if(x_[c] >= 0.0f && dx*dx+dy*dy < r2_){
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // The square of side s at (x,y) lies inside a single disk. Disks are
+  // convex, the four corners are enough.
+  bool covered(const double& x, const double& y, const double& s) const{
+    size_t cx = cellOf(x), cy = cellOf(y);
+    size_t x0 = cx > reach_ ? cx-reach_ : 0;
+    size_t y0 = cy > reach_ ? cy-reach_ : 0;
+    size_t x1 = min(cellOf(x+s)+reach_, n_-1);
+    size_t y1 = min(cellOf(y+s)+reach_, n_-1);
+    for(size_t j=y0; j <= y1; j++){
+      for(size_t i=x0; i <= x1; i++){
+        size_t c = j*n_+i;
+        if(x_[c] < 0.0f){
+          continue;
+        }
+        double dx0 = x-x_[c], dx1 = x+s-x_[c];
+        double dy0 = y-y_[c], dy1 = y+s-y_[c];
+        double dx = max(dx0*dx0, dx1*dx1), dy = max(dy0*dy0, dy1*dy1);
+        if(dx+dy < r2_){
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // Samples within margin cells around tile t
+  void around(const size_t& t, const size_t& margin,
+              vector<float>& pts) const{
+    size_t cx0,cy0,cx1,cy1;
+    tileCells(t, cx0, cy0, cx1, cy1);
+    cx0 = cx0 > margin ? cx0-margin : 0;
+    cy0 = cy0 > margin ? cy0-margin : 0;
+    cx1 = min(cx1+margin, n_);
+    cy1 = min(cy1+margin, n_);
+    for(size_t j=cy0; j < cy1; j++){
+      for(size_t i=cx0; i < cx1; i++){
+        if(occupied(i, j)){
+          pts.push_back(x_[j*n_+i]);
+          pts.push_back(y_[j*n_+i]);
+        }
+      }
+    }
+  }
+
+  // Every sample, row by row
+  void gather(vector<float>& pts) const{
+    pts.clear();
+    for(size_t c=0; c < n_*n_; c++){
+      if(x_[c] >= 0.0f){
+        pts.push_back(x_[c]);
+        pts.push_back(y_[c]);
+      }
+    }
+  }
+
+ private:
+  float r2_;
+  size_t n_;
+  double cell_;
+  size_t reach_;        // cells a disk overlaps on each side
+  size_t tilecells_;
+  size_t ntiles_;
+  vector<float> x_,y_;
+};
+
+// Processing of one tile, called concurrently on tiles of one color
+class TileWork{
+ public:
+  virtual ~TileWork(){}
+  virtual void tile(const size_t& t) = 0;
+};
+
+// The tiles of one color, one at a time to whichever thread is free
+class ColorPass : public ParallelWork{
+ public:
+  ColorPass(TileWork& work, const vector<size_t>& tiles)
+      :work_(work),tiles_(tiles){}
+
+  void range(const size_t& begin, const size_t& end, const size_t&){
+    for(size_t i=begin; i < end; i++){
+      work_.tile(tiles_[i]);
+    }
+  }
+
+ private:
+  TileWork& work_;
+  const vector<size_t>& tiles_;
+};
+
+// One pass per color of the 2x2 checkerboard of tiles, the calling
+// thread takes part in each
+void runColors(const DiskGrid& grid, TileWork& work, const size_t& threads){
+  size_t nt = grid.tilesPerSide();
+  for(size_t color=0; color < 4; color++){
+    vector<size_t> tiles;
+    for(size_t ty=color/2; ty < nt; ty+=2){
+      for(size_t tx=color%2; tx < nt; tx+=2){
+        tiles.push_back(ty*nt+tx);
+      }
+    }
+
+    ColorPass pass(work, tiles);
+    runParallel(pass, tiles.size(), 1, threads);
+  }
+}
+
+class BridsonWork : public TileWork{
+ public:
+  BridsonWork(DiskGrid& grid, const uint64_t& seed, const float& r,
+              const size_t& k)
+      :grid_(grid),seed_(seed),r_(r),k_(k){}
+
+  void tile(const size_t& t){
+    TileRandom rnd(seed_, t);
+    //candidates reach 2r, the samples of the tiles done before that
+    //close to the tile grow into it
+    vector<float> active;
+    grid_.around(t, 2*grid_.reach(), active);
+
+    size_t cx0,cy0,cx1,cy1;
+    grid_.tileCells(t, cx0, cy0, cx1, cy1);
+    double cell = grid_.cellSize();
+    for(size_t i=0; i < k_; i++){
+      float x = (cx0+rnd.uniform()*(cx1-cx0))*cell;
+      float y = (cy0+rnd.uniform()*(cy1-cy0))*cell;
+      if(grid_.inTile(t, x, y) && !grid_.conflict(x, y)){
+        grid_.insert(x, y);
+        active.push_back(x);
+        active.push_back(y);
+        break;
+      }
+    }
+
+    while(!active.empty()){
+      size_t a = rnd.below(active.size()/2);
+      float ax = active[2*a], ay = active[2*a+1];
+      bool found = false;
+      for(size_t i=0; i < k_ && !found; i++){
+        //uniform in the annulus [r,2r)
+        float angle = 2*M_PI*rnd.uniform();
+        float d = r_*sqrt(1+3*rnd.uniform());
+        float x = ax+d*cos(angle), y = ay+d*sin(angle);
+        if(grid_.inTile(t, x, y) && !grid_.conflict(x, y)){
+          grid_.insert(x, y);
+          active.push_back(x);
+          active.push_back(y);
+          found = true;
+        }
+      }
+      if(!found){
+        active[2*a] = active[active.size()-2];
+        active[2*a+1] = active[active.size()-1];
+        active.resize(active.size()-2);
+      }
+    }
+  }
+
+ private:
+  DiskGrid& grid_;
+  uint64_t seed_;
+  float r_;
+  size_t k_;
+};
+
+// Flat quadtree, phase one: darts in random empty cells of the tile
+class ThrowWork : public TileWork{
+ public:
+  ThrowWork(DiskGrid& grid, const uint64_t& seed, const size_t& ndarts)
+      :grid_(grid),seed_(seed),ndarts_(ndarts){}
+
+  void tile(const size_t& t){
+    TileRandom rnd(seed_, t);
+    size_t cx0,cy0,cx1,cy1;
+    grid_.tileCells(t, cx0, cy0, cx1, cy1);
+    double cell = grid_.cellSize();
+
+    vector<uint32_t> cells;
+    for(size_t j=cy0; j < cy1; j++){
+      for(size_t i=cx0; i < cx1; i++){
+        if(!grid_.covered(i*cell, j*cell, cell)){
+          cells.push_back(j*grid_.cells()+i);
+        }
+      }
+    }
+
+    //the share of the darts of the tile, rounded at random
+    double share = (double)ndarts_*(cx1-cx0)*(cy1-cy0)/
+        ((double)grid_.cells()*grid_.cells());
+    size_t darts = (size_t)share + (rnd.uniform() < share-floor(share));
+    for(size_t d=0; d < darts && !cells.empty(); d++){
+      size_t i = rnd.below(cells.size());
+      size_t cx = cells[i] % grid_.cells(), cy = cells[i] / grid_.cells();
+      float x = (cx+rnd.uniform())*cell, y = (cy+rnd.uniform())*cell;
+      if(grid_.inTile(t, x, y) && !grid_.conflict(x, y)){
+        grid_.insert(x, y);
+        cells[i] = cells.back();
+        cells.pop_back();
+      }
+    }
+  }
+
+ private:
+  DiskGrid& grid_;
+  uint64_t seed_;
+  size_t ndarts_;
+};
+
+// Flat quadtree, phase two: the voids left in the tile, refined until
+// they are all covered
+class RefineWork : public TileWork{
+ public:
+  RefineWork(DiskGrid& grid, const uint64_t& seed, const size_t& maxlevels)
+      :grid_(grid),seed_(seed),maxlevels_(maxlevels),
+       levels_(grid.tilesPerSide()*grid.tilesPerSide(), 0){}
+
+  size_t levels() const{
+    return *max_element(levels_.begin(), levels_.end());
+  }
+
+  void tile(const size_t& t){
+    //another stream than the throw pass of the tile
+    TileRandom rnd(seed_, t+levels_.size());
+    size_t cx0,cy0,cx1,cy1;
+    grid_.tileCells(t, cx0, cy0, cx1, cy1);
+
+    //squares of side s, doubles keep deep levels exact
+    double s = grid_.cellSize();
+    vector<double> squares,next;
+    for(size_t j=cy0; j < cy1; j++){
+      for(size_t i=cx0; i < cx1; i++){
+        squares.push_back(i*s);
+        squares.push_back(j*s);
+      }
+    }
+
+    size_t level = 0;
+    for(; level < maxlevels_; level++){
+      //drop the squares of cells with a sample and those inside a disk
+      next.clear();
+      for(size_t q=0; q < squares.size(); q+=2){
+        double x = squares[q], y = squares[q+1];
+        if(!grid_.occupied(grid_.cellOf(x+s/2), grid_.cellOf(y+s/2)) &&
+           !grid_.covered(x, y, s)){
+          next.push_back(x);
+          next.push_back(y);
+        }
+      }
+      squares.swap(next);
+      if(squares.empty()){
+        break;
+      }
+
+      //a dart per square in random order
+      size_t n = squares.size()/2;
+      for(size_t q=n; q > 1; q--){
+        size_t o = rnd.below(q);
+        swap(squares[2*(q-1)], squares[2*o]);
+        swap(squares[2*(q-1)+1], squares[2*o+1]);
+      }
+      for(size_t q=0; q < n; q++){
+        double sx = squares[2*q], sy = squares[2*q+1];
+        if(grid_.occupied(grid_.cellOf(sx+s/2), grid_.cellOf(sy+s/2))){
+          continue;
+        }
+        float x = sx+rnd.uniform()*s, y = sy+rnd.uniform()*s;
+        if(grid_.inTile(t, x, y) && !grid_.conflict(x, y)){
+          grid_.insert(x, y);
+        }
+      }
+
+      //the four children of each square
+      next.clear();
+      double h = s/2;
+      for(size_t q=0; q < n; q++){
+        double sx = squares[2*q], sy = squares[2*q+1];
+        if(grid_.occupied(grid_.cellOf(sx+h), grid_.cellOf(sy+h))){
+          continue;
+        }
+        double children[8] = {sx,sy, sx+h,sy, sx,sy+h, sx+h,sy+h};
+        next.insert(next.end(), children, children+8);
+      }
+      squares.swap(next);
+      s = h;
+    }
+    levels_[t] = level;
+  }
+
+ private:
+  DiskGrid& grid_;
+  uint64_t seed_;
+  size_t maxlevels_;
+  vector<size_t> levels_;  // per tile, written by the tile's thread
+};
+
+uint64_t runSeed(const SampleRunConfig& cfg){
+  return cfg.seed ? cfg.seed : (uint64_t)time(NULL);
+}
+
+}
+
+const char* BridsonBackend::phaseName(const size_t& i) const{
+  static const char* names[] = {"grid", "sample", "gather"};
+  return (i < 3) ? names[i] : NULL;
+}
+
+void BridsonBackend::run(const SampleRunConfig& cfg, SampleRunResult& res){
+  Timer timer,total;
+  total.start();
+
+  timer.start();
+  DiskGrid grid;
+  grid.init(cfg.radius);
+  res.phases[0] = timer.stop();
+
+  timer.start();
+  BridsonWork work(grid, runSeed(cfg), cfg.radius, k_);
+  runColors(grid, work, cfg.threads);
+  res.phases[1] = timer.stop();
+
+  timer.start();
+  grid.gather(res.pts);
+  res.phases[2] = timer.stop();
+
+  res.iterations = 4; //passes over the tiles
+  res.elapsed = total.stop();
+}
+
+const char* QuadtreeBackend::phaseName(const size_t& i) const{
+  static const char* names[] = {"grid", "throw", "refine", "gather"};
+  return (i < 4) ? names[i] : NULL;
+}
+
+void QuadtreeBackend::run(const SampleRunConfig& cfg, SampleRunResult& res){
+  Timer timer,total;
+  total.start();
+  uint64_t seed = runSeed(cfg);
+
+  timer.start();
+  DiskGrid grid;
+  grid.init(cfg.radius);
+  res.phases[0] = timer.stop();
+
+  timer.start();
+  ThrowWork throwing(grid, seed, cfg.ndarts);
+  runColors(grid, throwing, cfg.threads);
+  res.phases[1] = timer.stop();
+
+  timer.start();
+  RefineWork refine(grid, seed, maxlevels_);
+  runColors(grid, refine, cfg.threads);
+  res.phases[2] = timer.stop();
+
+  timer.start();
+  grid.gather(res.pts);
+  res.phases[3] = timer.stop();
+
+  res.iterations = refine.levels(); //deepest refinement
+  res.elapsed = total.stop();
+}
@@ -0,0 +1,54 @@
+#ifndef __CPUSAMPLERS__
+#define __CPUSAMPLERS__
+
+#include "Benchmark.hpp"
+
+// Host reference samplers for the benchmark driver, both in the unit
+// square (the resolution of the run is ignored) on a background grid
+// of cells of side at most r/sqrt(2), one sample per cell.
+//
+// The grid is cut in square tiles processed by cfg.threads threads in
+// four passes, one per color of a 2x2 checkerboard of tiles. Tiles of
+// the same color are at least a tile (more than r) apart, so a thread
+// writes only the cells of its tile and reads the cells around it,
+// which no other thread is writing. Every tile draws from its own
+// random stream seeded from cfg.seed: the samples do not depend on the
+// number of threads.
+
+// Bridson's algorithm ("Fast Poisson disk sampling in arbitrary
+// dimensions", 2007): grow the set from active samples, k candidates
+// in the annulus [r,2r) around a random active sample. A tile starts
+// from the samples of the tiles done before it and from a random dart.
+// Not maximal, the coverage reports how close it gets.
+class BridsonBackend : public SamplerBackend{
+ public:
+  BridsonBackend(const size_t& k = 30):k_(k){}
+
+  string name() const {return "bridson";}
+  const char* phaseName(const size_t& i) const;
+  bool threaded() const {return true;}
+  void run(const SampleRunConfig& cfg, SampleRunResult& res);
+
+ private:
+  size_t k_;  // candidates per active sample
+};
+
+// Maximal sampling on a flat quadtree (Ebeida et al., "Efficient
+// maximal Poisson-disk sampling", 2011). cfg.ndarts darts are thrown
+// in random empty cells, then the cells left are split in four, the
+// children inside a disk are dropped and a dart is thrown in each of
+// the others, level after level until none is left.
+class QuadtreeBackend : public SamplerBackend{
+ public:
+  QuadtreeBackend(const size_t& maxlevels = 20):maxlevels_(maxlevels){}
+
+  string name() const {return "quadtree";}
+  const char* phaseName(const size_t& i) const;
+  bool threaded() const {return true;}
+  void run(const SampleRunConfig& cfg, SampleRunResult& res);
+
+ private:
+  size_t maxlevels_;  // refinement levels before giving up on a void
+};
+
+#endif
@@ -22,6 +22,12 @@ void emitTri(vec3 p, float r){
   gl_Position = vec4(p+vec3(SQRT3,-1,0)*r,1); EmitVertex();
 }
 void main(){
+#ifdef COVERAGE_REJECTION
+  // Darts on covered pixels were marked when they were generated
+  if(dart[0] == 0xffffffffu)
+    return;
+#endif
+
   // Make 3D coordinate in (0,1), z is the gl_PrimitiveIDIn in 24bits
   vec3 p = vec3(unpackUnorm2x16(dart[0]),float(gl_PrimitiveIDIn)/float(0x00ffffff));
 
@@ -0,0 +1,88 @@
+
+#include <cassert>
+
+#include "GpuTimer.hpp"
+
+GpuTimer::GpuTimer(const size_t& nphases, const size_t& depth)
+    :nphases_(nphases),depth_(depth),head_(0),tail_(0),gpu0_(0),cpu0_(0){
+  assert(nphases_ > 0 && depth_ > 0);
+  queries_.resize(depth_*(nphases_+1));
+  glGenQueries(queries_.size(), &queries_[0]);
+}
+
+GpuTimer::~GpuTimer(){
+  glDeleteQueries(queries_.size(), &queries_[0]);
+}
+
+void GpuTimer::begin(){
+  if(head_-tail_ == depth_){ //ring full, the oldest frame must finish
+    readBack(true);
+  }
+  glQueryCounter(query(head_,0), GL_TIMESTAMP);
+}
+
+void GpuTimer::mark(const size_t& phase){
+  assert(phase < nphases_);
+  glQueryCounter(query(head_,phase+1), GL_TIMESTAMP);
+  if(phase+1 == nphases_){
+    head_++;
+  }
+}
+
+//Read back the oldest frame, returns false if it is not ready
+bool GpuTimer::readBack(const bool& wait){
+  if(tail_ == head_){
+    return false;
+  }
+  GLuint last = query(tail_,nphases_);
+  if(!wait){
+    GLint available = 0;
+    glGetQueryObjectiv(last, GL_QUERY_RESULT_AVAILABLE, &available);
+    if(!available){
+      return false;
+    }
+  }
+
+  Frame f;
+  f.id = tail_;
+  f.stamps.resize(nphases_+1);
+  for(size_t i=0; i <= nphases_; i++){
+    glGetQueryObjectui64v(query(tail_,i), GL_QUERY_RESULT, &f.stamps[i]);
+  }
+  frames_.push_back(f);
+  tail_++;
+  return true;
+}
+
+size_t GpuTimer::poll(){
+  size_t n = 0;
+  while(readBack(false)){
+    n++;
+  }
+  return n;
+}
+
+void GpuTimer::drain(){
+  while(readBack(true));
+}
+
+double GpuTimer::phaseTime(const Frame& f, const size_t& phase) const{
+  return (f.stamps[phase+1]-f.stamps[phase])*1e-9;
+}
+
+double GpuTimer::totalTime(const size_t& phase) const{
+  double total = 0;
+  for(size_t i=0; i < frames_.size(); i++){
+    total += phaseTime(frames_[i], phase);
+  }
+  return total;
+}
+
+void GpuTimer::calibrate(const double& now){
+  glGetInteger64v(GL_TIMESTAMP, &gpu0_);
+  cpu0_ = now;
+}
+
+double GpuTimer::toSeconds(const GLuint64& stamp) const{
+  return cpu0_ + ((GLint64)stamp - gpu0_)*1e-9;
+}
@@ -0,0 +1,55 @@
+#ifndef __GPUTIMER__
+#define __GPUTIMER__
+
+#include <GL/glew.h>
+
+#include <vector>
+using namespace std;
+
+// Phase timing on the GL timeline with GL_TIMESTAMP queries. A frame
+// (one sampler iteration) records a timestamp at begin() and one per
+// mark(). Frames live in a ring of query objects and are read back
+// with poll() once their last query is available, so timing does not
+// stall the pipeline unless the ring is full.
+class GpuTimer{
+ public:
+  struct Frame{
+    size_t id;
+    vector<GLuint64> stamps; // ns, stamps[0] is the frame begin
+  };
+
+  GpuTimer(const size_t& nphases, const size_t& depth=16);
+  ~GpuTimer();
+
+  void begin();
+  void mark(const size_t& phase);
+
+  // Read back the finished frames without waiting, returns the count
+  size_t poll();
+  // Wait for and read back every pending frame
+  void drain();
+
+  const vector<Frame>& frames() const {return frames_;}
+  double phaseTime(const Frame& f, const size_t& phase) const;
+  // Total time of a phase over all the frames read back
+  double totalTime(const size_t& phase) const;
+  // Map a GL timestamp to seconds on the clock passed to calibrate()
+  void calibrate(const double& now);
+  double toSeconds(const GLuint64& stamp) const;
+
+ private:
+  const size_t nphases_;
+  const size_t depth_;
+  vector<GLuint> queries_;   // depth_ slots of nphases_+1 queries
+  size_t head_,tail_;        // issued / read back frames
+  GLint64 gpu0_;
+  double cpu0_;
+  vector<Frame> frames_;
+
+  GLuint query(const size_t& frame, const size_t& i) const{
+    return queries_[(frame % depth_)*(nphases_+1) + i];
+  }
+  bool readBack(const bool& wait);
+};
+
+#endif
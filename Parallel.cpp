@@ -0,0 +1,80 @@
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+using namespace std;
+
+#include "Parallel.hpp"
+
+namespace{
+
+class RangeWork : public ParallelWork{
+ public:
+  RangeWork(void (*function)(void*, size_t, size_t), void* context)
+      :function_(function),context_(context){}
+  void range(const size_t& begin, const size_t& end, const size_t&){
+    function_(context_, begin, end);
+  }
+
+ private:
+  void (*function_)(void*, size_t, size_t);
+  void* context_;
+};
+
+struct ParallelRun{
+  ParallelWork* work;
+  size_t n,chunk;
+  size_t next,nextthread;
+};
+
+void* parallelWorker(void* arg){
+  ParallelRun* run = (ParallelRun*)arg;
+  size_t thread = __sync_fetch_and_add(&run->nextthread, 1);
+  for(;;){
+    size_t begin = __sync_fetch_and_add(&run->next, run->chunk);
+    if(begin >= run->n){
+      break;
+    }
+    run->work->range(begin, min(begin+run->chunk, run->n), thread);
+  }
+  return NULL;
+}
+
+}
+
+void runParallel(ParallelWork& work, const size_t& n, const size_t& chunk,
+                 const size_t& threads){
+  ParallelRun run;
+  run.work = &work;
+  run.n = n;
+  run.chunk = max(chunk, (size_t)1);
+  run.next = 0;
+  run.nextthread = 0;
+  vector<pthread_t> workers(max(threads, (size_t)1)-1);
+  size_t started = 0;
+  for(; started < workers.size(); started++){
+    if(pthread_create(&workers[started], NULL, parallelWorker, &run) != 0){
+      break; //fewer threads, the work is the same
+    }
+  }
+  parallelWorker(&run);
+  for(size_t i=0; i < started; i++){
+    pthread_join(workers[i], NULL);
+  }
+}
+
+size_t parallelThreads(const size_t& threads){
+  if(threads > 0){
+    return threads;
+  }
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return (n > 0) ? n : 1;
+}
+
+void parallelRanges(void (*function)(void* context, size_t begin, size_t end),
+                    void* context, size_t n, size_t chunk, unsigned threads){
+  RangeWork work(function, context);
+  runParallel(work, n, chunk, parallelThreads(threads));
+}
@@ -0,0 +1,26 @@
+#ifndef __PARALLEL__
+#define __PARALLEL__
+
+#include <cstddef>
+
+// Work over [0,n) in chunks, shared by the calling thread and
+// threads-1 pthreads. thread numbers the callers from 0 to threads-1,
+// for per-thread accumulators.
+class ParallelWork{
+ public:
+  virtual ~ParallelWork(){}
+  virtual void range(const size_t& begin, const size_t& end,
+                     const size_t& thread) = 0;
+};
+
+void runParallel(ParallelWork& work, const size_t& n, const size_t& chunk,
+                 const size_t& threads);
+
+// threads, or the number of online processors for 0
+size_t parallelThreads(const size_t& threads);
+
+// runParallel for a C callback, fits LodePNGCompressSettings::parallel_for
+void parallelRanges(void (*function)(void* context, size_t begin, size_t end),
+                    void* context, size_t n, size_t chunk, unsigned threads);
+
+#endif
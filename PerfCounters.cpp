@@ -0,0 +1,125 @@
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "PerfCounters.hpp"
+
+static const uint64_t CACHELINE = 64;
+
+PerfCounters::Counts::Counts(){
+  memset(v, 0, sizeof(v));
+}
+
+PerfCounters::Counts& PerfCounters::Counts::operator+=(const Counts& b){
+  for(size_t i=0; i < NEVENTS; i++){
+    v[i] += b.v[i];
+  }
+  return *this;
+}
+
+double PerfCounters::Counts::ipc() const{
+  return v[CYCLES] ? (double)v[INSTRUCTIONS]/v[CYCLES] : 0;
+}
+
+static int openEvent(const uint64_t& config, const int& group){
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.disabled = (group < 0); //the group starts with its leader
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+PerfCounters::PerfCounters():enabled0_(0),running0_(0){
+  static const uint64_t config[NEVENTS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+  leader_ = openEvent(config[0], -1);
+  for(size_t i=0; i < NEVENTS; i++){
+    //a missing event is left at zero, only the cycles are mandatory
+    fd_[i] = leader_;
+    if(i > 0){
+      fd_[i] = (leader_ >= 0) ? openEvent(config[i], leader_) : -1;
+    }
+    id_[i] = ~(uint64_t)0;
+    if(fd_[i] >= 0){
+      ioctl(fd_[i], PERF_EVENT_IOC_ID, &id_[i]);
+    }
+  }
+  if(leader_ >= 0){
+    ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+  else{
+    perror("perf_event_open");
+  }
+}
+
+PerfCounters::~PerfCounters(){
+  for(size_t i=0; i < NEVENTS; i++){
+    if(fd_[i] >= 0) close(fd_[i]);
+  }
+}
+
+bool PerfCounters::read(Counts& c, uint64_t& enabled,
+                        uint64_t& running) const{
+  uint64_t buf[3 + 2*NEVENTS];
+  if(leader_ < 0 || ::read(leader_, buf, sizeof(buf)) <= 0){
+    return false;
+  }
+  enabled = buf[1];
+  running = buf[2];
+  for(size_t j=0; j < buf[0] && j < NEVENTS; j++){
+    for(size_t i=0; i < NEVENTS; i++){
+      if(id_[i] == buf[4+2*j]){
+        c.v[i] = buf[3+2*j];
+      }
+    }
+  }
+  return true;
+}
+
+void PerfCounters::start(){
+  begin_ = Counts();
+  read(begin_, enabled0_, running0_);
+}
+
+PerfCounters::Counts PerfCounters::stop(){
+  Counts end,delta;
+  uint64_t enabled,running;
+  if(!read(end, enabled, running)){
+    return delta;
+  }
+
+  //scale up when the group was only on the PMU part of the time
+  double scale = 1;
+  if(running > running0_){
+    scale = (double)(enabled-enabled0_)/(running-running0_);
+  }
+  for(size_t i=0; i < NEVENTS; i++){
+    delta.v[i] = (uint64_t)((end.v[i]-begin_.v[i])*scale);
+  }
+  total_ += delta;
+  return delta;
+}
+
+void PerfCounters::report(FILE* f, const string& name, const Counts& c,
+                          const double& npixels){
+  fprintf(f, "#perf %-10s cycles %llu instr %llu IPC %.2f "
+          "llc-miss %llu branch-miss %llu bytes/pixel %.3f\n",
+          name.c_str(), (unsigned long long)c.v[CYCLES],
+          (unsigned long long)c.v[INSTRUCTIONS], c.ipc(),
+          (unsigned long long)c.v[LLC_MISSES],
+          (unsigned long long)c.v[BRANCH_MISSES],
+          npixels > 0 ? c.v[LLC_MISSES]*CACHELINE/npixels : 0.0);
+}
@@ -0,0 +1,55 @@
+#ifndef __PERFCOUNTERS__
+#define __PERFCOUNTERS__
+
+#include <stdint.h>
+
+#include <cstdio>
+#include <string>
+using namespace std;
+
+// Hardware counters of the calling thread through Linux perf_event_open:
+// cycles, instructions, last level cache misses and branch misses, read
+// as one group. Counts accumulate over start()/stop() pairs and are
+// scaled when the kernel multiplexed the group. User space only, so it
+// works with the default perf_event_paranoid setting.
+class PerfCounters{
+ public:
+  enum Event {CYCLES, INSTRUCTIONS, LLC_MISSES, BRANCH_MISSES, NEVENTS};
+
+  struct Counts{
+    uint64_t v[NEVENTS];
+    Counts();
+    Counts& operator+=(const Counts& b);
+    double ipc() const;
+  };
+
+  PerfCounters();
+  ~PerfCounters();
+
+  // False if the counters could not be opened (no PMU, paranoid, ...)
+  bool ok() const {return leader_ >= 0;}
+
+  void start();
+  // Counts since start(), also added to total()
+  Counts stop();
+
+  const Counts& total() const {return total_;}
+  void clear() {total_ = Counts();}
+
+  // One line: cycles, instructions, IPC, LLC misses, branch misses and
+  // the bytes per pixel the LLC misses moved for npixels pixels
+  static void report(FILE* f, const string& name, const Counts& c,
+                     const double& npixels);
+
+ private:
+  int leader_;
+  int fd_[NEVENTS];
+  uint64_t id_[NEVENTS];
+  Counts total_;
+
+  bool read(Counts& c, uint64_t& enabled, uint64_t& running) const;
+  Counts begin_;
+  uint64_t enabled0_,running0_;
+};
+
+#endif
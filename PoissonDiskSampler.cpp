@@ -16,20 +16,53 @@ using namespace std;
 #include "lodepng.h"
 
 #include "Timer.hpp"
+#include "Parallel.hpp"
+#include "Probe.hpp"
+#include "SampleRing.hpp"
+#include "SampleSet.hpp"
+#include "TileStats.hpp"
+
+#include <sched.h>
 
 #define MINDARTS 1024
 
+float computeR(const size_t& n){
+  return 0.7766*sqrt(2.0/(sqrt(3.0)*n));
+}
+
+size_t computeN(const float& r){
+  return 2.0/(sqrt(3.0)*pow(r/0.7766,2));
+}
+
 PoissonDiskSampler::PoissonDiskSampler(const size_t& w, const size_t& h,
                                        const size_t& nd, const float& rd)
-    :width_(w),height_(h),ndarts_(nd),ond_(nd),dartradius_(rd),res_offset_(0){
+    :plan_(w,h,nd,rd),width_(w),height_(h),ndarts_(nd),ond_(nd),
+     dartradius_(rd),res_offset_(0),published_offset_(0),accepted_(0),
+     importancetex_(0),importancewidth_(0),importanceheight_(0),
+     cuda_thrust_ogl_obj_(NULL){
   assert(width_ > 0);
   assert(height_ > 0);
   assert(ndarts_ > 0);
   assert(dartradius_ > 0);
+  lodepng_arena_init(&pngarena_);
+}
+
+PoissonDiskSampler::PoissonDiskSampler(const SamplerPlan& plan)
+    :plan_(plan),width_(plan.tilewidth),height_(plan.tileheight),
+     ndarts_(plan.ndarts),ond_(plan.ndarts),dartradius_(plan.radius),
+     res_offset_(0),published_offset_(0),accepted_(0),
+     importancetex_(0),importancewidth_(0),importanceheight_(0),
+     cuda_thrust_ogl_obj_(NULL){
+  assert(width_ > 0);
+  assert(height_ > 0);
+  assert(ndarts_ > 0);
+  assert(dartradius_ > 0);
+  lodepng_arena_init(&pngarena_);
 }
 
 PoissonDiskSampler::~PoissonDiskSampler(){
   cleanup();
+  lodepng_arena_cleanup(&pngarena_);
 }
 
 //Initial the FBO and textures for dart throwing and conflict checking
@@ -81,13 +114,22 @@ void PoissonDiskSampler::initFBO(){
 
 void PoissonDiskSampler::initPrograms(){
   // Create and compile our GLSL program from the shaders
+  //the storage choices of the plan are shader defines
+  string defines;
+  if(plan_.packedcoords){
+    defines += "#define PACKED_FEEDBACK\n";
+  }
+  if(!plan_.emptylist){
+    defines += "#define COVERAGE_REJECTION\n";
+  }
+
   programThrow_ = LoadShaders( "VertexShader.vs",
                                "DartThrowing1.gs",
-                               "FragmentShader1.fs" );
+                               "FragmentShader1.fs", defines );
 
   programRemove_ = LoadShaders( "VertexShader.vs",
                                 "ConflictRemoval2.gs",
-                                "FragmentShader2.fs" );
+                                "FragmentShader2.fs", defines );
 
   // Setup transform feedback at geometry shader of 2nd pass
   GLchar const * Strings[] = {"feedbackPos"};
@@ -118,6 +160,7 @@ void PoissonDiskSampler::initPrograms(){
 
 //Initialize buffers, vertex arrays, call cuda init and fbo init
 size_t PoissonDiskSampler::init(){
+  PROBE_ZONE("init");
   cuda_thrust_ogl_obj_ = new cudaThrustOGL;
   size_t oldmem = cuda_thrust_ogl_obj_->freeGPUMem();
 
@@ -129,18 +172,20 @@ size_t PoissonDiskSampler::init(){
   glBufferData(GL_ARRAY_BUFFER,sizeof(GLuint)*ndarts_,NULL,GL_DYNAMIC_DRAW);
 
   // Setup empty List Buffer
+  //(a single element without the list, cuda still registers it)
   glGenBuffers(1, &emptylistBuffer_);
   glBindBuffer(GL_ARRAY_BUFFER, emptylistBuffer_);
-  glBufferData(GL_ARRAY_BUFFER,sizeof(GLuint)*width_*height_,NULL,
+  glBufferData(GL_ARRAY_BUFFER,
+               sizeof(GLuint)*(plan_.emptylist ? width_*height_ : 1),NULL,
                GL_DYNAMIC_DRAW);
 
   // Setup result buffer
   //120% of the estimate # of samples
-  resultsbuffer_size_ = 2.0/(sqrt(3.0)*pow(dartradius_/0.7766,2))*1.2;
+  resultsbuffer_size_ = plan_.resultsCapacity();
   glGenBuffers(1, &resultsBuffer_);
   glBindBuffer(GL_ARRAY_BUFFER, resultsBuffer_);
-  glBufferData(GL_ARRAY_BUFFER,sizeof(GLfloat)*2*3*resultsbuffer_size_,NULL,
-               GL_STATIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER,plan_.feedbackStride()*resultsbuffer_size_,
+               NULL,GL_STATIC_DRAW);
 
   // Setup primitive query object
   glGenQueries(1,&query_);
@@ -156,6 +201,7 @@ size_t PoissonDiskSampler::init(){
   cuda_thrust_ogl_obj_->cudaInit(coverageTexture_, sourceBuffer_,
                                  emptylistBuffer_, resultsBuffer_,
                                  width_,height_);
+  cuda_thrust_ogl_obj_->setEmptyList(plan_.emptylist);
 
   reset();
   glFinish();
@@ -163,6 +209,7 @@ size_t PoissonDiskSampler::init(){
 }
 
 void PoissonDiskSampler::reset(){
+  PROBE_ZONE("reset");
   glBindVertexArray(VertexArrayID_);
   glEnableVertexAttribArray(0);
   glBindBuffer(GL_ARRAY_BUFFER, sourceBuffer_);
@@ -176,6 +223,7 @@ void PoissonDiskSampler::reset(){
 
   //reset results
   res_offset_ = 0;
+  published_offset_ = 0;
   //reset ndarts
   ndarts_=ond_;
   //reset cuda
@@ -207,9 +255,19 @@ void PoissonDiskSampler::cleanup(){
   glFinish();
 }
 
+//Insert the defines after the #version line of a shader
+static void addDefines(string& code, const string& defines){
+  if(defines.empty()){
+    return;
+  }
+  size_t eol = code.find('\n');
+  code.insert((eol == string::npos) ? code.size() : eol+1, defines);
+}
+
 GLuint PoissonDiskSampler::LoadShaders(const string& vertex_file_path,
                                        const string& geometry_file_path,
-                                       const string& fragment_file_path){
+                                       const string& fragment_file_path,
+                                       const string& defines){
 
   // Create the shaders
   GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
@@ -248,6 +306,10 @@ GLuint PoissonDiskSampler::LoadShaders(const string& vertex_file_path,
     FragmentShaderStream.close();
   }
 
+  addDefines(VertexShaderCode, defines);
+  addDefines(GeometryShaderCode, defines);
+  addDefines(FragmentShaderCode, defines);
+
   GLint Result = GL_FALSE;
   int InfoLogLength;
 
@@ -313,19 +375,26 @@ GLuint PoissonDiskSampler::LoadShaders(const string& vertex_file_path,
   return ProgramID;
 }
 
+void PoissonDiskSampler::generateDarts(){
+  PROBE_ZONE("generateDarts");
+  //without the list the darts fall anywhere, covered ones are dropped
+  if(plan_.emptylist){
+    ndarts_ = min(ndarts_, cuda_thrust_ogl_obj_->getRemainingDarts());
+  }
+  ndarts_ = max(ndarts_, (size_t)MINDARTS);
+
+  //Generate some random darts
+  cuda_thrust_ogl_obj_->makeVertices(ndarts_);
+}
+
 void PoissonDiskSampler::throwDarts(){
+  PROBE_ZONE("throwDarts");
   glEnable(GL_DEPTH_TEST);
   glDepthFunc(GL_LESS);
 
   glClearDepth(1.0f);
   glClear(GL_DEPTH_BUFFER_BIT);
 
-  ndarts_ = min(ndarts_, cuda_thrust_ogl_obj_->getRemainingDarts());
-  ndarts_ = max(ndarts_, (size_t)MINDARTS);
-
-  //Generate some random darts
-  cuda_thrust_ogl_obj_->makeVertices(ndarts_);
-
   glDrawBuffer(GL_NONE); //no render targets
   glUseProgram(programThrow_);
 
@@ -333,6 +402,7 @@ void PoissonDiskSampler::throwDarts(){
 }
 
 void PoissonDiskSampler::removeConflict(){
+  PROBE_ZONE("removeConflict");
   glDisable(GL_DEPTH_TEST);
 
   glActiveTexture(GL_TEXTURE0);
@@ -345,8 +415,8 @@ void PoissonDiskSampler::removeConflict(){
   //bind buffer for capturing results
   glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0,
                     resultsBuffer_,
-                    res_offset_*2*sizeof(GLfloat)*3,
-                    (resultsbuffer_size_-res_offset_)*2*sizeof(GLfloat)*3);
+                    res_offset_*plan_.feedbackStride(),
+                    (resultsbuffer_size_-res_offset_)*plan_.feedbackStride());
 
   glDrawBuffer(GL_COLOR_ATTACHMENT0);
 
@@ -363,25 +433,136 @@ void PoissonDiskSampler::removeConflict(){
   GLuint PrimitivesWritten = 0; //query for the # of accepted darts
   glGetQueryObjectuiv(query_, GL_QUERY_RESULT, &PrimitivesWritten);
   //cout << PrimitivesWritten << endl;
+  accepted_ = PrimitivesWritten;
+  if(cuda_thrust_ogl_obj_->tileStatsEnabled()){
+    cuda_thrust_ogl_obj_->countAccepted(res_offset_, PrimitivesWritten,
+                                        plan_.packedcoords);
+  }
   res_offset_ += PrimitivesWritten;
 }
 
 //Count the empty pixels by call thrust
 size_t  PoissonDiskSampler::collectEmptyPixels(){
+  PROBE_ZONE("collectEmptyPixels");
   return cuda_thrust_ogl_obj_->thrustCountEmptyPixels();
 }
 
-void PoissonDiskSampler::loadImportanceMap(const string& filename){
-  std::vector<unsigned char> image; //the raw pixels
+size_t PoissonDiskSampler::sample(const size_t& maxitr){
+  PROBE_ZONE("sample");
+  size_t emptypixels = 0;
+  size_t itr = 0;
+  do{
+    generateDarts();
+    throwDarts();
+    removeConflict();
+    emptypixels = collectEmptyPixels();
+    itr++;
+  }
+  while(emptypixels > 0 && itr < maxitr);
+  return itr;
+}
+
+void PoissonDiskSampler::setSeed(const unsigned int& seed){
+  cuda_thrust_ogl_obj_->setSeed(seed);
+}
+
+unsigned int PoissonDiskSampler::getSeed() const{
+  return cuda_thrust_ogl_obj_->getSeed();
+}
+
+unsigned int PoissonDiskSampler::loadImportanceMap(const string& filename,
+                                                   const unsigned int& x,
+                                                   const unsigned int& y,
+                                                   const unsigned int& w,
+                                                   const unsigned int& h){
+  vector<unsigned char> png;
+  lodepng::load_file(png, filename);
+  unsigned int error = loadImportanceMap(png, x, y, w, h);
+  if(error){
+    cerr << "Importance Map: " << filename << ": "
+         << lodepng_error_text(error) << endl;
+    return error;
+  }
+  cout << "Importance Map: " << importancewidth_ << " " << importanceheight_
+       << endl;
+  return 0;
+}
+
+//Load the importance map from an in-memory png. It's decoded row by row
+//straight into a mapped pixel unpack buffer the texture is filled from,
+//never whole in client memory. Rows below the region aren't decoded, the
+//ones above aren't converted, and the shaders read the map in normalized
+//coordinates so a downscaled map covers the same square. A failed load
+//leaves no map active
+unsigned int PoissonDiskSampler::loadImportanceMap(
+    const vector<unsigned char>& png, const unsigned int& x,
+    const unsigned int& y, const unsigned int& w, const unsigned int& h){
+  PROBE_ZONE("loadImportanceMap");
+  const unsigned char* data = png.empty() ? NULL : &png[0];
+  lodepng::State state; //decodes to RGBA8
+  LodePNGAllocator allocator;
+  lodepng_arena_allocator(&allocator, &pngarena_);
+  state.decoder.allocator = &allocator;
   unsigned int iwidth, iheight;
+  unsigned int error = lodepng_inspect(&iwidth, &iheight, &state, data,
+                                       png.size());
+  if(!error && (w == 0) != (h == 0)){
+    error = 88; //a region needs both sizes, lodepng would take the whole map
+  }
+  if(error){
+    unloadImportanceMap();
+    return error;
+  }
 
-  //decode
-  unsigned int error = lodepng::decode(image, iwidth, iheight,
-                                       std::string(filename));
-  assert(error == 0);
-  cout << "Importance Map: " << iwidth << " " << iheight << endl;
+  if(w != 0){
+    state.decoder.region_x = x;
+    state.decoder.region_y = y;
+    state.decoder.region_w = iwidth = w;
+    state.decoder.region_h = iheight = h;
+  }
+  //No more texels than samples can tell apart
+  if(iwidth > width_) iwidth = state.decoder.scale_w = width_;
+  if(iheight > height_) iheight = state.decoder.scale_h = height_;
+  createImportanceTexture(iwidth, iheight);
+
+  GLuint unpack;
+  size_t size = 4*(size_t)iwidth*iheight;
+  glGenBuffers(1, &unpack);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpack);
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+  unsigned char* pixels =
+      (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                       GL_MAP_WRITE_BIT |
+                                       GL_MAP_INVALIDATE_BUFFER_BIT);
+  if(pixels == NULL){
+    error = 83; //the buffer could not be mapped
+  }
+  else{
+    {
+      PROBE_ZONE("lodepng_decode");
+      error = lodepng_decode_into(pixels, size, &iwidth, &iheight, &state,
+                                  data, png.size());
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  }
+
+  if(!error){
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, iwidth, iheight,
+                    GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glDeleteBuffers(1, &unpack);
+  if(error){ //don't sample with an undefined map
+    unloadImportanceMap();
+  }
+  return error;
+}
 
-  glGenTextures(1,&importancetex_);
+void PoissonDiskSampler::createImportanceTexture(const unsigned int& iwidth,
+                                                 const unsigned int& iheight){
+  if(importancetex_ == 0){ //reuse the texture of a previous map
+    glGenTextures(1,&importancetex_);
+  }
 
   glActiveTexture(GL_TEXTURE0+1);
   glBindTexture(GL_TEXTURE_2D, importancetex_);
@@ -391,10 +572,86 @@ void PoissonDiskSampler::loadImportanceMap(const string& filename){
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
 
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, iwidth, iheight, 0,
-               GL_RGBA, GL_UNSIGNED_BYTE, &image[0]);
+               GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  importancewidth_ = iwidth;
+  importanceheight_ = iheight;
+}
+
+void PoissonDiskSampler::unloadImportanceMap(){
+  glActiveTexture(GL_TEXTURE0+1);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glDeleteTextures(1,&importancetex_);
+  importancetex_ = 0;
+  importancewidth_ = importanceheight_ = 0;
+}
+
+void PoissonDiskSampler::enableTileStats(const size_t& tilesize){
+  cuda_thrust_ogl_obj_->enableTileStats(tilesize);
+}
+
+void PoissonDiskSampler::tileStats(TileStats& stats) const{
+  const cudaThrustOGL& c = *cuda_thrust_ogl_obj_;
+  vector<GLuint> raw;
+  c.downloadTileStats(raw);
+
+  size_t n = c.tilesX()*c.tilesY();
+  stats.tilesize = c.tileSize();
+  stats.tilesx = c.tilesX();
+  stats.tilesy = c.tilesY();
+  stats.iterations = c.iterations();
+  const GLuint* field = raw.empty() ? NULL : &raw[0];
+  stats.thrown.assign(field+cudaThrustOGL::TILE_THROWN*n,
+                      field+(cudaThrustOGL::TILE_THROWN+1)*n);
+  stats.throwrejected.assign(field+cudaThrustOGL::TILE_THROWREJECTED*n,
+                             field+(cudaThrustOGL::TILE_THROWREJECTED+1)*n);
+  stats.accepted.assign(field+cudaThrustOGL::TILE_ACCEPTED*n,
+                        field+(cudaThrustOGL::TILE_ACCEPTED+1)*n);
+  stats.covered.assign(field+cudaThrustOGL::TILE_COVERED*n,
+                       field+(cudaThrustOGL::TILE_COVERED+1)*n);
+  stats.conflictrejected.resize(n);
+  for(size_t i=0; i < n; i++){
+    //a dart near a tile border may be counted in its neighbour when
+    //accepted, the rounding of its packed position
+    GLuint kept = stats.thrown[i]-stats.throwrejected[i];
+    stats.conflictrejected[i] = kept-min(kept, stats.accepted[i]);
+  }
+}
+
+void PoissonDiskSampler::memoryUsage(vector<MemoryItem>& items) const{
+  samplerMemory(plan_, items);
+  if(importancetex_ != 0){
+    items.push_back(MemoryItem("importance texture",
+                               4*importancewidth_*importanceheight_, true));
+  }
+  items.push_back(MemoryItem("random vertices", random_vertices_.capacity()*
+                             sizeof(random_vertices_[0]), false));
+  if(pngarena_.size != 0){
+    items.push_back(MemoryItem("png decode arena", pngarena_.size, false));
+  }
 }
 
 //Save the depth map and coverage map to images
+//Debug dumps are full resolution RGBA, the fast deflate keeps them from
+//taking longer than the sampling itself
+static void saveDebugPNG(const string& filename, const GLubyte* rgba,
+                         const size_t& w, const size_t& h){
+  lodepng::State state;
+  state.encoder.zlibsettings.fast = 1;
+  state.encoder.zlibsettings.threads = 0;
+  state.encoder.zlibsettings.parallel_for = parallelRanges;
+  vector<unsigned char> png;
+  unsigned error;
+  { //lodepng has no zones of its own
+    PROBE_ZONE("lodepng_encode");
+    error = lodepng::encode(png, rgba, w, h, state);
+  }
+  if(error){
+    cerr << filename << ": " << lodepng_error_text(error) << endl;
+    return;
+  }
+  lodepng::save_file(png, filename);
+}
+
 void PoissonDiskSampler::saveImage(const string& filename) const{
   vector<GLuint> pixels(width_*height_);
   vector<GLubyte> bpixels(width_*height_*4);
@@ -422,8 +679,7 @@ void PoissonDiskSampler::saveImage(const string& filename) const{
     bpixels[i*4+3]=255;
   }
 
-  lodepng::encode(std::string(filename)+"-p0.png", &bpixels[0],
-                  width_, height_);
+  saveDebugPNG(filename+"-p0.png", &bpixels[0], width_, height_);
 
   glBindTexture(GL_TEXTURE_2D, coverageTexture_);
   glGetTexImage(GL_TEXTURE_2D, 0, GL_RED_INTEGER, GL_UNSIGNED_INT,
@@ -443,8 +699,7 @@ void PoissonDiskSampler::saveImage(const string& filename) const{
     bpixels[i*4+3]=255;
   }
 
-  lodepng::encode(std::string(filename)+"-p1.png", &bpixels[0],
-                  width_, height_);
+  saveDebugPNG(filename+"-p1.png", &bpixels[0], width_, height_);
 }
 
 struct Vec2f{
@@ -455,23 +710,107 @@ struct Vec2f{
   }
 };
 
+void uniqueSamples(vector<GLfloat>& res){
+  if(res.empty()){
+    return;
+  }
+  //compact the duplicated pts
+  Vec2f* end = unique((Vec2f*)&res[0],(Vec2f*)&res[0]+res.size()/2);
+  res.resize(2*(end - (Vec2f*)&res[0]));
+}
+
+//Position of the packed dart captured by the feedback, as the
+//unpackUnorm2x16 of the shaders
+static inline void unpackDart(const GLuint& d, GLfloat& x, GLfloat& y){
+  x = (d & 0xffff)/65535.0f;
+  y = (d >> 16)/65535.0f;
+}
+
 //Get the sample from the feedback buffer
 void PoissonDiskSampler::downloadResults(vector<GLfloat>& res){
+  PROBE_ZONE("downloadResults");
+  if(plan_.packedcoords){
+    vector<GLuint> tri(res_offset_*3);
+    glBindBuffer(GL_ARRAY_BUFFER, resultsBuffer_);
+    glGetBufferSubData(GL_ARRAY_BUFFER,0,tri.size()*sizeof(tri[0]),&tri[0]);
+
+    //the three vertices of a triangle hold the same dart
+    res.resize(res_offset_*2);
+    for(size_t i=0; i < res_offset_; i++){
+      unpackDart(tri[i*3], res[i*2], res[i*2+1]);
+    }
+    return;
+  }
+
   res.resize(res_offset_*2*3); //resize the results buffer
 
   //download the results from the feedback buffer
   glBindBuffer(GL_ARRAY_BUFFER, resultsBuffer_);
   glGetBufferSubData(GL_ARRAY_BUFFER,0,res.size()*sizeof(res[0]),&res[0]);
 
-  //compact the duplicated pts
-  Vec2f* end = unique((Vec2f*)&res[0],(Vec2f*)&res[0]+res.size()/2);
-  res.resize(2*(end - (Vec2f*)&res[0]));
+  uniqueSamples(res);
 
   //assert(res.size() == 2*res_offset_);
 }
 
+void PoissonDiskSampler::downloadResults(SampleSet& set){
+  vector<GLfloat> res;
+  downloadResults(res);
+  set.build(res, dartradius_);
+}
+
+//Copy the new samples from the feedback buffer into the ring
+size_t PoissonDiskSampler::publishResults(SampleRing& ring){
+  PROBE_ZONE("publishResults");
+  size_t count = res_offset_-published_offset_;
+  if(count == 0){
+    return 0;
+  }
+
+  //map only the triangles captured since the last call
+  glBindBuffer(GL_ARRAY_BUFFER, resultsBuffer_);
+  const void* tri =
+      glMapBufferRange(GL_ARRAY_BUFFER,
+                       published_offset_*plan_.feedbackStride(),
+                       count*plan_.feedbackStride(), GL_MAP_READ_BIT);
+  assert(tri != NULL);
+
+  //the three vertices of a triangle hold the same sample
+  size_t done = 0;
+  while(done < count){
+    float* pts;
+    size_t n = ring.reserve(&pts, count-done);
+    if(n == 0){ //the consumer is behind
+      sched_yield();
+      continue;
+    }
+    if(plan_.packedcoords){
+      const GLuint* packed = (const GLuint*)tri;
+      for(size_t i=0; i < n; i++){
+        unpackDart(packed[(done+i)*3], pts[2*i], pts[2*i+1]);
+      }
+    }
+    else{
+      const GLfloat* pos = (const GLfloat*)tri;
+      for(size_t i=0; i < n; i++){
+        pts[2*i] = pos[(done+i)*6];
+        pts[2*i+1] = pos[(done+i)*6+1];
+      }
+    }
+    ring.publish(n);
+    done += n;
+  }
+
+  glUnmapBuffer(GL_ARRAY_BUFFER);
+  published_offset_ = res_offset_;
+  return count;
+}
+
 //Save the empty list into an image
 void PoissonDiskSampler::saveEmptyList(const string& filename) const{
+  if(!plan_.emptylist){ //nothing to show, darts are rejected on coverage
+    return;
+  }
   glBindBuffer(GL_ARRAY_BUFFER, emptylistBuffer_);
   size_t listsize = cuda_thrust_ogl_obj_->getRemainingDarts();
   //cout << listsize << endl;
@@ -487,5 +826,5 @@ void PoissonDiskSampler::saveEmptyList(const string& filename) const{
     img[res[i]*4+2]=0;
     img[res[i]*4+3]=255;
   }
-  lodepng::encode(filename+"-e.png", &img[0], width_, height_);
+  saveDebugPNG(filename+"-e.png", &img[0], width_, height_);
 }
@@ -8,18 +8,37 @@
 using namespace std;
 
 #include <cudaThrustOGL.hpp>
+#include "SamplerPlan.hpp"
+#include "lodepng.h"
+
+class SampleRing;
+class SampleSet;
+struct TileStats;
+
+//Estimated radius for n samples and number of samples for radius r
+float computeR(const size_t& n);
+size_t computeN(const float& r);
+
+//Drop the repeated vertices of the captured triangles, the feedback
+//buffer holds every accepted sample three times in a row
+void uniqueSamples(std::vector<GLfloat>& res);
 
 class PoissonDiskSampler{
  public:
   PoissonDiskSampler(const size_t& w, const size_t& h,
                      const size_t& nd, const float& rd);
+  // Sample one tile of the plan with its storage choices
+  explicit PoissonDiskSampler(const SamplerPlan& plan);
   ~PoissonDiskSampler();
 
+  // Returns the device memory used, measured with cudaMemGetInfo
   size_t init();
   void reset(); 
 
   void cleanup();
 
+  // Pass 0: Dart generation from the empty pixel list
+  void generateDarts();
   // Pass 1: Dart throwing Step
   void throwDarts();
   // Pass 2: Conflict removal Step
@@ -27,28 +46,79 @@ class PoissonDiskSampler{
   // Post-Pass: empty pixel removal/compaction
   size_t collectEmptyPixels();
 
+  // Run the three passes until the domain is covered or maxitr is
+  // reached, returns the number of iterations
+  size_t sample(const size_t& maxitr=200);
+
+  // Seed of the dart generator, applied on the next reset()
+  void setSeed(const unsigned int& seed);
+  unsigned int getSeed() const;
+
+  size_t width() const {return width_;}
+  size_t height() const {return height_;}
+  size_t ndarts() const {return ond_;}
+  // Statistics of the last iteration
+  size_t dartsThrown() const {return ndarts_;}
+  size_t dartsAccepted() const {return accepted_;}
+  float radius() const {return dartradius_;}
+  const SamplerPlan& plan() const {return plan_;}
+
+  // Count where the darts go per tilesize pixels wide tile (0 stops),
+  // call after init(); the counts restart on reset()
+  void enableTileStats(const size_t& tilesize);
+  void tileStats(TileStats& stats) const;
+
+  // Size of every buffer, texture and host copy the sampler owns
+  void memoryUsage(std::vector<MemoryItem>& items) const;
+
   void saveImage(const string& filename) const;
   void saveEmptyList(const string& filename) const;
   void downloadResults(std::vector<GLfloat>& res);
-
-  //Load an importance map and activate the importance texture
-  void loadImportanceMap(const string& filename);
+  // Download the samples into a grid indexed set with cell size r/sqrt(2)
+  void downloadResults(SampleSet& set);
+  // Push the samples accepted since the last call into a shared
+  // memory ring, blocks while the ring is full. Returns the count.
+  size_t publishResults(SampleRing& ring);
+
+  //Load an importance map and activate the importance texture. Only the
+  //rectangle at (x,y) of size w x h is kept (both 0 for the whole map), and
+  //it's box filtered down to the sampling resolution if larger. Returns
+  //the lodepng error, 0 on success
+  unsigned int loadImportanceMap(const string& filename,
+                                 const unsigned int& x = 0,
+                                 const unsigned int& y = 0,
+                                 const unsigned int& w = 0,
+                                 const unsigned int& h = 0);
+  unsigned int loadImportanceMap(const std::vector<unsigned char>& png,
+                                 const unsigned int& x = 0,
+                                 const unsigned int& y = 0,
+                                 const unsigned int& w = 0,
+                                 const unsigned int& h = 0);
+  void unloadImportanceMap();
 
  private:
+  const SamplerPlan plan_;
   size_t width_,height_,ndarts_;
   const size_t ond_;
   float dartradius_;
 
   GLuint res_offset_;
+  GLuint published_offset_;
+  GLuint accepted_;
   GLuint resultsbuffer_size_;
   std::vector<GLshort> random_vertices_;  
 
+  //Bind a texture of that size for the rows of an importance map
+  void createImportanceTexture(const unsigned int& iwidth,
+                               const unsigned int& iheight);
+
   // OpenGL programs
   GLuint programThrow_;
   GLuint programRemove_;
   GLuint LoadShaders(const string& vertex_file_path,
                      const string& geometry_file_path,
-                     const string& fragment_file_path);
+                     const string& fragment_file_path,
+                     const string& defines="");
   void initPrograms();
 
   // OpenGL buffers
@@ -64,6 +134,8 @@ class PoissonDiskSampler{
   GLuint depthTexture_;
   GLuint coverageTexture_;
   GLuint importancetex_;
+  size_t importancewidth_,importanceheight_;
+  LodePNGArena pngarena_; //decode memory, reused from one map to the next
 
   // Cuda implementation wrapper
   cudaThrustOGL* cuda_thrust_ogl_obj_;
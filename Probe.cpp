@@ -0,0 +1,188 @@
+
+#include "Probe.hpp"
+
+#ifdef PIXELPIE_PROBES
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Timer.hpp"
+
+// Histogram: 8 linear sub-buckets per power of two of ticks, which puts
+// the p99 within 12.5% of the true value
+static const size_t SUBBITS = 3;
+static const size_t NBUCKETS = (64 << SUBBITS);
+
+static size_t bucketOf(const uint64_t& t){
+  if(t < (1u << SUBBITS)){
+    return (size_t)t;
+  }
+  size_t e = 63 - __builtin_clzll(t);
+  size_t sub = (size_t)(t >> (e - SUBBITS)) & ((1u << SUBBITS)-1);
+  return ((e - SUBBITS + 1) << SUBBITS) + sub;
+}
+
+// Upper bound of a bucket, in ticks
+static uint64_t bucketTop(const size_t& b){
+  if(b < (1u << SUBBITS)){
+    return b;
+  }
+  size_t e = (b >> SUBBITS) + SUBBITS - 1;
+  uint64_t sub = b & ((1u << SUBBITS)-1);
+  return ((((uint64_t)1 << SUBBITS) + sub + 1) << (e - SUBBITS)) - 1;
+}
+
+struct ProbeNode{
+  size_t site;
+  size_t parent;
+  vector<size_t> children;
+  uint64_t count,total,min;
+  vector<uint32_t> hist;
+
+  ProbeNode(const size_t& s, const size_t& p)
+      :site(s),parent(p),count(0),total(0),min(~(uint64_t)0),hist(NBUCKETS){}
+};
+
+static const size_t ROOT = 0;
+
+// Per-thread call tree, node 0 is the root
+struct ProbeThread{
+  vector<ProbeNode> nodes;
+  size_t current;
+
+  ProbeThread():current(ROOT){
+    nodes.push_back(ProbeNode(~(size_t)0, ROOT));
+  }
+
+  size_t child(const size_t& parent, const size_t& site){
+    const vector<size_t>& c = nodes[parent].children;
+    for(size_t i=0; i < c.size(); i++){
+      if(nodes[c[i]].site == site){
+        return c[i];
+      }
+    }
+    nodes.push_back(ProbeNode(site, parent));
+    nodes[parent].children.push_back(nodes.size()-1);
+    return nodes.size()-1;
+  }
+};
+
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static vector<const char*>* sites = NULL;
+static vector<ProbeThread*>* threads = NULL;
+static __thread ProbeThread* this_thread = NULL;
+
+//The TSC rate comes from the wall time elapsed since the first probe
+static uint64_t ticks0 = 0;
+static Timer* wall0 = NULL;
+
+ProbeSite::ProbeSite(const char* n):name(n){
+  pthread_mutex_lock(&registry_mutex);
+  if(sites == NULL){
+    sites = new vector<const char*>();
+    threads = new vector<ProbeThread*>();
+    wall0 = new Timer();
+    wall0->start();
+    ticks0 = probeTicks();
+  }
+  id = sites->size();
+  sites->push_back(n);
+  pthread_mutex_unlock(&registry_mutex);
+}
+
+static ProbeThread* probeThread(){
+  if(this_thread == NULL){
+    this_thread = new ProbeThread();
+    pthread_mutex_lock(&registry_mutex);
+    threads->push_back(this_thread);
+    pthread_mutex_unlock(&registry_mutex);
+  }
+  return this_thread;
+}
+
+ProbeScope::ProbeScope(ProbeSite& site){
+  thread_ = probeThread();
+  parent_ = thread_->current;
+  node_ = thread_->child(parent_, site.id);
+  thread_->current = node_;
+  start_ = probeTicks();
+}
+
+ProbeScope::~ProbeScope(){
+  uint64_t t = probeTicks() - start_;
+  ProbeNode& n = thread_->nodes[node_];
+  n.count++;
+  n.total += t;
+  n.min = std::min(n.min, t);
+  n.hist[bucketOf(t)]++;
+  thread_->current = parent_;
+}
+
+struct ProbeStats{
+  uint64_t count,total,min;
+  vector<uint64_t> hist;
+
+  ProbeStats():count(0),total(0),min(~(uint64_t)0),hist(NBUCKETS){}
+};
+
+//Merge a thread tree into the table keyed by zone path
+static void mergeNode(const ProbeThread& t, const size_t& node,
+                      const string& prefix, map<string,ProbeStats>& table){
+  const vector<size_t>& c = t.nodes[node].children;
+  for(size_t i=0; i < c.size(); i++){
+    const ProbeNode& n = t.nodes[c[i]];
+    string path = prefix + (*sites)[n.site];
+    ProbeStats& s = table[path];
+    s.count += n.count;
+    s.total += n.total;
+    s.min = std::min(s.min, n.min);
+    for(size_t b=0; b < NBUCKETS; b++){
+      s.hist[b] += n.hist[b];
+    }
+    mergeNode(t, c[i], path + "/", table);
+  }
+}
+
+void probeReport(FILE* f){
+  pthread_mutex_lock(&registry_mutex);
+  if(sites == NULL){
+    pthread_mutex_unlock(&registry_mutex);
+    return;
+  }
+  double tickrate = (probeTicks() - ticks0) / wall0->stop();
+
+  map<string,ProbeStats> table;
+  for(size_t i=0; i < threads->size(); i++){
+    mergeNode(*(*threads)[i], ROOT, "", table);
+  }
+  pthread_mutex_unlock(&registry_mutex);
+
+  fprintf(f, "#%-39s %10s %12s %12s %12s %12s\n", "zone", "count",
+          "total ms", "min us", "mean us", "p99 us");
+  for(map<string,ProbeStats>::const_iterator i=table.begin();
+      i != table.end(); ++i){
+    const ProbeStats& s = i->second;
+    if(s.count == 0){
+      continue;
+    }
+    uint64_t rank = (s.count*99 + 99)/100, seen = 0;
+    size_t b = 0;
+    for(; b < NBUCKETS; b++){
+      seen += s.hist[b];
+      if(seen >= rank) break;
+    }
+    fprintf(f, "%-40s %10llu %12.3f %12.3f %12.3f %12.3f\n",
+            i->first.c_str(), (unsigned long long)s.count,
+            s.total/tickrate*1e3, s.min/tickrate*1e6,
+            (double)s.total/s.count/tickrate*1e6,
+            bucketTop(b)/tickrate*1e6);
+  }
+}
+
+#endif
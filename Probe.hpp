@@ -0,0 +1,61 @@
+#ifndef __PROBE__
+#define __PROBE__
+
+// Scoped profiling probes. PROBE_ZONE("name") times the enclosing scope
+// with the TSC; zones nest, so a zone opened inside another is reported
+// under it ("sample/throwDarts"). Each thread aggregates into its own
+// tables (count, min, total and a log-linear histogram for the p99), the
+// tables are merged by probeReport(). Everything compiles to nothing
+// unless PIXELPIE_PROBES is defined (make PROBES=1).
+
+#include <cstdio>
+
+#ifdef PIXELPIE_PROBES
+
+#include <stdint.h>
+
+struct ProbeThread;
+
+// One PROBE_ZONE in the source, registered on first use
+struct ProbeSite{
+  const char* name;
+  size_t id;
+  explicit ProbeSite(const char* n);
+};
+
+class ProbeScope{
+ public:
+  explicit ProbeScope(ProbeSite& site);
+  ~ProbeScope();
+
+ private:
+  ProbeThread* thread_;
+  size_t node_;
+  size_t parent_;
+  uint64_t start_;
+};
+
+static inline uint64_t probeTicks(){
+  uint32_t lo,hi;
+  __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+#define PROBE_CONCAT2(a,b) a##b
+#define PROBE_CONCAT(a,b) PROBE_CONCAT2(a,b)
+#define PROBE_ZONE(name)                                            \
+  static ProbeSite PROBE_CONCAT(probe_site_,__LINE__)(name);        \
+  ProbeScope PROBE_CONCAT(probe_scope_,__LINE__)(PROBE_CONCAT(probe_site_,__LINE__))
+
+// Print the merged zone statistics. Call it once the instrumented
+// threads are idle, their tables are read without locking.
+void probeReport(FILE* f);
+
+#else
+
+#define PROBE_ZONE(name)
+static inline void probeReport(FILE*){}
+
+#endif
+
+#endif
@@ -0,0 +1,194 @@
+
+#include <cstring>
+
+#include "SampleCodec.hpp"
+#include "SampleFile.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SAMPLECODEC_X86
+#include <tmmintrin.h>
+#endif
+
+static inline size_t bytesNeeded(const uint32_t& v){
+  if(v < (1u<<8)) return 1;
+  if(v < (1u<<16)) return 2;
+  if(v < (1u<<24)) return 3;
+  return 4;
+}
+
+size_t encodeMortonDeltas(const uint32_t* codes, const size_t& n,
+                          const uint32_t& base, uint8_t* out){
+  uint8_t* p = out;
+  uint32_t prev = base;
+  for(size_t g=0; g < n; g+=4){
+    uint8_t* control = p++;
+    *control = 0;
+    for(size_t k=0; k < 4 && g+k < n; k++){
+      uint32_t d = codes[g+k]-prev;
+      prev = codes[g+k];
+      size_t len = bytesNeeded(d);
+      *control |= (len-1) << (2*k);
+      for(size_t b=0; b < len; b++){
+        *p++ = (d >> (8*b)) & 0xff;
+      }
+    }
+  }
+  return p-out;
+}
+
+//Decode one group of up to 4 deltas, returns the bytes consumed or 0
+static inline size_t decodeGroupScalar(const uint8_t* in, const uint8_t* end,
+                                       const size_t& count, uint32_t& prev,
+                                       uint32_t* codes){
+  if(in >= end) return 0;
+  const uint8_t* p = in;
+  uint8_t control = *p++;
+  for(size_t k=0; k < count; k++){
+    size_t len = ((control >> (2*k)) & 3) + 1;
+    if((size_t)(end-p) < len) return 0;
+    uint32_t d = 0;
+    for(size_t b=0; b < len; b++){
+      d |= (uint32_t)p[b] << (8*b);
+    }
+    p += len;
+    prev += d;
+    codes[k] = prev;
+  }
+  return p-in;
+}
+
+#ifdef SAMPLECODEC_X86
+
+//Shuffle masks of the 16 data bytes after every control byte, and the
+//bytes a group takes with its control byte
+struct GroupTables{
+  uint8_t shuffle[256][16];
+  uint8_t length[256];
+
+  GroupTables(){
+    for(size_t c=0; c < 256; c++){
+      size_t offset = 0;
+      for(size_t k=0; k < 4; k++){
+        size_t len = ((c >> (2*k)) & 3) + 1;
+        for(size_t b=0; b < 4; b++){
+          shuffle[c][4*k+b] = (b < len) ? offset+b : 0x80;
+        }
+        offset += len;
+      }
+      length[c] = 1+offset;
+    }
+  }
+};
+
+static const GroupTables& groupTables(){
+  static GroupTables tables;
+  return tables;
+}
+
+static bool detectSIMD(){
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("ssse3");
+}
+
+static bool use_simd = detectSIMD();
+
+static inline __m128i mortonCompact4(__m128i a){
+  a = _mm_and_si128(a, _mm_set1_epi32(0x55555555));
+  a = _mm_and_si128(_mm_or_si128(a, _mm_srli_epi32(a,1)),
+                    _mm_set1_epi32(0x33333333));
+  a = _mm_and_si128(_mm_or_si128(a, _mm_srli_epi32(a,2)),
+                    _mm_set1_epi32(0x0f0f0f0f));
+  a = _mm_and_si128(_mm_or_si128(a, _mm_srli_epi32(a,4)),
+                    _mm_set1_epi32(0x00ff00ff));
+  a = _mm_and_si128(_mm_or_si128(a, _mm_srli_epi32(a,8)),
+                    _mm_set1_epi32(0x0000ffff));
+  return a;
+}
+
+//Decode the full groups while the 16 bytes after their control byte can
+//be loaded, returns the number of codes done. Writes codes or packed
+//(x,y) pairs.
+template <bool XY>
+__attribute__((target("ssse3")))
+static size_t decodeGroupsSSSE3(const uint8_t*& in, const uint8_t* end,
+                                const size_t& n, uint32_t& prev,
+                                uint32_t* out){
+  const GroupTables& t = groupTables();
+  const uint8_t* p = in;
+  __m128i carry = _mm_set1_epi32(prev);
+  size_t i = 0;
+  for(; i+4 <= n && end-p >= 17; i+=4){
+    uint8_t control = *p;
+    __m128i data = _mm_loadu_si128((const __m128i*)(p+1));
+    __m128i mask = _mm_loadu_si128((const __m128i*)t.shuffle[control]);
+    __m128i v = _mm_shuffle_epi8(data, mask);
+
+    //inclusive prefix sum of the deltas plus the previous code
+    v = _mm_add_epi32(v, _mm_slli_si128(v,4));
+    v = _mm_add_epi32(v, _mm_slli_si128(v,8));
+    v = _mm_add_epi32(v, carry);
+    carry = _mm_shuffle_epi32(v, _MM_SHUFFLE(3,3,3,3));
+
+    if(XY){ //x in the low, y in the high half of every lane
+      __m128i x = mortonCompact4(v);
+      __m128i y = mortonCompact4(_mm_srli_epi32(v,1));
+      v = _mm_or_si128(x, _mm_slli_epi32(y,16));
+    }
+    _mm_storeu_si128((__m128i*)(out+i), v);
+    p += t.length[control];
+  }
+  prev = _mm_cvtsi128_si32(carry);
+  in = p;
+  return i;
+}
+
+#endif
+
+void setSampleCodecSIMD(const bool& enable){
+#ifdef SAMPLECODEC_X86
+  use_simd = enable && detectSIMD();
+#endif
+}
+
+size_t decodeMortonDeltas(const uint8_t* in, const uint8_t* end,
+                          const size_t& n, const uint32_t& base,
+                          uint32_t* codes){
+  const uint8_t* p = in;
+  uint32_t prev = base;
+  size_t i = 0;
+#ifdef SAMPLECODEC_X86
+  if(use_simd){
+    i = decodeGroupsSSSE3<false>(p, end, n, prev, codes);
+  }
+#endif
+  for(; i < n; i+=4){
+    size_t count = (n-i < 4) ? n-i : 4;
+    size_t len = decodeGroupScalar(p, end, count, prev, codes+i);
+    if(len == 0) return 0;
+    p += len;
+  }
+  return p-in;
+}
+
+size_t decodeSamples(const uint8_t* in, const uint8_t* end,
+                     const size_t& n, const uint32_t& base, uint16_t* xy){
+  const uint8_t* p = in;
+  uint32_t prev = base;
+  size_t i = 0;
+#ifdef SAMPLECODEC_X86
+  if(use_simd){
+    i = decodeGroupsSSSE3<true>(p, end, n, prev, (uint32_t*)xy);
+  }
+#endif
+  for(; i < n; i+=4){
+    uint32_t codes[4];
+    size_t count = (n-i < 4) ? n-i : 4;
+    size_t len = decodeGroupScalar(p, end, count, prev, codes);
+    if(len == 0) return 0;
+    p += len;
+    for(size_t k=0; k < count; k++){
+      mortonDecode(codes[k], xy[2*(i+k)], xy[2*(i+k)+1]);
+    }
+  }
+  return p-in;
+}
@@ -0,0 +1,38 @@
+#ifndef __SAMPLECODEC__
+#define __SAMPLECODEC__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Codec for Morton sorted sample blocks. The codes are delta encoded
+// against their predecessor (the first against the block's base code)
+// and the deltas are packed with a byte aligned variable length code:
+// every group of 4 deltas has one control byte holding their lengths
+// (1-4 bytes, 2 bits each), followed by the little endian delta
+// bytes. Poisson-disk sets have nearly uniform deltas, so most of them
+// take 1-2 bytes, and a group decodes with one shuffle on SSSE3.
+
+// Upper bound of the encoded size of n codes
+inline size_t maxEncodedSize(const size_t& n){
+  return (n+3)/4 + 4*n;
+}
+
+// Encode n sorted codes, out must hold maxEncodedSize(n) bytes.
+// Returns the number of bytes written.
+size_t encodeMortonDeltas(const uint32_t* codes, const size_t& n,
+                          const uint32_t& base, uint8_t* out);
+
+// Decode n codes from [in,end), returns the number of bytes consumed
+// or 0 if the stream is truncated
+size_t decodeMortonDeltas(const uint8_t* in, const uint8_t* end,
+                          const size_t& n, const uint32_t& base,
+                          uint32_t* codes);
+
+// Decode n samples straight to interleaved unorm16 (x,y) pairs
+size_t decodeSamples(const uint8_t* in, const uint8_t* end,
+                     const size_t& n, const uint32_t& base, uint16_t* xy);
+
+// Force the scalar decoder (benchmarks and testing)
+void setSampleCodecSIMD(const bool& enable);
+
+#endif
@@ -0,0 +1,318 @@
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+#include "SampleFile.hpp"
+#include "SampleCodec.hpp"
+
+bool writeSampleFile(const string& filename, const vector<float>& pts,
+                     const uint32_t& width, const uint32_t& height,
+                     const float& radius, const uint32_t& seed,
+                     const uint32_t& blocksize,
+                     const bool& compress){
+  const size_t count = pts.size()/2;
+  //the codec works on the Morton sorted blocks
+  const bool packeddata = compress && blocksize > 0;
+
+  SampleFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "PPSF", 4);
+  header.version = SAMPLEFILE_VERSION;
+  header.width = width;
+  header.height = height;
+  header.radius = radius;
+  header.seed = seed;
+  header.count = count;
+  header.blocksize = blocksize;
+
+  vector<uint16_t> data(count*2);
+  vector<uint8_t> packed;
+  vector<SampleFileBlock> blocks;
+
+  if(blocksize == 0){ //keep the sample order
+    for(size_t i=0; i < count; i++){
+      data[2*i] = quantizeUnorm16(pts[2*i]);
+      data[2*i+1] = quantizeUnorm16(pts[2*i+1]);
+    }
+  }
+  else{
+    header.flags |= SF_INDEXED;
+
+    //sort along the Morton curve
+    vector<uint32_t> codes(count);
+    for(size_t i=0; i < count; i++){
+      codes[i] = mortonEncode(quantizeUnorm16(pts[2*i]),
+                              quantizeUnorm16(pts[2*i+1]));
+    }
+    sort(codes.begin(), codes.end());
+
+    blocks.resize((count+blocksize-1)/blocksize);
+    for(size_t b=0; b < blocks.size(); b++){
+      SampleFileBlock& blk = blocks[b];
+      size_t first = b*blocksize;
+      size_t end = min(count, first+blocksize);
+      blk.offset = first*2*sizeof(uint16_t);
+      blk.size = (end-first)*2*sizeof(uint16_t);
+      blk.morton = codes[first];
+      blk.minx = blk.miny = 0xffff;
+      blk.maxx = blk.maxy = 0;
+      for(size_t i=first; i < end; i++){
+        uint16_t x,y;
+        mortonDecode(codes[i], x, y);
+        data[2*i] = x;
+        data[2*i+1] = y;
+        blk.minx = min(blk.minx, x);
+        blk.miny = min(blk.miny, y);
+        blk.maxx = max(blk.maxx, x);
+        blk.maxy = max(blk.maxy, y);
+      }
+    }
+
+    if(packeddata){
+      header.flags |= SF_COMPRESSED;
+      packed.resize(maxEncodedSize(count));
+      size_t offset = 0;
+      for(size_t b=0; b < blocks.size(); b++){
+        SampleFileBlock& blk = blocks[b];
+        size_t first = b*blocksize;
+        size_t end = min(count, first+blocksize);
+        blk.offset = offset;
+        blk.size = encodeMortonDeltas(&codes[first], end-first, blk.morton,
+                                      &packed[offset]);
+        offset += blk.size;
+      }
+      packed.resize(offset);
+    }
+  }
+
+  header.nblocks = blocks.size();
+  header.index_offset = sizeof(header);
+  header.data_offset = header.index_offset
+      + blocks.size()*sizeof(SampleFileBlock);
+  header.data_size = packeddata ? packed.size() : data.size()*sizeof(uint16_t);
+
+  FILE* outfile = fopen(filename.c_str(), "wb");
+  if(outfile == NULL){
+    perror(filename.c_str());
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, outfile) == 1;
+  if(ok && !blocks.empty()){
+    ok = fwrite(&blocks[0], sizeof(blocks[0]), blocks.size(), outfile)
+        == blocks.size();
+  }
+  if(ok && packeddata && !packed.empty()){
+    ok = fwrite(&packed[0], 1, packed.size(), outfile) == packed.size();
+  }
+  else if(ok && !packeddata && !data.empty()){
+    ok = fwrite(&data[0], sizeof(data[0]), data.size(), outfile)
+        == data.size();
+  }
+  ok = (fclose(outfile) == 0) && ok;
+  return ok;
+}
+
+SampleFileReader::SampleFileReader()
+    :map_(NULL),mapsize_(0),header_(NULL),blocks_(NULL),data_(NULL),
+     dataend_(NULL){
+}
+
+SampleFileReader::~SampleFileReader(){
+  close();
+}
+
+bool SampleFileReader::open(const string& filename){
+  close();
+
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if(fd < 0){
+    return false;
+  }
+  struct stat st;
+  if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SampleFileHeader)){
+    ::close(fd);
+    return false;
+  }
+  void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd); //the mapping keeps the file alive
+  if(p == MAP_FAILED){
+    return false;
+  }
+  map_ = (const unsigned char*) p;
+  mapsize_ = st.st_size;
+  header_ = (const SampleFileHeader*) map_;
+
+  //validate the header against the mapping
+  const SampleFileHeader& h = *header_;
+  bool ok = memcmp(h.magic, "PPSF", 4) == 0
+      && h.version == SAMPLEFILE_VERSION
+      && h.index_offset + h.nblocks*sizeof(SampleFileBlock) <= mapsize_
+      && h.data_offset <= mapsize_
+      && h.data_size <= mapsize_ - h.data_offset;
+  if(ok && (h.flags & SF_INDEXED)){
+    ok = h.blocksize > 0
+        && h.nblocks == (h.count+h.blocksize-1)/h.blocksize;
+  }
+  if(ok && (h.flags & SF_COMPRESSED)){
+    ok = (h.flags & SF_INDEXED) != 0;
+  }
+  else if(ok){
+    ok = h.data_size >= h.count*2*sizeof(uint16_t);
+  }
+  if(!ok){
+    close();
+    return false;
+  }
+
+  blocks_ = (const SampleFileBlock*)(map_ + h.index_offset);
+  data_ = (const uint16_t*)(map_ + h.data_offset);
+  dataend_ = map_ + h.data_offset + h.data_size;
+  return true;
+}
+
+void SampleFileReader::close(){
+  if(map_ != NULL){
+    munmap((void*)map_, mapsize_);
+  }
+  map_ = NULL;
+  mapsize_ = 0;
+  header_ = NULL;
+  blocks_ = NULL;
+  data_ = NULL;
+  dataend_ = NULL;
+}
+
+size_t SampleFileReader::blockCount(const size_t& b) const{
+  size_t first = b*header_->blocksize;
+  return min((size_t)header_->blocksize, size()-first);
+}
+
+size_t SampleFileReader::decodeBlock(const size_t& b,
+                                     vector<uint16_t>& xy) const{
+  assert(indexed() && b < header_->nblocks);
+  size_t n = blockCount(b);
+  xy.resize(2*n);
+  if(n == 0){
+    return 0;
+  }
+  const SampleFileBlock& blk = blocks_[b];
+  if(!compressed()){
+    memcpy(&xy[0], data_+2*b*header_->blocksize, 2*n*sizeof(uint16_t));
+    return n;
+  }
+  const uint8_t* p = (const uint8_t*)data_ + blk.offset;
+  //the decoder may look ahead into the following blocks
+  size_t used = 0;
+  if(blk.offset <= header_->data_size){
+    used = decodeSamples(p, dataend_, n, blk.morton, &xy[0]);
+  }
+  if(used == 0 || used > blk.size){
+    xy.clear(); //corrupt block
+    return 0;
+  }
+  return n;
+}
+
+void SampleFileReader::get(const size_t& i, float& x, float& y) const{
+  assert(i < size());
+  if(compressed()){
+    vector<uint16_t> xy;
+    size_t b = i/header_->blocksize;
+    decodeBlock(b, xy);
+    size_t j = i-b*header_->blocksize;
+    assert(2*j+1 < xy.size());
+    x = dequantizeUnorm16(xy[2*j]);
+    y = dequantizeUnorm16(xy[2*j+1]);
+    return;
+  }
+  x = dequantizeUnorm16(data_[2*i]);
+  y = dequantizeUnorm16(data_[2*i+1]);
+}
+
+void SampleFileReader::readAll(vector<float>& pts) const{
+  size_t offset = pts.size();
+  pts.resize(offset + 2*size());
+  if(compressed()){
+    vector<uint16_t> xy;
+    for(size_t b=0; b < header_->nblocks; b++){
+      size_t n = decodeBlock(b, xy);
+      for(size_t i=0; i < 2*n; i++){
+        pts[offset++] = dequantizeUnorm16(xy[i]);
+      }
+    }
+    pts.resize(offset);
+    return;
+  }
+  for(size_t i=0; i < 2*size(); i++){
+    pts[offset+i] = dequantizeUnorm16(data_[i]);
+  }
+}
+
+static bool blockLess(const uint32_t& code, const SampleFileBlock& blk){
+  return code < blk.morton;
+}
+
+size_t SampleFileReader::query(const float& x0, const float& y0,
+                               const float& x1, const float& y1,
+                               vector<float>& pts) const{
+  if(x0 > x1 || y0 > y1 || x1 < 0.0f || y1 < 0.0f ||
+     x0 > 1.0f || y0 > 1.0f){
+    return 0;
+  }
+  //quantized inclusive bounds
+  uint16_t qx0 = (uint16_t)ceil(max(x0,0.0f)*65535.0f);
+  uint16_t qy0 = (uint16_t)ceil(max(y0,0.0f)*65535.0f);
+  uint16_t qx1 = (uint16_t)floor(min(x1,1.0f)*65535.0f);
+  uint16_t qy1 = (uint16_t)floor(min(y1,1.0f)*65535.0f);
+
+  size_t found = 0;
+  size_t bfirst = 0, bend = 1, bsize = size();
+  if(indexed()){
+    //every sample of the box has a code in [lo,hi]
+    uint32_t lo = mortonEncode(qx0,qy0);
+    uint32_t hi = mortonEncode(qx1,qy1);
+    const SampleFileBlock* end = blocks_+header_->nblocks;
+    const SampleFileBlock* b0 = upper_bound(blocks_, end, lo, blockLess);
+    const SampleFileBlock* b1 = upper_bound(blocks_, end, hi, blockLess);
+    bfirst = (b0 == blocks_) ? 0 : (b0-blocks_)-1;
+    bend = b1-blocks_;
+    bsize = header_->blocksize;
+  }
+
+  vector<uint16_t> xy;
+  for(size_t b=bfirst; b < bend; b++){
+    size_t first = b*bsize;
+    size_t last = min(size(), first+bsize);
+    const uint16_t* data = data_ + 2*first;
+    if(indexed()){
+      const SampleFileBlock& blk = blocks_[b];
+      if(blk.maxx < qx0 || blk.minx > qx1 || blk.maxy < qy0 || blk.miny > qy1){
+        continue;
+      }
+    }
+    if(compressed()){
+      decodeBlock(b, xy);
+      if(xy.empty()) continue;
+      data = &xy[0];
+    }
+    for(size_t i=0; i < last-first; i++){
+      uint16_t x = data[2*i], y = data[2*i+1];
+      if(x >= qx0 && x <= qx1 && y >= qy0 && y <= qy1){
+        pts.push_back(dequantizeUnorm16(x));
+        pts.push_back(dequantizeUnorm16(y));
+        found++;
+      }
+    }
+  }
+  return found;
+}
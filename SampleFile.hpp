@@ -0,0 +1,140 @@
+#ifndef __SAMPLEFILE__
+#define __SAMPLEFILE__
+
+#include <stdint.h>
+
+#include <vector>
+#include <string>
+using namespace std;
+
+// Binary sample set file (.pps, host byte order, little endian on
+// every platform we run on). Layout:
+//
+//   SampleFileHeader
+//   SampleFileBlock[nblocks]   if SF_INDEXED
+//   sample data                data_size bytes at data_offset
+//
+// Coordinates are stored as unorm16 pairs (x,y), which is the exact
+// precision of the darts thrown by the sampler (unpackUnorm2x16).
+// Indexed files are sorted along the Morton curve and split into
+// blocks of blocksize samples, each with its bounding box. The blocks
+// of compressed files hold Morton deltas (see SampleCodec.hpp) and
+// decode independently.
+
+#define SAMPLEFILE_VERSION 1
+
+enum SampleFileFlags{
+  SF_INDEXED = 1,   // Morton sorted with a block index
+  SF_COMPRESSED = 2 // delta coded blocks, requires SF_INDEXED
+};
+
+struct SampleFileHeader{
+  char magic[4];         // "PPSF"
+  uint32_t version;
+  uint32_t width;        // resolution of the sampler
+  uint32_t height;
+  float radius;          // normalized disk radius
+  uint32_t seed;
+  uint64_t count;        // number of samples
+  uint32_t flags;
+  uint32_t blocksize;    // samples per index block
+  uint64_t nblocks;
+  uint64_t index_offset;
+  uint64_t data_offset;
+  uint64_t data_size;
+};
+
+struct SampleFileBlock{
+  uint64_t offset;       // of the block data, relative to data_offset
+  uint32_t size;         // of the block data in bytes
+  uint32_t morton;       // Morton code of the first sample
+  uint16_t minx,miny;    // bounding box of the block
+  uint16_t maxx,maxy;
+};
+
+// Quantization between (0,1) floats and unorm16
+inline uint16_t quantizeUnorm16(const float& v){
+  float c = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+  return (uint16_t)(c*65535.0f + 0.5f);
+}
+
+inline float dequantizeUnorm16(const uint16_t& q){
+  return q*(1.0f/65535.0f);
+}
+
+// Interleave the bits of x (even) and y (odd)
+inline uint32_t mortonEncode(const uint16_t& x, const uint16_t& y){
+  uint32_t a = x, b = y;
+  a = (a | (a << 8)) & 0x00ff00ff;
+  a = (a | (a << 4)) & 0x0f0f0f0f;
+  a = (a | (a << 2)) & 0x33333333;
+  a = (a | (a << 1)) & 0x55555555;
+  b = (b | (b << 8)) & 0x00ff00ff;
+  b = (b | (b << 4)) & 0x0f0f0f0f;
+  b = (b | (b << 2)) & 0x33333333;
+  b = (b | (b << 1)) & 0x55555555;
+  return a | (b << 1);
+}
+
+inline uint16_t mortonCompact(uint32_t a){
+  a &= 0x55555555;
+  a = (a | (a >> 1)) & 0x33333333;
+  a = (a | (a >> 2)) & 0x0f0f0f0f;
+  a = (a | (a >> 4)) & 0x00ff00ff;
+  a = (a | (a >> 8)) & 0x0000ffff;
+  return (uint16_t)a;
+}
+
+inline void mortonDecode(const uint32_t& m, uint16_t& x, uint16_t& y){
+  x = mortonCompact(m);
+  y = mortonCompact(m >> 1);
+}
+
+// Write pts (interleaved x,y in (0,1)) to filename. Returns false if
+// the file could not be written. blocksize 0 writes an unindexed file
+// in the given sample order, compress is then ignored.
+bool writeSampleFile(const string& filename, const vector<float>& pts,
+                     const uint32_t& width, const uint32_t& height,
+                     const float& radius, const uint32_t& seed,
+                     const uint32_t& blocksize=1024,
+                     const bool& compress=false);
+
+// Memory mapped reader, opening only validates the header
+class SampleFileReader{
+ public:
+  SampleFileReader();
+  ~SampleFileReader();
+
+  bool open(const string& filename);
+  void close();
+
+  const SampleFileHeader& header() const {return *header_;}
+  size_t size() const {return header_->count;}
+  bool indexed() const {return (header_->flags & SF_INDEXED) != 0;}
+  bool compressed() const {return (header_->flags & SF_COMPRESSED) != 0;}
+
+  // Sample i, dequantized (decodes its whole block if compressed)
+  void get(const size_t& i, float& x, float& y) const;
+  // Quantized (x,y) pairs of block b, returns the number of samples
+  size_t decodeBlock(const size_t& b, vector<uint16_t>& xy) const;
+  // Append all samples to pts
+  void readAll(vector<float>& pts) const;
+  // Append the samples inside [x0,x1]x[y0,y1] to pts, returns the count
+  size_t query(const float& x0, const float& y0,
+               const float& x1, const float& y1, vector<float>& pts) const;
+
+ private:
+  const unsigned char* map_;
+  size_t mapsize_;
+  const SampleFileHeader* header_;
+  const SampleFileBlock* blocks_;
+  const uint16_t* data_;
+  const uint8_t* dataend_;
+
+  size_t blockCount(const size_t& b) const;
+
+  SampleFileReader(const SampleFileReader&);
+  SampleFileReader& operator=(const SampleFileReader&);
+};
+
+#endif
@@ -0,0 +1,160 @@
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+#include "SampleRing.hpp"
+
+#define SAMPLERING_MAGIC 0x474e5252 // "RRNG"
+#define SAMPLERING_VERSION 1
+
+SampleRing::SampleRing(const string& name, const bool& owner, int fd,
+                       Header* header, const size_t& mapsize)
+    :name_(name),owner_(owner),fd_(fd),header_(header),
+     data_((float*)(header+1)),mapsize_(mapsize),cached_(0){
+}
+
+SampleRing::~SampleRing(){
+  if(owner_){
+    close();
+  }
+  munmap(header_, mapsize_);
+  ::close(fd_);
+  if(owner_){
+    shm_unlink(name_.c_str());
+  }
+}
+
+SampleRing* SampleRing::create(const string& name, const size_t& capacity){
+  assert(capacity > 0 && (capacity & (capacity-1)) == 0);
+
+  shm_unlink(name.c_str()); //start from a fresh object
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if(fd < 0){
+    perror(name.c_str());
+    return NULL;
+  }
+
+  size_t mapsize = sizeof(Header) + capacity*2*sizeof(float);
+  if(ftruncate(fd, mapsize) != 0){
+    perror(name.c_str());
+    ::close(fd);
+    shm_unlink(name.c_str());
+    return NULL;
+  }
+  void* p = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == MAP_FAILED){
+    perror(name.c_str());
+    ::close(fd);
+    shm_unlink(name.c_str());
+    return NULL;
+  }
+
+  Header* header = (Header*) p;
+  memset(header, 0, sizeof(Header));
+  header->capacity = capacity;
+  header->version = SAMPLERING_VERSION;
+  //the magic is written last, attaching consumers check it
+  __atomic_store_n(&header->magic, SAMPLERING_MAGIC, __ATOMIC_RELEASE);
+
+  return new SampleRing(name, true, fd, header, mapsize);
+}
+
+SampleRing* SampleRing::attach(const string& name){
+  int fd = shm_open(name.c_str(), O_RDWR, 0600);
+  if(fd < 0){
+    return NULL;
+  }
+
+  struct stat st;
+  if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)){
+    ::close(fd);
+    return NULL;
+  }
+  void* p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                 fd, 0);
+  if(p == MAP_FAILED){
+    ::close(fd);
+    return NULL;
+  }
+
+  Header* header = (Header*) p;
+  if(__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SAMPLERING_MAGIC ||
+     header->version != SAMPLERING_VERSION ||
+     sizeof(Header) + header->capacity*2*sizeof(float) > (size_t)st.st_size){
+    munmap(p, st.st_size);
+    ::close(fd);
+    return NULL;
+  }
+
+  return new SampleRing(name, false, fd, header, st.st_size);
+}
+
+size_t SampleRing::reserve(float** pts, const size_t& n){
+  const uint64_t cap = header_->capacity;
+  const uint64_t head = header_->head; //only we write it
+
+  //reload the consumer position only when the cached one is exhausted
+  if(head - cached_ + n > cap){
+    cached_ = __atomic_load_n(&header_->tail, __ATOMIC_ACQUIRE);
+  }
+
+  size_t free = cap - (head - cached_);
+  size_t pos = head & (cap-1);
+  size_t count = min(min(n, free), (size_t)(cap - pos)); //no wrapping
+  *pts = data_ + 2*pos;
+  return count;
+}
+
+void SampleRing::publish(const size_t& n){
+  __atomic_store_n(&header_->head, header_->head + n, __ATOMIC_RELEASE);
+}
+
+void SampleRing::endRun(){
+  __atomic_store_n(&header_->runend, header_->head, __ATOMIC_RELAXED);
+  __atomic_store_n(&header_->runs, header_->runs+1, __ATOMIC_RELEASE);
+}
+
+void SampleRing::close(){
+  __atomic_store_n(&header_->closed, 1, __ATOMIC_RELEASE);
+}
+
+size_t SampleRing::acquire(const float** pts){
+  const uint64_t cap = header_->capacity;
+  const uint64_t tail = header_->tail; //only we write it
+
+  if(cached_ == tail){
+    cached_ = __atomic_load_n(&header_->head, __ATOMIC_ACQUIRE);
+  }
+
+  size_t pos = tail & (cap-1);
+  size_t count = min((size_t)(cached_ - tail), (size_t)(cap - pos));
+  *pts = data_ + 2*pos;
+  return count;
+}
+
+void SampleRing::release(const size_t& n){
+  __atomic_store_n(&header_->tail, header_->tail + n, __ATOMIC_RELEASE);
+}
+
+bool SampleRing::finished() const{
+  //closed has to be observed before head to not miss the last batch
+  if(!__atomic_load_n(&header_->closed, __ATOMIC_ACQUIRE)) return false;
+  return __atomic_load_n(&header_->head, __ATOMIC_ACQUIRE) == header_->tail;
+}
+
+uint64_t SampleRing::runs() const{
+  return __atomic_load_n(&header_->runs, __ATOMIC_ACQUIRE);
+}
+
+uint64_t SampleRing::runEnd() const{
+  return __atomic_load_n(&header_->runend, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,70 @@
+#ifndef __SAMPLERING__
+#define __SAMPLERING__
+
+#include <stdint.h>
+
+#include <string>
+using namespace std;
+
+// Single-producer/single-consumer ring of 2D samples in POSIX shared
+// memory. The producer writes straight into the mapped ring and
+// publishes with a release store of head; the consumer reads the
+// samples in place and hands the space back by advancing tail. head
+// and tail count samples since creation and are never wrapped.
+class SampleRing{
+ public:
+  struct Header{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;  // in samples, a power of two
+    char pad0[48];
+    uint64_t head;      // written by the producer only
+    uint64_t runs;      // number of finished runs
+    uint64_t runend;    // value of head at the end of the last run
+    uint32_t closed;    // no more samples will be produced
+    char pad1[36];
+    uint64_t tail;      // written by the consumer only
+    char pad2[56];
+  };
+
+  // Producer side: create (or replace) the shared memory object
+  static SampleRing* create(const string& name, const size_t& capacity);
+  // Consumer side: attach to an existing ring
+  static SampleRing* attach(const string& name);
+  ~SampleRing();
+
+  // Producer: get up to n contiguous free samples, returns the count
+  size_t reserve(float** pts, const size_t& n);
+  // Producer: make n reserved samples visible to the consumer
+  void publish(const size_t& n);
+  // Producer: mark the end of a sampling run / of the stream
+  void endRun();
+  void close();
+
+  // Consumer: get the contiguous readable samples, returns the count
+  size_t acquire(const float** pts);
+  // Consumer: return n acquired samples to the producer
+  void release(const size_t& n);
+  // Consumer: true once the producer closed and everything was read
+  bool finished() const;
+
+  size_t capacity() const {return header_->capacity;}
+  uint64_t runs() const;
+  uint64_t runEnd() const;
+
+ private:
+  SampleRing(const string& name, const bool& owner, int fd,
+             Header* header, const size_t& mapsize);
+
+  string name_;
+  const bool owner_;
+  int fd_;
+  Header* header_;
+  float* data_;
+  size_t mapsize_;
+
+  // cached copy of the other side's counter
+  uint64_t cached_;
+};
+
+#endif
@@ -0,0 +1,309 @@
+
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+using namespace std;
+
+#include "SampleSet.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define OVERFLOW_BIT 0x80000000u
+
+const uint32_t SampleSet::NONE; //odr-used by assign
+
+SampleSet::SampleSet()
+    :npts_(0),radius_(0),cell_(1),invcell_(1),gw_(0),gh_(0),stride_(0){
+}
+
+size_t SampleSet::cellX(const float& x) const{
+  if(!(x > 0.0f)) return 0;
+  size_t c = x*invcell_;
+  return min(c, gw_-1);
+}
+
+size_t SampleSet::cellY(const float& y) const{
+  if(!(y > 0.0f)) return 0;
+  size_t c = y*invcell_;
+  return min(c, gh_-1);
+}
+
+void SampleSet::build(const vector<float>& pts, const float& r){
+  assert(r > 0.0f);
+  npts_ = pts.size()/2;
+  radius_ = r;
+  cell_ = r/sqrt(2.0f);
+  invcell_ = 1.0f/cell_;
+  gw_ = gh_ = max((size_t)1, (size_t)ceil(invcell_));
+  stride_ = gw_+3; //a 4-wide load at the last cell stays in the row
+
+  const float inf = numeric_limits<float>::infinity();
+  cellx_.assign(stride_*gh_, inf);
+  celly_.assign(stride_*gh_, inf);
+  cellid_.assign(stride_*gh_, NONE);
+  where_.resize(npts_);
+  overflow_.clear();
+
+  for(size_t i=0; i < npts_; i++){
+    float x = pts[2*i], y = pts[2*i+1];
+    size_t c = cellY(y)*stride_ + cellX(x);
+    if(cellid_[c] == NONE){
+      cellx_[c] = x;
+      celly_[c] = y;
+      cellid_[c] = i;
+      where_[i] = c;
+    }
+    else{ //closer than r to the sample of the cell
+      Extra e;
+      e.cell = c;
+      e.id = i;
+      e.x = x;
+      e.y = y;
+      overflow_.push_back(e);
+    }
+  }
+
+  stable_sort(overflow_.begin(), overflow_.end());
+  for(size_t j=0; j < overflow_.size(); j++){
+    where_[overflow_[j].id] = OVERFLOW_BIT | j;
+  }
+}
+
+void SampleSet::get(const uint32_t& i, float& x, float& y) const{
+  assert(i < npts_);
+  uint32_t c = where_[i];
+  if(c & OVERFLOW_BIT){
+    const Extra& e = overflow_[c & ~OVERFLOW_BIT];
+    x = e.x;
+    y = e.y;
+  }
+  else{
+    x = cellx_[c];
+    y = celly_[c];
+  }
+}
+
+void SampleSet::scanRow(const size_t& row, const size_t& c0, const size_t& c1,
+                        const float& x, const float& y, const float& d2,
+                        vector<uint32_t>& ids) const{
+  const size_t base = row*stride_;
+  const float* px = &cellx_[base];
+  const float* py = &celly_[base];
+  size_t c = c0;
+#ifdef __SSE2__
+  const __m128 vx = _mm_set1_ps(x);
+  const __m128 vy = _mm_set1_ps(y);
+  const __m128 vd2 = _mm_set1_ps(d2);
+  for(; c <= c1; c+=4){ //the lanes past c1 are masked off
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(px+c), vx);
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(py+c), vy);
+    __m128 dd = _mm_add_ps(_mm_mul_ps(dx,dx), _mm_mul_ps(dy,dy));
+    int mask = _mm_movemask_ps(_mm_cmple_ps(dd, vd2));
+    if(c1-c < 3) mask &= (2 << (c1-c)) - 1;
+    while(mask){
+      int b = __builtin_ctz(mask);
+      ids.push_back(cellid_[base+c+b]);
+      mask &= mask-1;
+    }
+  }
+#endif
+  for(; c <= c1; c++){
+    float dx = px[c]-x, dy = py[c]-y;
+    if(dx*dx+dy*dy <= d2){
+      ids.push_back(cellid_[base+c]);
+    }
+  }
+
+  if(!overflow_.empty()){
+    Extra key;
+    key.cell = base+c0;
+    vector<Extra>::const_iterator it
+        = lower_bound(overflow_.begin(), overflow_.end(), key);
+    for(; it != overflow_.end() && it->cell <= base+c1; it++){
+      float dx = it->x-x, dy = it->y-y;
+      if(dx*dx+dy*dy <= d2){
+        ids.push_back(it->id);
+      }
+    }
+  }
+}
+
+size_t SampleSet::radiusQuery(const float& x, const float& y, const float& d,
+                              vector<uint32_t>& ids) const{
+  if(npts_ == 0 || d < 0.0f) return 0;
+  size_t before = ids.size();
+  size_t cx0 = cellX(x-d), cx1 = cellX(x+d);
+  size_t cy0 = cellY(y-d), cy1 = cellY(y+d);
+  for(size_t row=cy0; row <= cy1; row++){
+    scanRow(row, cx0, cx1, x, y, d*d, ids);
+  }
+  return ids.size()-before;
+}
+
+//Insert (id,d) into the sorted k-best list
+static inline void knnInsert(const uint32_t& id, const float& d,
+                             const size_t& k, uint32_t* ids, float* dist2,
+                             size_t& found){
+  size_t i = (found < k) ? found++ : k-1;
+  while(i > 0 && dist2[i-1] > d){
+    ids[i] = ids[i-1];
+    dist2[i] = dist2[i-1];
+    i--;
+  }
+  ids[i] = id;
+  dist2[i] = d;
+}
+
+void SampleSet::knnRow(const size_t& row, const size_t& c0, const size_t& c1,
+                       const float& x, const float& y, const size_t& k,
+                       uint32_t* ids, float* dist2, size_t& found) const{
+  const float inf = numeric_limits<float>::infinity();
+  const size_t base = row*stride_;
+  const float* px = &cellx_[base];
+  const float* py = &celly_[base];
+  size_t c = c0;
+#ifdef __SSE2__
+  const __m128 vx = _mm_set1_ps(x);
+  const __m128 vy = _mm_set1_ps(y);
+  for(; c <= c1; c+=4){ //the lanes past c1 are masked off
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(px+c), vx);
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(py+c), vy);
+    __m128 dd = _mm_add_ps(_mm_mul_ps(dx,dx), _mm_mul_ps(dy,dy));
+    float worst = (found < k) ? inf : dist2[k-1];
+    int mask = _mm_movemask_ps(_mm_cmplt_ps(dd, _mm_set1_ps(worst)));
+    if(c1-c < 3) mask &= (2 << (c1-c)) - 1;
+    if(mask == 0) continue;
+    float d[4];
+    _mm_storeu_ps(d, dd);
+    while(mask){
+      int b = __builtin_ctz(mask);
+      if(found < k || d[b] < dist2[k-1]){
+        knnInsert(cellid_[base+c+b], d[b], k, ids, dist2, found);
+      }
+      mask &= mask-1;
+    }
+  }
+#endif
+  for(; c <= c1; c++){
+    if(cellid_[base+c] == NONE) continue;
+    float dx = px[c]-x, dy = py[c]-y;
+    float d = dx*dx+dy*dy;
+    if(found < k || d < dist2[k-1]){
+      knnInsert(cellid_[base+c], d, k, ids, dist2, found);
+    }
+  }
+
+  if(!overflow_.empty()){
+    Extra key;
+    key.cell = base+c0;
+    vector<Extra>::const_iterator it
+        = lower_bound(overflow_.begin(), overflow_.end(), key);
+    for(; it != overflow_.end() && it->cell <= base+c1; it++){
+      float dx = it->x-x, dy = it->y-y;
+      float d = dx*dx+dy*dy;
+      if(found < k || d < dist2[k-1]){
+        knnInsert(it->id, d, k, ids, dist2, found);
+      }
+    }
+  }
+}
+
+size_t SampleSet::knnQuery(const float& x, const float& y, const size_t& k,
+                           uint32_t* ids, float* dist2) const{
+  size_t found = 0;
+  if(npts_ == 0 || k == 0) return 0;
+  const long cx = cellX(x), cy = cellY(y);
+  const long w = gw_, h = gh_;
+
+  //visit rings of cells at growing Chebyshev distance t; the samples
+  //of ring t are at least (t-1) cells away
+  for(long t=0; ; t++){
+    if(found == k && t > 0){
+      float bound = (t-1)*cell_;
+      if(dist2[k-1] <= bound*bound) break;
+    }
+    if(cx-t < 0 && cy-t < 0 && cx+t >= w && cy+t >= h) break;
+
+    long x0 = max(cx-t, 0L), x1 = min(cx+t, w-1);
+    if(cy-t >= 0){
+      knnRow(cy-t, x0, x1, x, y, k, ids, dist2, found);
+    }
+    if(t > 0 && cy+t < h){
+      knnRow(cy+t, x0, x1, x, y, k, ids, dist2, found);
+    }
+    long y0 = max(cy-t+1, 0L), y1 = min(cy+t-1, h-1);
+    for(long row=y0; t > 0 && row <= y1; row++){
+      if(cx-t >= 0){
+        knnRow(row, cx-t, cx-t, x, y, k, ids, dist2, found);
+      }
+      if(cx+t < w){
+        knnRow(row, cx+t, cx+t, x, y, k, ids, dist2, found);
+      }
+    }
+  }
+  return found;
+}
+
+//Order the queries by grid row (counting sort) so that neighbouring
+//queries share cache lines
+void SampleSet::sortQueries(const float* q, const size_t& nq,
+                            vector<uint32_t>& order) const{
+  vector<uint32_t> start(gh_+1, 0);
+  for(size_t i=0; i < nq; i++){
+    start[cellY(q[2*i+1])+1]++;
+  }
+  for(size_t row=0; row < gh_; row++){
+    start[row+1] += start[row];
+  }
+  order.resize(nq);
+  for(size_t i=0; i < nq; i++){
+    order[start[cellY(q[2*i+1])]++] = i;
+  }
+}
+
+void SampleSet::radiusQueryBatch(const float* q, const size_t& nq,
+                                 const float& d, vector<uint32_t>& offsets,
+                                 vector<uint32_t>& ids) const{
+  vector<uint32_t> order;
+  sortQueries(q, nq, order);
+
+  //results in sorted order, then scattered back to the query order
+  vector<uint32_t> sorted, start(nq+1), count(nq);
+  for(size_t i=0; i < nq; i++){
+    uint32_t qi = order[i];
+    start[i] = sorted.size();
+    count[qi] = radiusQuery(q[2*qi], q[2*qi+1], d, sorted);
+  }
+  start[nq] = sorted.size();
+
+  offsets.resize(nq+1);
+  offsets[0] = 0;
+  for(size_t qi=0; qi < nq; qi++){
+    offsets[qi+1] = offsets[qi] + count[qi];
+  }
+  ids.resize(sorted.size());
+  for(size_t i=0; i < nq; i++){
+    uint32_t qi = order[i];
+    copy(sorted.begin()+start[i], sorted.begin()+start[i+1],
+         ids.begin()+offsets[qi]);
+  }
+}
+
+void SampleSet::knnQueryBatch(const float* q, const size_t& nq,
+                              const size_t& k, uint32_t* ids,
+                              float* dist2) const{
+  vector<uint32_t> order;
+  sortQueries(q, nq, order);
+  for(size_t i=0; i < nq; i++){
+    uint32_t qi = order[i];
+    size_t found = knnQuery(q[2*qi], q[2*qi+1], k, ids+qi*k, dist2+qi*k);
+    for(size_t j=found; j < k; j++){
+      ids[qi*k+j] = NONE;
+      dist2[qi*k+j] = numeric_limits<float>::infinity();
+    }
+  }
+}
@@ -0,0 +1,89 @@
+#ifndef __SAMPLESET__
+#define __SAMPLESET__
+
+#include <stdint.h>
+
+#include <vector>
+using namespace std;
+
+// Sample set in the unit square with a uniform grid index. The cell
+// size is r/sqrt(2), so a set with minimum distance r has at most one
+// sample per cell and the grid stores the samples themselves: every
+// cell holds the coordinates (SoA, +inf when empty) and the index of
+// its sample. Rows of cells are contiguous and padded, which lets the
+// queries test four cells per SSE instruction. Samples closer than r
+// (the GPU sampler resolves conflicts per pixel) go to a small
+// overflow list.
+class SampleSet{
+ public:
+  static const uint32_t NONE = 0xffffffff;
+
+  SampleSet();
+
+  // Index interleaved (x,y) points with the nominal minimum distance r
+  void build(const vector<float>& pts, const float& r);
+
+  size_t size() const {return npts_;}
+  float radius() const {return radius_;}
+  float cellSize() const {return cell_;}
+  size_t gridWidth() const {return gw_;}
+  size_t gridHeight() const {return gh_;}
+  size_t overflowSize() const {return overflow_.size();}
+
+  // Coordinates of the sample with the input index i
+  void get(const uint32_t& i, float& x, float& y) const;
+
+  // Indices of the samples within distance d of (x,y), appended to ids
+  size_t radiusQuery(const float& x, const float& y, const float& d,
+                     vector<uint32_t>& ids) const;
+
+  // The k nearest samples sorted by distance, returns how many were
+  // found (less than k only if the set is smaller)
+  size_t knnQuery(const float& x, const float& y, const size_t& k,
+                  uint32_t* ids, float* dist2) const;
+
+  // Batched versions, queries are interleaved (x,y). Radius results
+  // are in CSR form: the ids of query q are ids[offsets[q],offsets[q+1]).
+  // kNN results are k entries per query, padded with NONE.
+  void radiusQueryBatch(const float* q, const size_t& nq, const float& d,
+                        vector<uint32_t>& offsets,
+                        vector<uint32_t>& ids) const;
+  void knnQueryBatch(const float* q, const size_t& nq, const size_t& k,
+                     uint32_t* ids, float* dist2) const;
+
+ private:
+  size_t npts_;
+  float radius_;
+  float cell_,invcell_;
+  size_t gw_,gh_;
+  size_t stride_;               // gw_ plus empty padding cells
+
+  vector<float> cellx_,celly_;  // +inf for empty cells
+  vector<uint32_t> cellid_;     // NONE for empty cells
+  vector<uint32_t> where_;      // input index -> cell, NONE if overflow
+
+  struct Extra{
+    uint32_t cell;
+    uint32_t id;
+    float x,y;
+    bool operator<(const Extra& b) const {return cell < b.cell;}
+  };
+  vector<Extra> overflow_;      // sorted by cell
+
+  size_t cellX(const float& x) const;
+  size_t cellY(const float& y) const;
+
+  // Test the cells [c0,c1] of one row against the disk (x,y,d2)
+  void scanRow(const size_t& row, const size_t& c0, const size_t& c1,
+               const float& x, const float& y, const float& d2,
+               vector<uint32_t>& ids) const;
+  // Offer the samples of cells [c0,c1] of one row to a k-best list
+  void knnRow(const size_t& row, const size_t& c0, const size_t& c1,
+              const float& x, const float& y, const size_t& k,
+              uint32_t* ids, float* dist2, size_t& found) const;
+
+  void sortQueries(const float* q, const size_t& nq,
+                   vector<uint32_t>& order) const;
+};
+
+#endif
@@ -0,0 +1,410 @@
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "SampleVerifier.hpp"
+#include "Parallel.hpp"
+
+#define REFINELEVELS 7    //cells are 2r wide, leaves r/64
+#define COVERSLACK 1e-5   //relative to r^2, a vertex that close to a
+                          //third circle closes a void of no area
+
+namespace{
+
+// The samples bucketed in g x g cells at least 2r wide (CSR, sorted by
+// cell): a disk touching a cell, or a disk through a point of the
+// cell, has its center in the 3x3 cells around it
+struct VerifyGrid{
+  size_t g;
+  double cell;
+  vector<uint32_t> start;   // g*g+1 offsets
+  vector<float> x,y;
+
+  size_t cellOf(const float& v) const{
+    if(!(v > 0.0f)) return 0;
+    return min((size_t)(v*g), g-1);
+  }
+
+  // Samples of the 3x3 cells around (cx,cy), their sorted index in ids
+  void around(const size_t& cx, const size_t& cy, vector<float>& nx,
+              vector<float>& ny, vector<uint32_t>& ids) const{
+    nx.clear();
+    ny.clear();
+    ids.clear();
+    size_t x0 = cx ? cx-1 : 0, x1 = min(cx+1, g-1);
+    size_t y0 = cy ? cy-1 : 0, y1 = min(cy+1, g-1);
+    for(size_t j=y0; j <= y1; j++){
+      for(size_t k=start[j*g+x0]; k < start[j*g+x1+1]; k++){
+        nx.push_back(x[k]);
+        ny.push_back(y[k]);
+        ids.push_back(k);
+      }
+    }
+  }
+};
+
+// Inside one of the disks (nx,ny) but skip1 and skip2 (local indices)
+bool coveredBy(const double& px, const double& py, const vector<float>& nx,
+               const vector<float>& ny, const double& r2,
+               const size_t& skip1, const size_t& skip2){
+  double limit = r2*(1+COVERSLACK);
+  for(size_t k=0; k < nx.size(); k++){
+    double dx = nx[k]-px, dy = ny[k]-py;
+    if(dx*dx+dy*dy < limit && k != skip1 && k != skip2){
+      return true;
+    }
+  }
+  return false;
+}
+
+class CountWork : public ParallelWork{
+ public:
+  CountWork(const vector<float>& pts, VerifyGrid& grid)
+      :pts_(pts),grid_(grid){}
+
+  void range(const size_t& begin, const size_t& end, const size_t&){
+    for(size_t i=begin; i < end; i++){
+      size_t c = grid_.cellOf(pts_[2*i+1])*grid_.g + grid_.cellOf(pts_[2*i]);
+      __sync_fetch_and_add(&grid_.start[c+1], 1u);
+    }
+  }
+
+ private:
+  const vector<float>& pts_;
+  VerifyGrid& grid_;
+};
+
+// The order inside a cell depends on the threads, nothing else does
+class ScatterWork : public ParallelWork{
+ public:
+  ScatterWork(const vector<float>& pts, VerifyGrid& grid)
+      :pts_(pts),grid_(grid),cursor_(grid.start.begin(), grid.start.end()-1){}
+
+  void range(const size_t& begin, const size_t& end, const size_t&){
+    for(size_t i=begin; i < end; i++){
+      size_t c = grid_.cellOf(pts_[2*i+1])*grid_.g + grid_.cellOf(pts_[2*i]);
+      uint32_t k = __sync_fetch_and_add(&cursor_[c], 1u);
+      grid_.x[k] = pts_[2*i];
+      grid_.y[k] = pts_[2*i+1];
+    }
+  }
+
+ private:
+  const vector<float>& pts_;
+  VerifyGrid& grid_;
+  vector<uint32_t> cursor_;
+};
+
+struct Tally{
+  float mind2;
+  size_t closepairs;
+  vector<float> voids;      // interleaved uncovered vertices
+
+  Tally():mind2(numeric_limits<float>::infinity()),closepairs(0){}
+};
+
+// Distances and vertices of the union, by rows of cells
+class PairWork : public ParallelWork{
+ public:
+  PairWork(const VerifyGrid& grid, const float& r, vector<Tally>& tallies)
+      :grid_(grid),r_(r),r2_((double)r*r),tallies_(tallies){}
+
+  void range(const size_t& begin, const size_t& end, const size_t& thread){
+    Tally& tally = tallies_[thread];
+    float mind2 = tally.mind2;
+    size_t closepairs = tally.closepairs;
+    float r2f = r_*r_;
+    vector<float> nx,ny,cx,cy;
+    vector<uint32_t> ids,cid;
+    for(size_t row=begin; row < end; row++){
+      for(size_t col=0; col < grid_.g; col++){
+        size_t c = row*grid_.g+col;
+        if(grid_.start[c] == grid_.start[c+1]){
+          continue;
+        }
+        grid_.around(col, row, nx, ny, ids);
+        for(size_t li=0; li < ids.size(); li++){
+          uint32_t i = ids[li];
+          if(i < grid_.start[c] || i >= grid_.start[c+1]){
+            continue; //a sample of a neighbour cell
+          }
+          //the disks closer than 2r meet the disk of i, they are the
+          //only ones that can cover a point of its circle. They are
+          //kept relative to i, exact in float next to it.
+          float px = nx[li], py = ny[li];
+          cx.clear();
+          cy.clear();
+          cid.clear();
+          for(size_t lj=0; lj < ids.size(); lj++){
+            float dx = nx[lj]-px, dy = ny[lj]-py;
+            float d2 = dx*dx+dy*dy;
+            if(ids[lj] > i){ //every pair once
+              if(d2 < mind2) mind2 = d2;
+              if(d2 < r2f) closepairs++;
+            }
+            if(lj != li && d2 > 0.0f && d2 < 4*r2f){
+              cx.push_back(dx);
+              cy.push_back(dy);
+              cid.push_back(ids[lj]);
+            }
+          }
+          for(size_t k=0; k < cid.size(); k++){
+            if(cid[k] > i){
+              crossings(px, py, k, cx, cy, tally.voids);
+            }
+          }
+          edges(px, py, cx, cy, tally.voids);
+        }
+      }
+    }
+    tally.mind2 = mind2;
+    tally.closepairs = closepairs;
+  }
+
+ private:
+  const VerifyGrid& grid_;
+  float r_;
+  double r2_;
+  vector<Tally>& tallies_;
+
+  static bool inSquare(const double& x, const double& y){
+    return x >= 0 && x <= 1 && y >= 0 && y <= 1;
+  }
+
+  // Inside one of the disks (cx,cy) but skip, relative to the sample
+  bool covered(const float& vx, const float& vy, const vector<float>& cx,
+               const vector<float>& cy, const size_t& skip) const{
+    float limit = r2_*(1+COVERSLACK);
+    for(size_t k=0; k < cx.size(); k++){
+      float dx = cx[k]-vx, dy = cy[k]-vy;
+      if(dx*dx+dy*dy < limit && k != skip){
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // The two points where the circles of (x,y) and of its neighbour k
+  // cross
+  void crossings(const double& x, const double& y, const size_t& k,
+                 const vector<float>& cx, const vector<float>& cy,
+                 vector<float>& voids) const{
+    float dx = cx[k], dy = cy[k];
+    float h = sqrt(max(r2_/(dx*dx+dy*dy)-0.25, 0.0)); //half chord over d
+    for(int side=-1; side <= 1; side+=2){
+      float vx = dx/2-side*h*dy, vy = dy/2+side*h*dx;
+      if(inSquare(x+vx, y+vy) && !covered(vx, vy, cx, cy, k)){
+        voids.push_back(x+vx);
+        voids.push_back(y+vy);
+      }
+    }
+  }
+
+  // The points where the circle of (x,y) crosses the edges of the square
+  void edges(const double& x, const double& y, const vector<float>& cx,
+             const vector<float>& cy, vector<float>& voids) const{
+    double dist[4] = {x, 1-x, y, 1-y};
+    for(int e=0; e < 4; e++){
+      if(!(dist[e] < r_)){
+        continue;
+      }
+      float h = sqrt(r2_-dist[e]*dist[e]);
+      for(int side=-1; side <= 1; side+=2){
+        float vx = (e < 2) ? (e ? dist[e] : -dist[e]) : side*h;
+        float vy = (e < 2) ? side*h : (e == 3 ? dist[e] : -dist[e]);
+        if(inSquare(x+vx, y+vy) && !covered(vx, vy, cx, cy, cx.size())){
+          voids.push_back((e < 2) ? (e ? 1 : 0) : x+vx);
+          voids.push_back((e < 2) ? y+vy : (e == 3 ? 1 : 0));
+        }
+      }
+    }
+  }
+};
+
+// Uncovered area of cells, and the sides it reaches (1 left, 2 right,
+// 4 bottom, 8 top) so the voids can be followed into the next cells
+class AreaWork : public ParallelWork{
+ public:
+  AreaWork(const VerifyGrid& grid, const float& r,
+           const vector<uint32_t>& cells)
+      :grid_(grid),r2_((double)r*r),cells_(cells),area_(cells.size(), 0),
+       sides_(cells.size(), 0){}
+
+  double area(const size_t& k) const {return area_[k];}
+  unsigned sides(const size_t& k) const {return sides_[k];}
+
+  void range(const size_t& begin, const size_t& end, const size_t&){
+    CellDisks cell;
+    vector<uint32_t> ids;
+    vector<vector<uint32_t> > live(REFINELEVELS+1);
+    for(size_t k=begin; k < end; k++){
+      size_t cx = cells_[k] % grid_.g, cy = cells_[k] / grid_.g;
+      grid_.around(cx, cy, cell.nx, cell.ny, ids);
+      cell.x0 = cx*grid_.cell;
+      cell.y0 = cy*grid_.cell;
+      live[0].resize(ids.size());
+      for(size_t i=0; i < ids.size(); i++) live[0][i] = i;
+      unsigned sides = 0;
+      area_[k] = refine(cell, cell.x0, cell.y0, grid_.cell, 0, live, sides);
+      sides_[k] = sides;
+    }
+  }
+
+ private:
+  const VerifyGrid& grid_;
+  double r2_;
+  const vector<uint32_t>& cells_;
+  vector<double> area_;
+  vector<unsigned> sides_;
+
+  // The cell being measured and the disks around it
+  struct CellDisks{
+    vector<float> nx,ny;
+    double x0,y0;
+  };
+
+  // Uncovered area of the square, the disks that may touch it are
+  // live[level]
+  double refine(const CellDisks& cell, const double& x, const double& y,
+                const double& s, const size_t& level,
+                vector<vector<uint32_t> >& live, unsigned& sides) const{
+    const vector<float>& nx = cell.nx;
+    const vector<float>& ny = cell.ny;
+    vector<uint32_t>* next = (level < REFINELEVELS) ? &live[level+1] : NULL;
+    if(next != NULL) next->clear();
+
+    bool touched = false;
+    for(size_t i=0; i < live[level].size(); i++){
+      uint32_t d = live[level][i];
+      double dx0 = x-nx[d], dx1 = x+s-nx[d];
+      double dy0 = y-ny[d], dy1 = y+s-ny[d];
+      if(max(dx0*dx0, dx1*dx1)+max(dy0*dy0, dy1*dy1) <= r2_){
+        return 0; //inside the disk
+      }
+      double cx = min(max((double)nx[d], x), x+s) - nx[d];
+      double cy = min(max((double)ny[d], y), y+s) - ny[d];
+      if(cx*cx+cy*cy < r2_){
+        touched = true;
+        if(next != NULL) next->push_back(d);
+      }
+    }
+
+    if(touched && next == NULL){
+      //a leaf, decided by its center
+      double mx = x+s/2, my = y+s/2;
+      for(size_t i=0; i < live[level].size(); i++){
+        uint32_t d = live[level][i];
+        double dx = nx[d]-mx, dy = ny[d]-my;
+        if(dx*dx+dy*dy < r2_){
+          return 0;
+        }
+      }
+    }
+    else if(touched){
+      double h = s/2, a = 0;
+      //the children overwrite live[level+1], keep our own copy
+      vector<uint32_t> mine(next->begin(), next->end());
+      for(int c=0; c < 4; c++){
+        live[level+1] = mine;
+        a += refine(cell, x+(c&1)*h, y+(c>>1)*h, h, level+1, live, sides);
+      }
+      return a;
+    }
+
+    //uncovered
+    double eps = s/4, x0 = cell.x0, y0 = cell.y0;
+    if(x-x0 < eps) sides |= 1;
+    if(x0+grid_.cell-(x+s) < eps) sides |= 2;
+    if(y-y0 < eps) sides |= 4;
+    if(y0+grid_.cell-(y+s) < eps) sides |= 8;
+    return s*s;
+  }
+};
+
+}
+
+void verifySamples(const vector<float>& pts, const float& r,
+                   const size_t& threads, SampleVerification& result){
+  size_t nthreads = parallelThreads(threads);
+  size_t npts = pts.size()/2;
+
+  VerifyGrid grid;
+  grid.g = max((size_t)1, (size_t)floor(0.5/r));
+  grid.cell = 1.0/grid.g;
+  grid.start.assign(grid.g*grid.g+1, 0);
+  CountWork counting(pts, grid);
+  runParallel(counting, npts, 1<<16, nthreads);
+  for(size_t c=0; c < grid.g*grid.g; c++){
+    grid.start[c+1] += grid.start[c];
+  }
+  grid.x.resize(npts);
+  grid.y.resize(npts);
+  ScatterWork scatter(pts, grid);
+  runParallel(scatter, npts, 1<<16, nthreads);
+
+  vector<Tally> tallies(nthreads);
+  PairWork pairs(grid, r, tallies);
+  runParallel(pairs, grid.g, 1, nthreads);
+
+  result.npts = npts;
+  result.closepairs = 0;
+  float mind2 = numeric_limits<float>::infinity();
+  vector<float> voids;
+  for(size_t t=0; t < nthreads; t++){
+    mind2 = min(mind2, tallies[t].mind2);
+    result.closepairs += tallies[t].closepairs;
+    voids.insert(voids.end(), tallies[t].voids.begin(), tallies[t].voids.end());
+  }
+  result.mindist = sqrt(mind2)/r;
+
+  //the corners of the square
+  vector<float> nx,ny;
+  vector<uint32_t> ids;
+  double r2 = (double)r*r;
+  for(int c=0; c < 4; c++){
+    float px = c&1, py = c>>1;
+    grid.around(grid.cellOf(px), grid.cellOf(py), nx, ny, ids);
+    if(!coveredBy(px, py, nx, ny, r2, nx.size(), nx.size())){
+      voids.push_back(px);
+      voids.push_back(py);
+    }
+  }
+  result.voids = voids.size()/2;
+
+  //measure the voids from their vertices, cell by cell while they
+  //reach the next cell
+  vector<unsigned char> visited(grid.g*grid.g, 0);
+  vector<uint32_t> frontier;
+  for(size_t v=0; v < voids.size(); v+=2){
+    size_t c = grid.cellOf(voids[v+1])*grid.g + grid.cellOf(voids[v]);
+    if(!visited[c]){
+      visited[c] = 1;
+      frontier.push_back(c);
+    }
+  }
+  double uncovered = 0;
+  while(!frontier.empty()){
+    AreaWork area(grid, r, frontier);
+    runParallel(area, frontier.size(), 16, nthreads);
+    vector<uint32_t> next;
+    for(size_t k=0; k < frontier.size(); k++){
+      uncovered += area.area(k);
+      size_t cx = frontier[k] % grid.g, cy = frontier[k] / grid.g;
+      unsigned sides = area.sides(k);
+      size_t n[4] = {cy*grid.g+cx-1, cy*grid.g+cx+1,
+                     (cy-1)*grid.g+cx, (cy+1)*grid.g+cx};
+      bool inside[4] = {cx > 0, cx+1 < grid.g, cy > 0, cy+1 < grid.g};
+      for(int s=0; s < 4; s++){
+        if((sides & (1u << s)) && inside[s] && !visited[n[s]]){
+          visited[n[s]] = 1;
+          next.push_back(n[s]);
+        }
+      }
+    }
+    frontier.swap(next);
+  }
+  result.coverage = max(0.0, 1-uncovered);
+}
@@ -0,0 +1,31 @@
+#ifndef __SAMPLEVERIFIER__
+#define __SAMPLEVERIFIER__
+
+#include <vector>
+using namespace std;
+
+// Check of a Poisson disk sample set in the unit square against its
+// radius r. Disks of radius r around the samples must not contain
+// another sample (distance) and must cover the square (maximality).
+//
+// The union of the disks leaves a void only if one of its vertices is
+// uncovered: a corner of the square, a point where a circle crosses an
+// edge of the square or a point where two circles cross. Every such
+// point is tested against the other disks, the uncovered ones are the
+// voids. The area of the voids is then measured on the cells around
+// them by refining squares until they are inside a disk, outside all
+// of them or r/64 wide.
+struct SampleVerification{
+  size_t npts;
+  double mindist;       // smallest distance between two samples over r
+  size_t closepairs;    // pairs closer than r
+  size_t voids;         // uncovered vertices, 0 for a maximal set
+  double coverage;      // fraction of the square within r of a sample
+};
+
+// Verify interleaved (x,y) points with threads threads, 0 for one per
+// online processor. Sets of up to 2^32 points.
+void verifySamples(const vector<float>& pts, const float& r,
+                   const size_t& threads, SampleVerification& result);
+
+#endif
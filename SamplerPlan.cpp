@@ -0,0 +1,101 @@
+
+#include <stdint.h>
+
+#include <algorithm>
+
+#include "SamplerPlan.hpp"
+#include "PoissonDiskSampler.hpp"
+
+#define MINTILE 64
+
+size_t SamplerPlan::tiles() const{
+  return ((width+tilewidth-1)/tilewidth) * ((height+tileheight-1)/tileheight);
+}
+
+size_t SamplerPlan::feedbackStride() const{
+  //the geometry shader emits three vertices per accepted dart
+  return 3*(packedcoords ? sizeof(uint32_t) : 2*sizeof(float));
+}
+
+size_t SamplerPlan::resultsCapacity() const{
+  return computeN(radius)*1.2;
+}
+
+void samplerMemory(const SamplerPlan& plan, vector<MemoryItem>& items){
+  size_t pixels = plan.tilewidth*plan.tileheight;
+  size_t results = plan.feedbackStride()*plan.resultsCapacity();
+
+  items.push_back(MemoryItem("dart buffer", sizeof(uint32_t)*plan.ndarts,
+                             true));
+  //a one element buffer keeps the cuda registration valid
+  items.push_back(MemoryItem("empty pixel list", sizeof(uint32_t)*
+                             (plan.emptylist ? pixels : 1), true));
+  items.push_back(MemoryItem("results buffer", results, true));
+  //24 bit depth is stored in 32 bits
+  items.push_back(MemoryItem("depth texture", 4*pixels, true));
+  items.push_back(MemoryItem("coverage texture", pixels, true));
+  //copy_if/remove_if stage the kept elements, count_if needs nothing
+  items.push_back(MemoryItem("compaction scratch (estimate)",
+                             plan.emptylist ? sizeof(uint32_t)*pixels : 0,
+                             true));
+  //downloadResults copies the whole feedback buffer
+  items.push_back(MemoryItem("download staging", results, false));
+}
+
+size_t totalMemory(const vector<MemoryItem>& items, const bool& gpu){
+  size_t total = 0;
+  for(size_t i=0; i < items.size(); i++){
+    if(items[i].gpu == gpu){
+      total += items[i].bytes;
+    }
+  }
+  return total;
+}
+
+void printMemory(FILE* f, const vector<MemoryItem>& items){
+  for(size_t i=0; i < items.size(); i++){
+    fprintf(f, "#mem %-30s %s %10.3f MB\n", items[i].name.c_str(),
+            items[i].gpu ? "gpu" : "cpu", items[i].bytes/1048576.0);
+  }
+  fprintf(f, "#mem %-30s gpu %10.3f MB\n", "total",
+          totalMemory(items, true)/1048576.0);
+  fprintf(f, "#mem %-30s cpu %10.3f MB\n", "total",
+          totalMemory(items, false)/1048576.0);
+}
+
+bool planMemory(const size_t& w, const size_t& h, const size_t& nd,
+                const float& r, const size_t& budget, const size_t& maxtiles,
+                SamplerPlan& plan){
+  static const bool packed[2] = {false, true};
+
+  //uniform darts rarely hit the last empty pixels, so coverage rejection
+  //is not maximal within the iteration cap: split into tiles first
+  for(size_t nolist=0; nolist < 2; nolist++){
+    for(size_t k=0; ; k++){
+      size_t tw = w >> k, th = h >> k;
+      //a tile is a unit square of its own, the radius grows with the split
+      SamplerPlan p(w, h, max(nd >> (2*k), (size_t)1), r*(1 << k));
+      p.tilewidth = max(tw, (size_t)1);
+      p.tileheight = max(th, (size_t)1);
+      p.emptylist = !nolist;
+      if(k > 0 && p.tiles() > maxtiles){
+        break;
+      }
+
+      for(size_t i=0; i < 2; i++){
+        p.packedcoords = packed[i];
+        plan = p;
+
+        vector<MemoryItem> items;
+        samplerMemory(p, items);
+        if(totalMemory(items, true) <= budget){
+          return true;
+        }
+      }
+      if(tw/2 < MINTILE || th/2 < MINTILE){
+        break;
+      }
+    }
+  }
+  return false;
+}
@@ -0,0 +1,60 @@
+#ifndef __SAMPLERPLAN__
+#define __SAMPLERPLAN__
+
+#include <cstdio>
+#include <vector>
+#include <string>
+using namespace std;
+
+// Storage choices of a PoissonDiskSampler, fixed before anything is
+// allocated. The defaults are the original layout: float feedback
+// coordinates and a compacted list of the empty pixels. A sampler
+// built from a plan covers one tile: ndarts and radius are those of
+// the tile, in its own unit square.
+struct SamplerPlan{
+  size_t width,height;          // coverage grid of the whole domain
+  size_t tilewidth,tileheight;  // grid of one tile, see planMemory()
+  size_t ndarts;
+  float radius;
+  bool packedcoords;  // capture the 16 bit unorm dart instead of 2 floats
+  bool emptylist;     // compact the empty pixels, or reject covered darts
+
+  SamplerPlan(const size_t& w=0, const size_t& h=0, const size_t& nd=0,
+              const float& r=0)
+      :width(w),height(h),tilewidth(w),tileheight(h),ndarts(nd),radius(r),
+       packedcoords(false),emptylist(true){}
+
+  size_t tiles() const;
+  // Bytes of one accepted sample in the transform feedback buffer
+  size_t feedbackStride() const;
+  // Capacity of the feedback buffer, 120% of the expected samples
+  size_t resultsCapacity() const;
+};
+
+struct MemoryItem{
+  string name;
+  size_t bytes;
+  bool gpu;
+  MemoryItem(const string& n, const size_t& b, const bool& g)
+      :name(n),bytes(b),gpu(g){}
+};
+
+// The buffers a sampler with this plan allocates for one tile
+void samplerMemory(const SamplerPlan& plan, vector<MemoryItem>& items);
+size_t totalMemory(const vector<MemoryItem>& items, const bool& gpu);
+void printMemory(FILE* f, const vector<MemoryItem>& items);
+
+// Choose the storage of a w x h sampler with radius r and nd darts per
+// iteration so that its GPU buffers fit in budget bytes, split in at
+// most maxtiles tiles. In order of preference: the original layout,
+// packed coordinates, then the same on square tiles of half the size
+// each step (the radius and darts are scaled to the tile, the tiles are
+// sampled one at a time by the caller). Only if no tile fits with the
+// empty list are the same sizes tried without it, coverage rejection
+// may stop before the set is maximal. Returns false if nothing within
+// maxtiles fits; plan then holds the last candidate.
+bool planMemory(const size_t& w, const size_t& h, const size_t& nd,
+                const float& r, const size_t& budget, const size_t& maxtiles,
+                SamplerPlan& plan);
+
+#endif
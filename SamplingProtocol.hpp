@@ -0,0 +1,69 @@
+#ifndef __SAMPLINGPROTOCOL__
+#define __SAMPLINGPROTOCOL__
+
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+
+// Binary framing of the sampling daemon (host byte order, the socket
+// is local). A request is a SampleRequest followed by masksize bytes
+// of a PNG importance map. A reply is a SampleReply followed by
+// npts*2 floats with the sample coordinates in (0,1). The sampler
+// shaders don't use importance maps yet, so a request with a mask is
+// answered SAMPLE_BAD_REQUEST.
+
+#define SAMPLE_REQUEST_MAGIC 0x51525050 // "PPRQ"
+#define SAMPLE_REPLY_MAGIC   0x53525050 // "PPRS"
+#define SAMPLE_PROTOCOL_VERSION 1
+
+enum SampleStatus{
+  SAMPLE_OK = 0,
+  SAMPLE_BAD_REQUEST = 1, // malformed frame or parameters
+  SAMPLE_BUSY = 2,        // the request queue is full, retry later
+  SAMPLE_FAILED = 3       // the sampler could not serve the request
+};
+
+struct SampleRequest{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  float radius;      // normalized to the unit domain
+  uint32_t seed;
+  uint32_t ndarts;   // 0 picks computeN(radius)/2
+  uint32_t masksize; // size of the trailing PNG, must be 0 for now
+};
+
+struct SampleReply{
+  uint32_t magic;
+  uint32_t status;
+  uint32_t iterations;
+  uint32_t npts;
+};
+
+//Read/write exactly size bytes, returns false on error or EOF
+inline bool readFully(int fd, void* buf, size_t size){
+  char* p = (char*)buf;
+  while(size > 0){
+    ssize_t n = read(fd, p, size);
+    if(n < 0 && errno == EINTR) continue;
+    if(n <= 0) return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+inline bool writeFully(int fd, const void* buf, size_t size){
+  const char* p = (const char*)buf;
+  while(size > 0){
+    ssize_t n = write(fd, p, size);
+    if(n < 0 && errno == EINTR) continue;
+    if(n <= 0) return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,310 @@
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+#include "SamplingServer.hpp"
+#include "PoissonDiskSampler.hpp"
+#include "SampleVerifier.hpp"
+
+//Largest accepted request parameters
+#define MAXDIM 16384
+#define MAXMASKSIZE (256u<<20)
+
+SamplingServer::SamplingServer(const string& socketpath,
+                               const size_t& maxqueue,
+                               const size_t& maxsamplers,
+                               const bool& verify)
+    :socketpath_(socketpath),maxqueue_(maxqueue),maxsamplers_(maxsamplers),
+     verify_(verify),listenfd_(-1),stop_(0){
+  assert(maxqueue_ > 0);
+  assert(maxsamplers_ > 0);
+
+  pthread_mutex_init(&mutex_,NULL);
+  pthread_cond_init(&cond_,NULL);
+
+  //a client hanging up must not kill the daemon
+  signal(SIGPIPE, SIG_IGN);
+
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  assert(socketpath_.size() < sizeof(addr.sun_path));
+  strncpy(addr.sun_path, socketpath_.c_str(), sizeof(addr.sun_path)-1);
+
+  unlink(socketpath_.c_str()); //remove a stale socket
+  listenfd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  assert(listenfd_ >= 0);
+  int err = bind(listenfd_, (sockaddr*)&addr, sizeof(addr));
+  if(err != 0){
+    perror(socketpath_.c_str());
+  }
+  assert(err == 0);
+  err = listen(listenfd_, 64);
+  assert(err == 0);
+
+  pthread_create(&acceptthread_, NULL, acceptLoop, this);
+}
+
+SamplingServer::~SamplingServer(){
+  stop();
+  shutdown(listenfd_, SHUT_RDWR);
+  close(listenfd_);
+  pthread_join(acceptthread_, NULL);
+  unlink(socketpath_.c_str());
+
+  //fail the requests that never ran
+  pthread_mutex_lock(&mutex_);
+  while(!queue_.empty()){
+    Job* job = queue_.front();
+    queue_.pop_front();
+    job->reply.status = SAMPLE_FAILED;
+    job->done = true;
+    pthread_cond_signal(&job->cond);
+  }
+  pthread_mutex_unlock(&mutex_);
+
+  //no client thread may outlive the mutex and the queue
+  reapClients(true);
+
+  while(!samplers_.empty()){
+    delete samplers_.back();
+    samplers_.pop_back();
+  }
+  pthread_cond_destroy(&cond_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+void* SamplingServer::acceptLoop(void* self){
+  SamplingServer* server = (SamplingServer*) self;
+  while(!server->stop_){
+    int fd = accept(server->listenfd_, NULL, NULL);
+    if(fd < 0){
+      if(errno == EINTR) continue;
+      break; //listening socket was shut down
+    }
+    server->reapClients(false);
+
+    Client* client = new Client;
+    client->server = server;
+    client->fd = fd;
+    client->finished = false;
+    pthread_mutex_lock(&server->mutex_);
+    if(pthread_create(&client->thread, NULL, clientLoop, client) != 0){
+      pthread_mutex_unlock(&server->mutex_);
+      close(fd);
+      delete client;
+      continue;
+    }
+    server->clients_.push_back(client);
+    pthread_mutex_unlock(&server->mutex_);
+  }
+  return NULL;
+}
+
+void* SamplingServer::clientLoop(void* arg){
+  Client* client = (Client*) arg;
+  client->server->serveClient(client->fd);
+  pthread_mutex_lock(&client->server->mutex_);
+  client->finished = true;
+  pthread_mutex_unlock(&client->server->mutex_);
+  return NULL;
+}
+
+//Join the client threads that are done, or all of them after shutting
+//their connections down. The fds are closed after the join, so a
+//thread never reads a reused fd
+void SamplingServer::reapClients(const bool& all){
+  list<Client*> done;
+  pthread_mutex_lock(&mutex_);
+  list<Client*>::iterator it = clients_.begin();
+  while(it != clients_.end()){
+    if(all || (*it)->finished){
+      if(all){
+        shutdown((*it)->fd, SHUT_RDWR);
+      }
+      done.push_back(*it);
+      it = clients_.erase(it);
+    }
+    else{
+      it++;
+    }
+  }
+  pthread_mutex_unlock(&mutex_);
+
+  for(it = done.begin(); it != done.end(); it++){
+    pthread_join((*it)->thread, NULL);
+    close((*it)->fd);
+    delete *it;
+  }
+}
+
+//Read requests from one connection until it is closed
+void SamplingServer::serveClient(int fd){
+  Job job;
+  pthread_cond_init(&job.cond, NULL);
+
+  while(readFully(fd, &job.req, sizeof(job.req))){
+    memset(&job.reply, 0, sizeof(job.reply));
+    job.reply.magic = SAMPLE_REPLY_MAGIC;
+    job.res.clear();
+    job.done = false;
+
+    const SampleRequest& req = job.req;
+    if(req.magic != SAMPLE_REQUEST_MAGIC ||
+       req.version != SAMPLE_PROTOCOL_VERSION ||
+       req.masksize > MAXMASKSIZE){
+      job.reply.status = SAMPLE_BAD_REQUEST;
+      writeFully(fd, &job.reply, sizeof(job.reply));
+      break; //cannot resync the stream
+    }
+
+    job.mask.resize(req.masksize);
+    if(req.masksize > 0 && !readFully(fd, &job.mask[0], req.masksize)){
+      break;
+    }
+
+    //computeN overflows for tiny radii, so it's bounded through computeR.
+    //The shaders don't read the importance map yet (impTex is unused), a
+    //mask is refused rather than decoded and ignored
+    if(req.masksize > 0 ||
+       req.width == 0 || req.height == 0 ||
+       req.width > MAXDIM || req.height > MAXDIM ||
+       !(req.radius > 0.0f && req.radius < 1.0f) ||
+       req.radius < computeR(req.width*(size_t)req.height) ||
+       req.ndarts > req.width*(size_t)req.height){
+      job.reply.status = SAMPLE_BAD_REQUEST;
+    }
+    else if(!submit(&job)){
+      job.reply.status = SAMPLE_BUSY;
+    }
+    else{ //wait for the GL thread
+      pthread_mutex_lock(&mutex_);
+      while(!job.done){
+        pthread_cond_wait(&job.cond, &mutex_);
+      }
+      pthread_mutex_unlock(&mutex_);
+    }
+
+    if(!writeFully(fd, &job.reply, sizeof(job.reply))) break;
+    if(job.reply.npts > 0 &&
+       !writeFully(fd, &job.res[0], job.reply.npts*2*sizeof(GLfloat))){
+      break;
+    }
+  }
+
+  pthread_cond_destroy(&job.cond);
+}
+
+//Queue a job, returns false if the queue is full
+bool SamplingServer::submit(Job* job){
+  pthread_mutex_lock(&mutex_);
+  bool accepted = !stop_ && queue_.size() < maxqueue_;
+  if(accepted){
+    queue_.push_back(job);
+    pthread_cond_signal(&cond_);
+  }
+  pthread_mutex_unlock(&mutex_);
+  return accepted;
+}
+
+void SamplingServer::run(){
+  while(!stop_){
+    pthread_mutex_lock(&mutex_);
+    while(queue_.empty() && !stop_){
+      //wake up periodically to notice stop() from a signal handler
+      timeval now;
+      gettimeofday(&now, NULL);
+      timespec timeout;
+      timeout.tv_sec = now.tv_sec;
+      timeout.tv_nsec = now.tv_usec*1000 + 100000000;
+      if(timeout.tv_nsec >= 1000000000){
+        timeout.tv_sec++;
+        timeout.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&cond_, &mutex_, &timeout);
+    }
+    if(stop_){
+      pthread_mutex_unlock(&mutex_);
+      break;
+    }
+    Job* job = queue_.front();
+    queue_.pop_front();
+    pthread_mutex_unlock(&mutex_);
+
+    process(job); //the GL work runs outside the lock
+
+    pthread_mutex_lock(&mutex_);
+    job->done = true;
+    pthread_cond_signal(&job->cond);
+    pthread_mutex_unlock(&mutex_);
+  }
+}
+
+void SamplingServer::process(Job* job){
+  const SampleRequest& req = job->req;
+  size_t nd = req.ndarts;
+  if(nd == 0){ //at least one dart for a radius that fits a single point
+    nd = max(computeN(req.radius)/2, (size_t)1);
+  }
+
+  PoissonDiskSampler* oglr = acquireSampler(req.width, req.height,
+                                            nd, req.radius);
+  oglr->unloadImportanceMap();
+
+  oglr->setSeed(req.seed);
+  oglr->reset();
+  size_t itr = oglr->sample();
+  oglr->downloadResults(job->res);
+
+  job->reply.status = SAMPLE_OK;
+  job->reply.iterations = itr;
+  job->reply.npts = job->res.size()/2;
+
+  if(verify_){
+    SampleVerification v;
+    verifySamples(job->res, req.radius, 0, v);
+    fprintf(stderr, "verify %ux%u r=%g seed=%u npts=%lu mindist=%f "
+            "closepairs=%lu voids=%lu coverage=%.8f\n", req.width,
+            req.height, req.radius, req.seed, v.npts, v.mindist,
+            v.closepairs, v.voids, v.coverage);
+  }
+}
+
+//Return a warm sampler for the parameters, initializing it if needed
+PoissonDiskSampler* SamplingServer::acquireSampler(const size_t& w,
+                                                   const size_t& h,
+                                                   const size_t& nd,
+                                                   const float& r){
+  list<PoissonDiskSampler*>::iterator it;
+  for(it = samplers_.begin(); it != samplers_.end(); it++){
+    PoissonDiskSampler* s = *it;
+    if(s->width() == w && s->height() == h &&
+       s->ndarts() == nd && s->radius() == r){
+      samplers_.splice(samplers_.begin(), samplers_, it);
+      return s;
+    }
+  }
+
+  //evict the least recently used sampler first to free its memory
+  if(samplers_.size() >= maxsamplers_){
+    delete samplers_.back();
+    samplers_.pop_back();
+  }
+
+  PoissonDiskSampler* s = new PoissonDiskSampler(w,h,nd,r);
+  s->init();
+  samplers_.push_front(s);
+  return s;
+}
@@ -0,0 +1,82 @@
+#ifndef __SAMPLINGSERVER__
+#define __SAMPLINGSERVER__
+
+#include <GL/glew.h>
+#include <pthread.h>
+#include <signal.h>
+
+#include <vector>
+#include <deque>
+#include <list>
+#include <string>
+using namespace std;
+
+#include "SamplingProtocol.hpp"
+
+class PoissonDiskSampler;
+
+// Long running sampling service on a unix domain socket. Every client
+// connection gets its own thread which parses the requests and queues
+// them; the samplers are driven by the thread calling run(), which
+// must own the OpenGL context. Initialized samplers are kept warm in
+// a small LRU cache keyed by (w, h, ndarts, r). With verify every
+// result is checked (SampleVerifier.hpp) and logged on stderr before it
+// is sent. The destructor shuts the connections down and joins
+// their threads.
+class SamplingServer{
+ public:
+  SamplingServer(const string& socketpath, const size_t& maxqueue,
+                 const size_t& maxsamplers, const bool& verify = false);
+  ~SamplingServer();
+
+  // Serve requests until stop() is called (GL thread only)
+  void run();
+  // Async-signal-safe
+  void stop(){stop_ = 1;}
+
+ private:
+  struct Job{
+    SampleRequest req;
+    std::vector<unsigned char> mask; // read to keep the stream in sync
+    std::vector<GLfloat> res;
+    SampleReply reply;
+    bool done;
+    pthread_cond_t cond;
+  };
+
+  string socketpath_;
+  const size_t maxqueue_;
+  const size_t maxsamplers_;
+  const bool verify_;
+  int listenfd_;
+  volatile sig_atomic_t stop_;
+
+  // A connection, its fd is closed once the thread is joined
+  struct Client{
+    SamplingServer* server;
+    int fd;
+    pthread_t thread;
+    bool finished;
+  };
+
+  pthread_t acceptthread_;
+  pthread_mutex_t mutex_;
+  pthread_cond_t cond_;
+  std::deque<Job*> queue_;
+  std::list<Client*> clients_;
+
+  // most recently used sampler first
+  std::list<PoissonDiskSampler*> samplers_;
+
+  static void* acceptLoop(void* self);
+  static void* clientLoop(void* arg);
+  void serveClient(int fd);
+  void reapClients(const bool& all);
+  bool submit(Job* job);
+
+  void process(Job* job);
+  PoissonDiskSampler* acquireSampler(const size_t& w, const size_t& h,
+                                     const size_t& nd, const float& r);
+};
+
+#endif
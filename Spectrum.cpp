@@ -0,0 +1,409 @@
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+
+#include "Spectrum.hpp"
+#include "Parallel.hpp"
+#include "lodepng.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define FFTOVERSAMPLE 16  //grid cells per period of the highest frequency
+                          //kept over two: binning moves 0.3% of the
+                          //averaged power into white noise, single
+                          //periodograms are noisier than direct sums
+
+namespace{
+
+// sum_j exp(-2 pi i (fx x_j + fy y_j)) for fy in [0,size/2] and fx in
+// [-size/2,size/2], one accumulator per thread. The other half of the
+// plane is the complex conjugate.
+class DirectWork : public ParallelWork{
+ public:
+  DirectWork(const vector<float>& pts, const size_t& size,
+             const size_t& threads)
+      :pts_(pts),size_(size),rows_(size/2+1),cols_((size+1+3) & ~3),
+       re_(threads),im_(threads){}
+
+  size_t rows() const {return rows_;}
+  size_t cols() const {return cols_;}
+
+  void range(const size_t& begin, const size_t& end, const size_t& thread){
+    vector<float>& re = re_[thread];
+    vector<float>& im = im_[thread];
+    if(re.empty()){
+      re.assign(rows_*cols_, 0.0f);
+      im.assign(rows_*cols_, 0.0f);
+    }
+    //columns past size+1 stay 0 and pad the rows to the SSE width
+    vector<float> xr(cols_, 0.0f), xi(cols_, 0.0f);
+    vector<float> yr(rows_), yi(rows_);
+    int half = size_/2;
+    for(size_t j=begin; j < end; j++){
+      exponentials(pts_[2*j], -half, size_+1, xr, xi);
+      exponentials(pts_[2*j+1], 0, rows_, yr, yi);
+      for(size_t fy=0; fy < rows_; fy++){
+        float* r = &re[fy*cols_];
+        float* i = &im[fy*cols_];
+#ifdef __SSE2__
+        __m128 ar = _mm_set1_ps(yr[fy]), ai = _mm_set1_ps(yi[fy]);
+        for(size_t c=0; c < cols_; c+=4){
+          __m128 br = _mm_loadu_ps(&xr[c]), bi = _mm_loadu_ps(&xi[c]);
+          __m128 vr = _mm_loadu_ps(r+c), vi = _mm_loadu_ps(i+c);
+          vr = _mm_add_ps(vr, _mm_sub_ps(_mm_mul_ps(ar, br),
+                                         _mm_mul_ps(ai, bi)));
+          vi = _mm_add_ps(vi, _mm_add_ps(_mm_mul_ps(ar, bi),
+                                         _mm_mul_ps(ai, br)));
+          _mm_storeu_ps(r+c, vr);
+          _mm_storeu_ps(i+c, vi);
+        }
+#else
+        float ar = yr[fy], ai = yi[fy];
+        for(size_t c=0; c < cols_; c++){
+          r[c] += ar*xr[c] - ai*xi[c];
+          i[c] += ar*xi[c] + ai*xr[c];
+        }
+#endif
+      }
+    }
+  }
+
+  // Sum of the threads' accumulators
+  void total(vector<double>& re, vector<double>& im) const{
+    re.assign(rows_*cols_, 0);
+    im.assign(rows_*cols_, 0);
+    for(size_t t=0; t < re_.size(); t++){
+      for(size_t k=0; k < re_[t].size(); k++){
+        re[k] += re_[t][k];
+        im[k] += im_[t][k];
+      }
+    }
+  }
+
+ private:
+  const vector<float>& pts_;
+  size_t size_;
+  size_t rows_,cols_;
+  vector<vector<float> > re_,im_;
+
+  // exp(-2 pi i f v) for f = first, first+1, ... by rotation, in
+  // double so that size steps keep float precision
+  static void exponentials(const float& v, const int& first, const size_t& n,
+                           vector<float>& re, vector<float>& im){
+    double a = -2*M_PI*v;
+    double sr = cos(a), si = sin(a);
+    double cr = cos(a*first), ci = sin(a*first);
+    for(size_t k=0; k < n; k++){
+      re[k] = cr;
+      im[k] = ci;
+      double t = cr*sr - ci*si;
+      ci = cr*si + ci*sr;
+      cr = t;
+    }
+  }
+};
+
+typedef complex<float> cfloat;
+
+// In place radix-2 FFT of n = 2^k values, tw[k] = exp(-2 pi i k/n)
+void fftInPlace(cfloat* a, const size_t& n, const vector<cfloat>& tw){
+  for(size_t i=1, j=0; i < n; i++){
+    size_t bit = n >> 1;
+    for(; j & bit; bit >>= 1) j ^= bit;
+    j ^= bit;
+    if(i < j) swap(a[i], a[j]);
+  }
+  for(size_t len=2; len <= n; len <<= 1){
+    size_t step = n/len, h = len/2;
+    for(size_t i=0; i < n; i+=len){
+      for(size_t k=0; k < h; k++){
+        const cfloat& w = tw[k*step];
+        cfloat u = a[i+k], b = a[i+k+h];
+        //written out, complex<float>::operator* checks for NaNs
+        cfloat v(b.real()*w.real()-b.imag()*w.imag(),
+                 b.real()*w.imag()+b.imag()*w.real());
+        a[i+k] = u+v;
+        a[i+k+h] = u-v;
+      }
+    }
+  }
+}
+
+// FFT of the rows of the binned samples, keeping the size columns of
+// the low frequencies (transposed, a column per size_ entries of m)
+class RowWork : public ParallelWork{
+ public:
+  RowWork(const vector<float>& pts, const vector<uint32_t>& rowstart,
+          const size_t& m, const size_t& size, const vector<cfloat>& tw,
+          vector<cfloat>& cols)
+      :pts_(pts),rowstart_(rowstart),m_(m),size_(size),tw_(tw),cols_(cols){}
+
+  void range(const size_t& begin, const size_t& end, const size_t&){
+    vector<cfloat> row(m_);
+    for(size_t y=begin; y < end; y++){
+      if(rowstart_[y] == rowstart_[y+1]){
+        continue; //empty rows transform to 0
+      }
+      fill(row.begin(), row.end(), cfloat(0, 0));
+      for(size_t k=rowstart_[y]; k < rowstart_[y+1]; k++){
+        row[min((size_t)(pts_[k]*m_), m_-1)] += 1;
+      }
+      fftInPlace(&row[0], m_, tw_);
+      for(size_t c=0; c < size_; c++){
+        size_t f = (c+m_-size_/2) % m_;
+        cols_[c*m_+y] = row[f];
+      }
+    }
+  }
+
+ private:
+  const vector<float>& pts_;      // x of the samples sorted by row
+  const vector<uint32_t>& rowstart_;
+  size_t m_,size_;
+  const vector<cfloat>& tw_;
+  vector<cfloat>& cols_;
+};
+
+class ColumnWork : public ParallelWork{
+ public:
+  ColumnWork(const size_t& m, const size_t& size, const vector<cfloat>& tw,
+             vector<cfloat>& cols, const double& n, vector<double>& p)
+      :m_(m),size_(size),tw_(tw),cols_(cols),n_(n),p_(p){}
+
+  void range(const size_t& begin, const size_t& end, const size_t&){
+    for(size_t c=begin; c < end; c++){
+      cfloat* col = &cols_[c*m_];
+      fftInPlace(col, m_, tw_);
+      for(size_t r=0; r < size_; r++){
+        size_t f = (r+m_-size_/2) % m_;
+        p_[r*size_+c] = norm(complex<double>(col[f]))/n_;
+      }
+    }
+  }
+
+ private:
+  size_t m_,size_;
+  const vector<cfloat>& tw_;
+  vector<cfloat>& cols_;
+  double n_;
+  vector<double>& p_;
+};
+
+}
+
+PowerSpectrum::PowerSpectrum(const size_t& size, const size_t& windows,
+                             const size_t& threads)
+    :size_(max(size & ~(size_t)1, (size_t)2)),windows_(max(windows,
+                                                          (size_t)1)),
+     threads_(parallelThreads(threads)),runs_(0),
+     sum_(size_*size_, 0){
+}
+
+void PowerSpectrum::clear(){
+  runs_ = 0;
+  fill(sum_.begin(), sum_.end(), 0);
+}
+
+void PowerSpectrum::add(const vector<float>& pts, const Method& method){
+  //the samples of every window, rescaled to the unit square
+  size_t k = windows_;
+  vector<vector<float> > cut(k*k);
+  for(size_t i=0; i+1 < pts.size(); i+=2){
+    float x = pts[i]*k, y = pts[i+1]*k;
+    size_t wx = min((size_t)max(x, 0.0f), k-1);
+    size_t wy = min((size_t)max(y, 0.0f), k-1);
+    cut[wy*k+wx].push_back(x-wx);
+    cut[wy*k+wx].push_back(y-wy);
+  }
+
+  vector<double> p(size_*size_);
+  for(size_t w=0; w < cut.size(); w++){
+    size_t n = cut[w].size()/2;
+    if(n < 2){
+      continue;
+    }
+    bool usedirect = (method == DIRECT);
+    if(method == AUTO){
+      //multiply-adds against butterflies of the non empty rows and the
+      //kept columns, an SSE multiply-add is the cheaper
+      size_t m = FFTOVERSAMPLE*size_;
+      double lg = log(m)/log(2.0);
+      double directcost = (double)n*(size_/2+1)*(size_+1);
+      double fftcost = ((double)min(n, m)+size_)*m*lg;
+      usedirect = directcost < 4*fftcost;
+    }
+    if(usedirect){
+      direct(cut[w], p);
+    }
+    else{
+      fft(cut[w], p);
+    }
+    for(size_t i=0; i < p.size(); i++){
+      sum_[i] += p[i];
+    }
+    runs_++;
+  }
+}
+
+void PowerSpectrum::direct(const vector<float>& pts, vector<double>& p) const{
+  size_t n = pts.size()/2;
+  DirectWork work(pts, size_, threads_);
+  runParallel(work, n, max(n/(4*threads_), (size_t)64), threads_);
+  vector<double> re,im;
+  work.total(re, im);
+
+  int half = size_/2;
+  for(int fy=-half; fy < half; fy++){
+    for(int fx=-half; fx < half; fx++){
+      //the conjugate of (-fx,-fy) below the fx axis
+      size_t row = abs(fy);
+      size_t col = (fy >= 0) ? fx+half : half-fx;
+      size_t k = row*work.cols()+col;
+      p[(fy+half)*size_+fx+half] = (re[k]*re[k]+im[k]*im[k])/n;
+    }
+  }
+}
+
+void PowerSpectrum::fft(const vector<float>& pts, vector<double>& p) const{
+  size_t n = pts.size()/2;
+  size_t m = 1;
+  while(m < FFTOVERSAMPLE*size_) m <<= 1;
+
+  vector<cfloat> tw(m/2);
+  for(size_t k=0; k < m/2; k++){
+    double a = -2*M_PI*k/m;
+    tw[k] = cfloat(cos(a), sin(a));
+  }
+
+  //x of the samples by grid row
+  vector<uint32_t> rowstart(m+1, 0);
+  for(size_t i=0; i < n; i++){
+    rowstart[min((size_t)(pts[2*i+1]*m), m-1)+1]++;
+  }
+  for(size_t y=0; y < m; y++){
+    rowstart[y+1] += rowstart[y];
+  }
+  vector<float> xs(n);
+  vector<uint32_t> cursor(rowstart.begin(), rowstart.end()-1);
+  for(size_t i=0; i < n; i++){
+    xs[cursor[min((size_t)(pts[2*i+1]*m), m-1)]++] = pts[2*i];
+  }
+
+  vector<cfloat> cols(size_*m, cfloat(0, 0));
+  RowWork rows(xs, rowstart, m, size_, tw, cols);
+  runParallel(rows, m, 16, threads_);
+  ColumnWork columns(m, size_, tw, cols, n, p);
+  runParallel(columns, size_, 1, threads_);
+}
+
+double PowerSpectrum::power(const int& fx, const int& fy) const{
+  int half = size_/2;
+  if(runs_ == 0 || fx < -half || fx >= half || fy < -half || fy >= half){
+    return 0;
+  }
+  return sum_[(fy+half)*size_+fx+half]/runs_;
+}
+
+void PowerSpectrum::radial(vector<double>& mean,
+                           vector<double>& anisotropy) const{
+  int half = size_/2;
+  vector<double> sum(half, 0), sum2(half, 0);
+  vector<size_t> count(half, 0);
+  for(int fy=-half; fy < half; fy++){
+    for(int fx=-half; fx < half; fx++){
+      size_t i = (size_t)(sqrt((double)fx*fx+fy*fy)+0.5);
+      if(i < (size_t)half){
+        double v = power(fx, fy);
+        sum[i] += v;
+        sum2[i] += v*v;
+        count[i]++;
+      }
+    }
+  }
+
+  mean.assign(half, 0);
+  anisotropy.assign(half, 0);
+  for(int i=0; i < half; i++){
+    if(count[i] == 0) continue;
+    mean[i] = sum[i]/count[i];
+    if(count[i] > 1 && mean[i] > 0){
+      double var = (sum2[i]-count[i]*mean[i]*mean[i])/(count[i]-1);
+      anisotropy[i] = 10*log10(max(var, 1e-30)/(mean[i]*mean[i]));
+    }
+  }
+}
+
+SpectralQuality PowerSpectrum::quality(const float& r) const{
+  SpectralQuality q;
+  vector<double> mean,anisotropy;
+  radial(mean, anisotropy);
+  if(runs_ == 0 || mean.size() < 2){
+    return q;
+  }
+
+  q.runs = runs_;
+  size_t peak = 1;
+  for(size_t i=2; i < mean.size(); i++){
+    if(mean[i] > mean[peak]) peak = i;
+  }
+  q.peakfreq = (double)peak*windows_*r;
+  q.peak = mean[peak];
+
+  size_t nlow = 0;
+  for(size_t i=1; 2*i < peak; i++){
+    q.lowpower += mean[i];
+    nlow++;
+  }
+  if(nlow > 0) q.lowpower /= nlow;
+
+  for(size_t i=peak; i < mean.size(); i++){
+    q.anisotropy += anisotropy[i];
+  }
+  q.anisotropy /= mean.size()-peak;
+  return q;
+}
+
+bool PowerSpectrum::savePeriodogram(const string& filename) const{
+  int half = size_/2;
+  vector<unsigned char> img(size_*size_);
+  for(int fy=-half; fy < half; fy++){
+    for(int fx=-half; fx < half; fx++){
+      double v = min(power(fx, fy)/2, 1.0);
+      img[(half-1-fy)*size_+fx+half] = (unsigned char)(255*v+0.5);
+    }
+  }
+  unsigned error = lodepng::encode(filename, img, size_, size_, LCT_GREY, 8);
+  if(error){
+    fprintf(stderr, "%s: %s\n", filename.c_str(), lodepng_error_text(error));
+  }
+  return error == 0;
+}
+
+bool PowerSpectrum::saveRadial(const string& filename, const float& r) const{
+  FILE* f = fopen(filename.c_str(), "w");
+  if(f == NULL){
+    perror(filename.c_str());
+    return false;
+  }
+  vector<double> mean,anisotropy;
+  radial(mean, anisotropy);
+  fprintf(f, "#runs %lu windows %lu\n#f\tf*r\tmean\tanisotropy_db\n",
+          runs_, windows_);
+  for(size_t i=1; i < mean.size(); i++){
+    fprintf(f, "%lu\t%f\t%f\t%f\n", i*windows_, (double)i*windows_*r,
+            mean[i], anisotropy[i]);
+  }
+  return fclose(f) == 0;
+}
+
+size_t PowerSpectrum::windowsFor(const size_t& size, const float& r){
+  //the principal frequency 0.9/r at size/4 in a window
+  double k = 3.6/(size*r);
+  return (k > 1) ? (size_t)k : 1;
+}
@@ -0,0 +1,77 @@
+#ifndef __SPECTRUM__
+#define __SPECTRUM__
+
+#include <vector>
+#include <string>
+using namespace std;
+
+// Summary of the averaged periodogram of sample sets with radius r
+struct SpectralQuality{
+  size_t runs;          // periodograms averaged, 0 if none
+  double peakfreq;      // of the highest annulus, times r
+  double peak;          // its mean power
+  double lowpower;      // mean power below half the peak frequency
+  double anisotropy;    // mean anisotropy (dB) from the peak frequency on
+
+  SpectralQuality():runs(0),peakfreq(0),peak(0),lowpower(0),anisotropy(0){}
+};
+
+// Periodogram P(f) = |sum_j exp(-2 pi i f.x_j)|^2 / n of point sets in
+// the unit square, at the integer frequencies f in [-size/2,size/2)^2,
+// averaged over every set added. White noise has P = 1, blue noise is
+// low below its principal frequency (about 0.9/r for a maximal set).
+//
+// Sets can be cut in windows x windows square windows, each rescaled
+// to the unit square and averaged as a set of its own: a frequency f of
+// a window is f*windows cycles over the whole set. windowsFor() puts
+// the principal frequency of radius r around a quarter of size.
+//
+// Sparse windows are summed directly, a row of exponentials times a
+// column per sample (SSE2, the conjugate half is mirrored). Dense ones
+// are binned on a 16*size grid and go through a 2D FFT that only keeps
+// the size x size low frequencies. Both are split over threads.
+class PowerSpectrum{
+ public:
+  enum Method{AUTO, DIRECT, FFT};
+
+  PowerSpectrum(const size_t& size = 128, const size_t& windows = 1,
+                const size_t& threads = 0);
+
+  // Add the periodograms of the windows of interleaved (x,y) points,
+  // windows with less than two samples are skipped
+  void add(const vector<float>& pts, const Method& method = AUTO);
+  void clear();
+
+  size_t size() const {return size_;}
+  size_t windows() const {return windows_;}
+  size_t runs() const {return runs_;}   // periodograms averaged
+
+  // Mean power at frequency (fx,fy)
+  double power(const int& fx, const int& fy) const;
+
+  // Annuli of width 1 around the origin, indexed by radius from 0 to
+  // size/2-1 (0 is the DC term alone): mean power and anisotropy in dB
+  // (variance over squared mean, Ulichney)
+  void radial(vector<double>& mean, vector<double>& anisotropy) const;
+  SpectralQuality quality(const float& r) const;
+
+  // Grey PNG of the periodogram, DC at the center, white from P = 2
+  bool savePeriodogram(const string& filename) const;
+  // Text table: frequency (cycles over the set), frequency times r,
+  // mean power, anisotropy (dB)
+  bool saveRadial(const string& filename, const float& r) const;
+
+  static size_t windowsFor(const size_t& size, const float& r);
+
+ private:
+  size_t size_;
+  size_t windows_;
+  size_t threads_;
+  size_t runs_;
+  vector<double> sum_;  // size*size, row fy+size/2, column fx+size/2
+
+  void direct(const vector<float>& pts, vector<double>& p) const;
+  void fft(const vector<float>& pts, vector<double>& p) const;
+};
+
+#endif
@@ -0,0 +1,69 @@
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include "TileStats.hpp"
+#include "lodepng.h"
+
+#define TILESTATS_VERSION 1
+#define TILESTATS_FIELDS 5
+
+const uint32_t TileStats::NOT_COVERED;
+
+bool saveTileStats(const string& filename, const TileStats& stats){
+  FILE* f = fopen(filename.c_str(), "wb");
+  if(f == NULL){
+    perror(filename.c_str());
+    return false;
+  }
+
+  uint32_t header[8] = {0, TILESTATS_VERSION, (uint32_t)stats.tilesize,
+                        (uint32_t)stats.tilesx, (uint32_t)stats.tilesy,
+                        (uint32_t)stats.iterations, TILESTATS_FIELDS, 0};
+  memcpy(&header[0], "PPTS", 4);
+  const vector<uint32_t>* fields[TILESTATS_FIELDS] = {
+    &stats.thrown, &stats.throwrejected, &stats.conflictrejected,
+    &stats.accepted, &stats.covered};
+
+  bool ok = fwrite(header, sizeof(header), 1, f) == 1;
+  for(size_t i=0; ok && i < TILESTATS_FIELDS; i++){
+    ok = fields[i]->size() == stats.size() &&
+        fwrite(&(*fields[i])[0], sizeof(uint32_t), stats.size(), f)
+        == stats.size();
+  }
+  return (fclose(f) == 0) && ok;
+}
+
+bool saveTileHeatmap(const string& filename, const TileStats& stats){
+  size_t n = stats.size();
+  if(n == 0){
+    return false;
+  }
+  uint32_t maxthrown = *max_element(stats.thrown.begin(),
+                                    stats.thrown.end());
+  size_t iterations = max(stats.iterations, (size_t)1);
+
+  vector<unsigned char> img(n*4);
+  for(size_t i=0; i < n; i++){
+    uint32_t thrown = stats.thrown[i];
+    double wasted = thrown ? 1.0-(double)stats.accepted[i]/thrown : 0;
+    if(stats.covered[i] == TileStats::NOT_COVERED){
+      img[i*4] = img[i*4+1] = img[i*4+2] = 255;
+    }
+    else{ //blue stops at 254, a covered tile is never white
+      img[i*4] = (unsigned char)(255*wasted);
+      img[i*4+1] = maxthrown ? (unsigned char)(255.0*thrown/maxthrown) : 0;
+      img[i*4+2] = (unsigned char)(254.0*min((size_t)stats.covered[i],
+                                             iterations)/iterations);
+    }
+    img[i*4+3] = 255;
+  }
+
+  unsigned error = lodepng::encode(filename, img, stats.tilesx,
+                                   stats.tilesy);
+  if(error){
+    fprintf(stderr, "%s: %s\n", filename.c_str(), lodepng_error_text(error));
+  }
+  return error == 0;
+}
@@ -0,0 +1,44 @@
+#ifndef __TILESTATS__
+#define __TILESTATS__
+
+#include <stdint.h>
+
+#include <vector>
+#include <string>
+using namespace std;
+
+// Where the darts of a sampling run went, per square tile of the
+// coverage grid. Darts are thrown, rejected in the throw pass (they fell
+// on a covered pixel, only without the empty list), rejected in the
+// conflict pass (they lost the depth test to a lower id dart) or
+// accepted. covered is the iteration at which the tile ran out of
+// empty pixels, NOT_COVERED if it never did.
+struct TileStats{
+  static const uint32_t NOT_COVERED = 0xffffffff;
+
+  size_t tilesize;
+  size_t tilesx,tilesy;
+  size_t iterations;
+
+  vector<uint32_t> thrown;
+  vector<uint32_t> throwrejected;
+  vector<uint32_t> conflictrejected;
+  vector<uint32_t> accepted;
+  vector<uint32_t> covered;
+
+  size_t size() const {return tilesx*tilesy;}
+};
+
+// Binary grid: a header of eight uint32 (magic "PPTS", version,
+// tilesize, tilesx, tilesy, iterations, number of fields, 0) followed
+// by the fields in declaration order, tilesx*tilesy uint32 each, rows
+// from y=0
+bool saveTileStats(const string& filename, const TileStats& stats);
+
+// Quick look PNG, one pixel per tile: red is the fraction of the darts
+// wasted, green the darts thrown (relative to the busiest tile), blue
+// the iteration the tile was covered, up to 254. A tile that was never
+// covered is white
+bool saveTileHeatmap(const string& filename, const TileStats& stats);
+
+#endif
@@ -23,6 +23,8 @@ class Timer{
 
 #else //*nix Timer
 
+#include <time.h>
+
 class Timer{
  private:
   struct timespec start_, stop_;
@@ -0,0 +1,96 @@
+
+#include <cstdio>
+
+#include "Trace.hpp"
+
+TraceWriter::TraceWriter(){
+  clock_.start();
+}
+
+double TraceWriter::now(){
+  return clock_.stop();
+}
+
+void TraceWriter::complete(const string& name, const double& start,
+                           const double& dur, const Args& args,
+                           const int& tid){
+  Event e;
+  e.name = name;
+  e.ph = 'X';
+  e.ts = start;
+  e.dur = dur;
+  e.tid = tid;
+  e.args = args;
+  events_.push_back(e);
+}
+
+void TraceWriter::counter(const string& name, const double& ts,
+                          const Args& values){
+  Event e;
+  e.name = name;
+  e.ph = 'C';
+  e.ts = ts;
+  e.dur = 0;
+  e.tid = 0;
+  e.args = values;
+  events_.push_back(e);
+}
+
+void TraceWriter::threadName(const int& tid, const string& name){
+  Event e;
+  e.name = "thread_name";
+  e.ph = 'M';
+  e.ts = 0;
+  e.dur = 0;
+  e.tid = tid;
+  events_.push_back(e);
+  //the metadata value is a string, kept out of the numeric args
+  events_.back().args.push_back(make_pair(name, 0.0));
+}
+
+static void writeEscaped(FILE* f, const string& s){
+  fputc('"', f);
+  for(size_t i=0; i < s.size(); i++){
+    if(s[i] == '"' || s[i] == '\\') fputc('\\', f);
+    fputc(s[i], f);
+  }
+  fputc('"', f);
+}
+
+bool TraceWriter::save(const string& filename) const{
+  FILE* f = fopen(filename.c_str(), "w");
+  if(f == NULL){
+    perror(filename.c_str());
+    return false;
+  }
+
+  //timestamps are in microseconds
+  fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  for(size_t i=0; i < events_.size(); i++){
+    const Event& e = events_[i];
+    fprintf(f, "{\"name\":");
+    writeEscaped(f, e.name);
+    fprintf(f, ",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f",
+            e.ph, e.tid, e.ts*1e6);
+    if(e.ph == 'X'){
+      fprintf(f, ",\"dur\":%.3f", e.dur*1e6);
+    }
+    if(e.ph == 'M'){
+      fprintf(f, ",\"args\":{\"name\":");
+      writeEscaped(f, e.args.empty() ? string() : e.args[0].first);
+      fprintf(f, "}");
+    }
+    else if(!e.args.empty()){
+      fprintf(f, ",\"args\":{");
+      for(size_t j=0; j < e.args.size(); j++){
+        if(j > 0) fputc(',', f);
+        writeEscaped(f, e.args[j].first);
+        fprintf(f, ":%.17g", e.args[j].second);
+      }
+      fprintf(f, "}");
+    }
+    fprintf(f, "}%s\n", (i+1 < events_.size()) ? "," : "");
+  }
+  fprintf(f, "]}\n");
+  return fclose(f) == 0;
+}
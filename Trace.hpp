@@ -0,0 +1,45 @@
+#ifndef __TRACE__
+#define __TRACE__
+
+#include <vector>
+#include <string>
+using namespace std;
+
+#include "Timer.hpp"
+
+// Collects duration and counter events and saves them in the Chrome
+// trace event JSON format, which Perfetto and chrome://tracing open.
+// Times are seconds since the construction of the writer.
+class TraceWriter{
+ public:
+  typedef vector<pair<string,double> > Args;
+
+  TraceWriter();
+
+  // Seconds since construction
+  double now();
+
+  // A complete event of duration dur starting at start, on track tid
+  void complete(const string& name, const double& start, const double& dur,
+                const Args& args=Args(), const int& tid=1);
+  // Counter values at time ts, one counter track per name
+  void counter(const string& name, const double& ts, const Args& values);
+  // Name a track
+  void threadName(const int& tid, const string& name);
+
+  bool save(const string& filename) const;
+  size_t size() const {return events_.size();}
+
+ private:
+  struct Event{
+    string name;
+    char ph;
+    double ts,dur;
+    int tid;
+    Args args;
+  };
+  vector<Event> events_;
+  Timer clock_;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+#include "SampleCodec.hpp"
+#include "SampleFile.hpp"
+
+// Round trip of the Morton delta codec, SIMD against scalar decoding,
+// on dense sets (1-2 byte deltas) and sparse ones (3-4 byte deltas,
+// every control byte up to 0xff). Exits 1 on a mismatch.
+
+static uint32_t random32(){
+  return ((uint32_t)(rand() & 0xffff) << 16) | (rand() & 0xffff);
+}
+
+//n sorted codes, deltas below maxdelta
+static void makeCodes(const size_t& n, const uint32_t& maxdelta,
+                      vector<uint32_t>& codes){
+  codes.resize(n);
+  for(size_t i=0; i < n; i++){
+    codes[i] = random32() % maxdelta;
+  }
+  for(size_t i=1; i < n; i++){
+    codes[i] += codes[i-1];
+  }
+}
+
+static size_t checkRoundTrip(const vector<uint32_t>& codes,
+                             const uint32_t& base, const bool& simd){
+  setSampleCodecSIMD(simd);
+  size_t n = codes.size(), errors = 0;
+  vector<uint8_t> enc(maxEncodedSize(n)+1);
+  size_t size = encodeMortonDeltas(n ? &codes[0] : NULL, n, base, &enc[0]);
+  const uint8_t* end = &enc[0]+size;
+
+  vector<uint32_t> dec(n+4);
+  if(decodeMortonDeltas(&enc[0], end, n, base, &dec[0]) != size){
+    errors++;
+  }
+  vector<uint16_t> xy(2*n+8);
+  if(decodeSamples(&enc[0], end, n, base, &xy[0]) != size){
+    errors++;
+  }
+  for(size_t i=0; i < n; i++){
+    uint16_t x, y;
+    mortonDecode(codes[i], x, y);
+    errors += dec[i] != codes[i];
+    errors += xy[2*i] != x || xy[2*i+1] != y;
+  }
+
+  //a truncated stream fails instead of reading past its end
+  if(n > 0 && decodeMortonDeltas(&enc[0], end-1, n, base, &dec[0]) != 0){
+    errors++;
+  }
+  return errors;
+}
+
+int main(){
+  srand(12345);
+  const uint32_t maxdeltas[4] = {1u<<8, 1u<<16, 1u<<24, 0xffffffffu};
+  size_t errors = 0, runs = 0;
+  for(size_t k=0; k < 4; k++){
+    for(size_t n=0; n < 200; n++){
+      vector<uint32_t> codes;
+      //spread the whole set over the code space, so the deltas of the
+      //sparse ones take 4 bytes
+      makeCodes(n, n ? min(maxdeltas[k], 0xffffffffu/(uint32_t)n) :
+                maxdeltas[k], codes);
+      errors += checkRoundTrip(codes, 0, true);
+      errors += checkRoundTrip(codes, 0, false);
+      runs += 2;
+    }
+  }
+  setSampleCodecSIMD(true);
+  printf("codec round trip: %lu errors in %lu runs\n",
+         (unsigned long)errors, (unsigned long)runs);
+  return errors == 0 ? 0 : 1;
+}
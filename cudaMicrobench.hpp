@@ -0,0 +1,24 @@
+#ifndef __CUDAMICROBENCH__
+#define __CUDAMICROBENCH__
+
+#include <cstddef>
+
+// The kernels of cudaThrustOGL on fixed device inputs, without the GL
+// interop. Both return the seconds of one run averaged over reps,
+// timed with cuda events.
+
+// random_uniform drawing ndarts darts from an empty list of listsize
+// pixels of a w x h grid (listsize 0: the first iteration, no list)
+double benchDartGeneration(const size_t& w, const size_t& h,
+                           const size_t& ndarts, const size_t& listsize,
+                           const size_t& reps);
+
+// Empty pixel compaction of a w x h coverage map in which one pixel
+// out of stride is empty: the copy_if of the first iteration over all
+// pixels, or the remove_if of the later ones over a list holding twice
+// the empty pixels. kept returns the size of the compacted list.
+double benchCompaction(const size_t& w, const size_t& h,
+                       const size_t& stride, const bool& first,
+                       const size_t& reps, size_t& kept);
+
+#endif
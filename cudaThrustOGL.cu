@@ -4,11 +4,18 @@
 #include <thrust/host_vector.h>
 #include <thrust/remove.h>
 #include <thrust/copy.h>
+#include <thrust/count.h>
+#include <thrust/reduce.h>
+#include <thrust/sequence.h>
 #include <thrust/random.h>
 #include <thrust/unique.h>
 #include <thrust/iterator/counting_iterator.h>
 
 #include <cassert>
+#include <algorithm>
+
+#include "Probe.hpp"
+#include "cudaMicrobench.hpp"
 
 typedef unsigned int uint;
 typedef GLubyte mask_t;
@@ -17,9 +24,18 @@ typedef GLubyte mask_t;
 texture<uchar1, cudaTextureType2D, cudaReadModeElementType> cudaTex;
 __constant__  GLuint texwidth;
 
+bool cudaThrustOGL::device_ready_ = false;
+
 cudaThrustOGL::cudaThrustOGL(){
-  err_=cudaDeviceReset();
-  err_=cudaGLSetGLDevice(0);
+  err_=cudaSuccess;
+  emptylist_=true;
+  tilestats_=NULL;
+  tilesize_=tilesx_=tilesy_=0;
+  if(!device_ready_){
+    err_=cudaDeviceReset();
+    err_=cudaGLSetGLDevice(0);
+    device_ready_ = true;
+  }
   err_=cudaSetDevice(0);
   assert(err_==cudaSuccess);
 }
@@ -58,6 +74,170 @@ void cudaThrustOGL::reset(){
   rem_darts_ = width_*height_; 
   iter_=0;
   rngoffset_=0; //keep using the random numbers
+
+  if(tilestats_ != NULL){ //counters to 0, no tile covered
+    size_t ntiles = tilesx_*tilesy_;
+    err_=cudaMemset(tilestats_, 0, TILE_COVERED*ntiles*sizeof(GLuint));
+    err_=cudaMemset(tilestats_+TILE_COVERED*ntiles, 0xff,
+                    ntiles*sizeof(GLuint));
+  }
+}
+
+//Device side view of the per-tile counters
+struct TileCounters{
+  GLuint* stats;
+  GLuint tilesize,tilesx,ntiles;
+
+  __device__
+  GLuint tileOf(const GLuint& x, const GLuint& y) const{
+    return (y/tilesize)*tilesx + x/tilesize;
+  }
+  __device__
+  void add(const int& field, const GLuint& tile, const GLuint& n=1) const{
+    atomicAdd(&stats[field*ntiles+tile], n);
+  }
+};
+
+//Empty pixels per tile from the sorted empty list: the list is in
+//pixel order, so a thread adds up a run of entries and only flushes
+//when the tile changes
+#define EMPTY_CHUNK 32
+__global__ void countEmptyList(const GLuint* list, const size_t n,
+                               const GLuint w, const TileCounters tc){
+  size_t begin = ((size_t)blockIdx.x*blockDim.x+threadIdx.x)*EMPTY_CHUNK;
+  size_t end = (begin+EMPTY_CHUNK < n) ? begin+EMPTY_CHUNK : n;
+  GLuint tile = 0xffffffff, count = 0;
+  for(size_t i=begin; i < end; i++){
+    GLuint t = tc.tileOf(list[i] % w, list[i] / w);
+    if(t != tile){
+      if(count > 0) tc.add(cudaThrustOGL::TILE_EMPTY, tile, count);
+      tile = t;
+      count = 0;
+    }
+    count++;
+  }
+  if(count > 0) tc.add(cudaThrustOGL::TILE_EMPTY, tile, count);
+}
+
+//Empty pixels per tile from the coverage texture, one block per tile
+__global__ void countEmptyCoverage(const GLuint w, const GLuint h,
+                                   const TileCounters tc){
+  __shared__ GLuint count;
+  if(threadIdx.x == 0) count = 0;
+  __syncthreads();
+
+  GLuint x0 = (blockIdx.x % tc.tilesx)*tc.tilesize;
+  GLuint y0 = (blockIdx.x / tc.tilesx)*tc.tilesize;
+  GLuint tw = min(tc.tilesize, w-x0), th = min(tc.tilesize, h-y0);
+  GLuint mine = 0;
+  for(GLuint i=threadIdx.x; i < tw*th; i+=blockDim.x){
+    mine += (tex2D(cudaTex, x0+i%tw, y0+i/tw).x == 0);
+  }
+  atomicAdd(&count, mine);
+  __syncthreads();
+  if(threadIdx.x == 0){
+    tc.stats[cudaThrustOGL::TILE_EMPTY*tc.ntiles+blockIdx.x] = count;
+  }
+}
+
+//Record the iteration at which the tiles ran out of empty pixels
+__global__ void markCovered(const GLuint iter, const TileCounters tc){
+  GLuint t = blockIdx.x*blockDim.x+threadIdx.x;
+  if(t < tc.ntiles && tc.stats[cudaThrustOGL::TILE_EMPTY*tc.ntiles+t] == 0 &&
+     tc.stats[cudaThrustOGL::TILE_COVERED*tc.ntiles+t] == 0xffffffff){
+    tc.stats[cudaThrustOGL::TILE_COVERED*tc.ntiles+t] = iter;
+  }
+}
+
+//Accepted darts per tile, read from the transform feedback buffer
+__global__ void countAcceptedDarts(const void* results, const size_t first,
+                                   const size_t n, const bool packed,
+                                   const GLuint w, const GLuint h,
+                                   const TileCounters tc){
+  size_t i = (size_t)blockIdx.x*blockDim.x+threadIdx.x;
+  if(i >= n) return;
+  float x,y;
+  if(packed){ //three vertices per dart
+    GLuint d = ((const GLuint*)results)[(first+i)*3];
+    x = (d & 0xffff)/65535.0f;
+    y = (d >> 16)/65535.0f;
+  }
+  else{
+    x = ((const float*)results)[(first+i)*6];
+    y = ((const float*)results)[(first+i)*6+1];
+  }
+  GLuint px = min((GLuint)(x*w), w-1), py = min((GLuint)(y*h), h-1);
+  tc.add(cudaThrustOGL::TILE_ACCEPTED, tc.tileOf(px, py));
+}
+
+TileCounters cudaThrustOGL::tileCounters() const{
+  TileCounters tc;
+  tc.stats = tilestats_;
+  tc.tilesize = tilesize_;
+  tc.tilesx = tilesx_;
+  tc.ntiles = tilesx_*tilesy_;
+  return tc;
+}
+
+void cudaThrustOGL::enableTileStats(const size_t& tilesize){
+  if(tilestats_ != NULL){
+    cudaFree(tilestats_);
+    tilestats_ = NULL;
+  }
+  tilesize_ = tilesize;
+  tilesx_ = tilesy_ = 0;
+  if(tilesize_ == 0){
+    return;
+  }
+  tilesx_ = (width_+tilesize_-1)/tilesize_;
+  tilesy_ = (height_+tilesize_-1)/tilesize_;
+  err_=cudaMalloc((void**)&tilestats_,
+                  TILE_NFIELDS*tilesx_*tilesy_*sizeof(GLuint));
+  assert(err_==cudaSuccess);
+  reset();
+}
+
+//Empty pixels per tile after the compaction (list) or from the
+//coverage texture (no list), then the newly covered tiles
+void cudaThrustOGL::countEmptyTiles(const GLuint* list, const size_t& n){
+  TileCounters tc = tileCounters();
+  if(list != NULL){
+    err_=cudaMemset(tilestats_+TILE_EMPTY*tc.ntiles, 0,
+                    tc.ntiles*sizeof(GLuint));
+    size_t threads = (n+EMPTY_CHUNK-1)/EMPTY_CHUNK;
+    if(threads > 0){
+      countEmptyList<<<(threads+255)/256, 256>>>(list, n, width_, tc);
+    }
+  }
+  else{
+    countEmptyCoverage<<<tc.ntiles, 256>>>(width_, height_, tc);
+  }
+  markCovered<<<(tc.ntiles+255)/256, 256>>>(iter_, tc);
+}
+
+void cudaThrustOGL::countAccepted(const size_t& first, const size_t& count,
+                                  const bool& packed){
+  if(tilestats_ == NULL || count == 0){
+    return;
+  }
+  void* results;
+  size_t bufsize;
+  err_=cudaGraphicsMapResources(1,&cuda_res_[3]);
+  err_=cudaGraphicsResourceGetMappedPointer(&results, &bufsize,
+                                            cuda_res_[3]);
+  countAcceptedDarts<<<(count+255)/256, 256>>>(results, first, count, packed,
+                                               width_, height_,
+                                               tileCounters());
+  err_=cudaGraphicsUnmapResources(1,&cuda_res_[3]);
+  assert(err_==cudaSuccess);
+}
+
+void cudaThrustOGL::downloadTileStats(std::vector<GLuint>& stats) const{
+  stats.resize(TILE_NFIELDS*tilesx_*tilesy_);
+  if(tilestats_ != NULL){
+    cudaMemcpy(&stats[0], tilestats_, stats.size()*sizeof(GLuint),
+               cudaMemcpyDeviceToHost);
+  }
 }
 
 //Operator structs for counting empty pixels
@@ -80,6 +260,7 @@ struct notEmpty{
 };
 
 size_t cudaThrustOGL::thrustCountEmptyPixels(){
+  PROBE_ZONE("thrustCountEmptyPixels");
   err_=cudaGraphicsMapResources(3,&cuda_res_[0]);
 
   //get the texture array
@@ -104,6 +285,27 @@ size_t cudaThrustOGL::thrustCountEmptyPixels(){
   //declare the newend of the emptylist
   thrust::device_ptr<GLuint> newend;
 
+  if(!emptylist_){ //only count, the darts are rejected on coverage
+    size_t count;
+    if(tilestats_ != NULL){ //the per-tile counts give the total
+      countEmptyTiles(NULL, 0);
+      thrust::device_ptr<GLuint> empty =
+          thrust::device_pointer_cast(tilestats_+TILE_EMPTY*tilesx_*tilesy_);
+      count = thrust::reduce(empty, empty+tilesx_*tilesy_, (size_t)0);
+    }
+    else{
+      count = thrust::count_if(thrust::make_counting_iterator<GLuint>(0),
+                               thrust::make_counting_iterator<GLuint>(
+                                   width_*height_), isEmpty());
+    }
+    err_=cudaUnbindTexture(cudaTex);
+    err_=cudaGraphicsUnmapResources(3,&cuda_res_[0]);
+    rem_darts_ = count;
+    iter_++;
+    assert(err_==cudaSuccess);
+    return rem_darts_;
+  }
+
   if(iter_==0){ // use counting itr to accelerate the first iteration
     newend = thrust::copy_if(thrust::make_counting_iterator<GLuint>(0),
                              thrust::make_counting_iterator<GLuint>(
@@ -115,6 +317,10 @@ size_t cudaThrustOGL::thrustCountEmptyPixels(){
   
   //cout << "after thrust " << dev_ptr[0] << " " << dev_ptr[1] << endl;
 
+  if(tilestats_ != NULL){
+    countEmptyTiles(emptylistbuf, newend-dev_ptr);
+  }
+
   err_=cudaUnbindTexture(cudaTex);
   err_=cudaGraphicsUnmapResources(3,&cuda_res_[0]);
 
@@ -129,8 +335,12 @@ size_t cudaThrustOGL::thrustCountEmptyPixels(){
 }
 
 void cudaThrustOGL::cudaCleanup(){
+  if(tilestats_ != NULL){
+    cudaFree(tilestats_);
+    tilestats_ = NULL;
+  }
   cudaGraphicsUnmapResources(3,&cuda_res_[0]);  
-  for(size_t i=0; i< 3; i++){
+  for(size_t i=0; i< 4; i++){
     cudaGraphicsUnregisterResource(cuda_res_[i]);
   }
   //cudaFree(drandvec);
@@ -149,6 +359,7 @@ size_t cudaThrustOGL::freeGPUMem(){
 
 
 void cudaThrustOGL::remDuplicateSamples(size_t dartCount){
+  PROBE_ZONE("remDuplicateSamples");
   unsigned int *buf;
   size_t bufSize;
   err_=cudaGraphicsMapResources(1,&cuda_res_[3]);
@@ -187,12 +398,22 @@ template <typename T> class random_uniform{
   
   //subpixel variables
   float sppixelw_,sprowarea_;
+
+  //mark the darts that fall on covered pixels (no empty list)
+  bool reject_;
+
+  //per-tile counts of the darts, off if stats is NULL
+  TileCounters tc_;
   
  public:
+  static const T REJECTED = 0xffffffff;
+
   // provide constructor to initialize the distribution:
   random_uniform(const size_t& w, const size_t& h, const T& umax,
-                 const T* dp, const size_t& o, const unsigned int& s)
-      :dist(),empty_ptr_(dp), offset_(o),umax_(umax),w_(w),h_(h){
+                 const T* dp, const size_t& o, const unsigned int& s,
+                 const bool& reject, const TileCounters& tc)
+      :dist(),empty_ptr_(dp), offset_(o),umax_(umax),w_(w),h_(h),
+       reject_(reject),tc_(tc){
     rng.seed(s);
 
     hscale_ = (USHRT_MAX*1.0f/h_);
@@ -216,6 +437,16 @@ template <typename T> class random_uniform{
       coord = empty_ptr_[coord]; //sample from the empty list
     }
 
+    bool rejected = reject_ && tex2D(cudaTex,coord % w_,coord / w_).x != 0;
+    if(tc_.stats != NULL){
+      GLuint tile = tc_.tileOf(coord % w_, coord / w_);
+      tc_.add(cudaThrustOGL::TILE_THROWN, tile);
+      if(rejected) tc_.add(cudaThrustOGL::TILE_THROWREJECTED, tile);
+    }
+    if(rejected){
+      return REJECTED; //skipped by the geometry shaders
+    }
+
     //pack the coordinates into ushorts
     GLushort x = (coord % w_)* wscale_;
     GLushort y = (coord / w_)* hscale_;
@@ -232,6 +463,7 @@ template <typename T> class random_uniform{
 
 //Generate some vertices
 void cudaThrustOGL::makeVertices(const size_t& ndarts){
+  PROBE_ZONE("makeVertices");
   err_=cudaGraphicsMapResources(3,&cuda_res_[0]);
    
   //get the dart buffer
@@ -252,14 +484,141 @@ void cudaThrustOGL::makeVertices(const size_t& ndarts){
     emptylistbuf=NULL; //do not use the emptylist lookup in iter 0
   }
 
-  //pick ndarts locations from the emptylist
-  thrust::transform(thrust::make_counting_iterator<GLuint>(0),
-                    thrust::make_counting_iterator<GLuint>(ndarts),
-                    dart_ptr,random_uniform<GLuint>(width_,height_,
-                                                    rem_darts_-1,
-                                                    emptylistbuf,
-                                                    rngoffset_,seed_));
+  if(!emptylist_){
+    //uniform over the domain, the covered pixels are read from the
+    //coverage texture
+    cudaArray* cuda_array;
+    err_=cudaGraphicsSubResourceGetMappedArray(&cuda_array,
+                                               cuda_res_[0],0,0);
+    err_=cudaBindTextureToArray(cudaTex, cuda_array);
+    thrust::transform(thrust::make_counting_iterator<GLuint>(0),
+                      thrust::make_counting_iterator<GLuint>(ndarts),
+                      dart_ptr,random_uniform<GLuint>(width_,height_,
+                                                      width_*height_-1,
+                                                      NULL,
+                                                      rngoffset_,seed_,
+                                                      iter_ > 0,
+                                                      tileCounters()));
+    err_=cudaUnbindTexture(cudaTex);
+  }
+  else{
+    //pick ndarts locations from the emptylist
+    thrust::transform(thrust::make_counting_iterator<GLuint>(0),
+                      thrust::make_counting_iterator<GLuint>(ndarts),
+                      dart_ptr,random_uniform<GLuint>(width_,height_,
+                                                      rem_darts_-1,
+                                                      emptylistbuf,
+                                                      rngoffset_,seed_,
+                                                      false,
+                                                      tileCounters()));
+  }
   rngoffset_+=ndarts;
   err_=cudaGraphicsUnmapResources(3,&cuda_res_[0]);
   assert(err_==cudaSuccess);
 }
+
+//Microbenchmarks, see cudaMicrobench.hpp
+
+double benchDartGeneration(const size_t& w, const size_t& h,
+                           const size_t& ndarts, const size_t& listsize,
+                           const size_t& reps){
+  //every k-th pixel is empty
+  thrust::device_vector<GLuint> list(std::max(listsize, (size_t)1));
+  size_t step = listsize ? std::max(w*h/listsize, (size_t)1) : 1;
+  thrust::sequence(list.begin(), list.end(), (GLuint)0, (GLuint)step);
+  thrust::device_vector<GLuint> darts(ndarts);
+
+  TileCounters tc;
+  tc.stats = NULL;
+  tc.tilesize = tc.tilesx = tc.ntiles = 0;
+  const GLuint* listptr = listsize ?
+      thrust::raw_pointer_cast(list.data()) : NULL;
+  GLuint umax = listsize ? listsize-1 : w*h-1;
+
+  cudaEvent_t start,stop;
+  cudaEventCreate(&start);
+  cudaEventCreate(&stop);
+  cudaEventRecord(start);
+  for(size_t i=0; i < reps; i++){
+    thrust::transform(thrust::make_counting_iterator<GLuint>(0),
+                      thrust::make_counting_iterator<GLuint>(ndarts),
+                      darts.begin(),
+                      random_uniform<GLuint>(w,h,umax,listptr,i*ndarts,
+                                             12345,false,tc));
+  }
+  cudaEventRecord(stop);
+  cudaEventSynchronize(stop);
+  float ms = 0;
+  cudaEventElapsedTime(&ms, start, stop);
+  cudaEventDestroy(start);
+  cudaEventDestroy(stop);
+  return ms*1e-3/reps;
+}
+
+//Coverage 0 every stride pixels, 1 elsewhere
+struct coveragePattern{
+  GLuint stride_;
+  coveragePattern(const GLuint& s):stride_(s){}
+  __host__ __device__
+  uchar1 operator()(const GLuint& i) const{
+    return make_uchar1((i % stride_ == 0) ? 0 : 1);
+  }
+};
+
+double benchCompaction(const size_t& w, const size_t& h,
+                       const size_t& stride, const bool& first,
+                       const size_t& reps, size_t& kept){
+  //fixed coverage map in a cuda array bound to cudaTex
+  thrust::device_vector<uchar1> coverage(w*h);
+  thrust::transform(thrust::make_counting_iterator<GLuint>(0),
+                    thrust::make_counting_iterator<GLuint>(w*h),
+                    coverage.begin(), coveragePattern(stride));
+  cudaChannelFormatDesc desc = cudaCreateChannelDesc<uchar1>();
+  cudaArray* array;
+  cudaMallocArray(&array, &desc, w, h);
+  cudaMemcpy2DToArray(array, 0, 0, thrust::raw_pointer_cast(coverage.data()),
+                      w*sizeof(uchar1), w*sizeof(uchar1), h,
+                      cudaMemcpyDeviceToDevice);
+  cudaBindTextureToArray(cudaTex, array);
+
+  //the remove_if input: the empty pixels and as many covered ones
+  size_t nempty = (w*h+stride-1)/stride;
+  thrust::device_vector<GLuint> input(first ? 1 : 2*nempty);
+  if(!first){
+    thrust::sequence(input.begin(), input.end(), (GLuint)0,
+                     (GLuint)std::max(stride/2, (size_t)1));
+  }
+  thrust::device_vector<GLuint> list(first ? w*h : input.size());
+
+  cudaEvent_t start,stop;
+  cudaEventCreate(&start);
+  cudaEventCreate(&stop);
+  float total = 0;
+  for(size_t i=0; i < reps; i++){
+    if(!first){ //remove_if works in place, restore its input untimed
+      thrust::copy(input.begin(), input.end(), list.begin());
+    }
+    cudaEventRecord(start);
+    thrust::device_vector<GLuint>::iterator end;
+    if(first){
+      end = thrust::copy_if(thrust::make_counting_iterator<GLuint>(0),
+                            thrust::make_counting_iterator<GLuint>(w*h),
+                            list.begin(), isEmpty());
+    }
+    else{
+      end = thrust::remove_if(list.begin(), list.end(), notEmpty());
+    }
+    cudaEventRecord(stop);
+    cudaEventSynchronize(stop);
+    float ms = 0;
+    cudaEventElapsedTime(&ms, start, stop);
+    total += ms;
+    kept = end-list.begin();
+  }
+  cudaEventDestroy(start);
+  cudaEventDestroy(stop);
+
+  cudaUnbindTexture(cudaTex);
+  cudaFreeArray(array);
+  return total*1e-3/reps;
+}
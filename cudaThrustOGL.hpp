@@ -7,6 +7,10 @@
 
 #include <cuda_gl_interop.h>
 
+#include <vector>
+
+struct TileCounters;
+
 class cudaThrustOGL{
  private:
   // 0: coverage texture
@@ -20,8 +24,19 @@ class cudaThrustOGL{
   size_t iter_;
   size_t rngoffset_;
   unsigned int seed_;
+  bool emptylist_; //compact the empty pixels, or reject covered darts
   cudaError_t err_;
 
+  //per-tile dart statistics, TILE_NFIELDS arrays of counters
+  GLuint* tilestats_;
+  size_t tilesize_,tilesx_,tilesy_;
+  TileCounters tileCounters() const;
+  void countEmptyTiles(const GLuint* list, const size_t& n);
+
+  //the device is reset only once per process so that several
+  //samplers can share it
+  static bool device_ready_;
+
  public:
   cudaThrustOGL();
   ~cudaThrustOGL(){cudaCleanup();};
@@ -32,6 +47,9 @@ class cudaThrustOGL{
 		const size_t& w, const size_t& h);
   void cudaCleanup();
   void reset();
+  void setSeed(const unsigned int& s){seed_ = s;}
+  unsigned int getSeed() const {return seed_;}
+  void setEmptyList(const bool& e){emptylist_ = e;}
 
   void makeVertices(const size_t& ndarts);
 
@@ -40,6 +58,23 @@ class cudaThrustOGL{
   size_t freeGPUMem();
 
   void remDuplicateSamples(size_t dartCount);
+
+  // Per-tile statistics of tilesize pixels wide tiles, 0 disables them.
+  // The covered field is the iteration the tile ran out of empty
+  // pixels, 0xffffffff while it has some.
+  enum TileField {TILE_THROWN, TILE_THROWREJECTED, TILE_ACCEPTED,
+                  TILE_EMPTY, TILE_COVERED, TILE_NFIELDS};
+  void enableTileStats(const size_t& tilesize);
+  bool tileStatsEnabled() const {return tilestats_ != NULL;}
+  size_t tilesX() const {return tilesx_;}
+  size_t tilesY() const {return tilesy_;}
+  size_t tileSize() const {return tilesize_;}
+  size_t iterations() const {return iter_;}
+  // Count the accepted darts [first,first+count) of the results buffer
+  void countAccepted(const size_t& first, const size_t& count,
+                     const bool& packed);
+  // TILE_NFIELDS arrays of tilesX()*tilesY() counters
+  void downloadTileStats(std::vector<GLuint>& stats) const;
 };
 
 #endif
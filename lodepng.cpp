@@ -32,12 +32,26 @@ Rename this file to lodepng.cpp to use it for C++, or to lodepng.c to use it for
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #ifdef LODEPNG_COMPILE_CPP
 #include <fstream>
 #endif /*LODEPNG_COMPILE_CPP*/
 
+/*SSE2 kernels for the PNG filters, part of every x86-64 target. Define LODEPNG_NO_SIMD to leave them out.*/
+#if defined(__SSE2__) && !defined(LODEPNG_NO_SIMD)
+#define LODEPNG_SSE2
+#include <emmintrin.h>
+#endif /*__SSE2__*/
+
+/*PCLMULQDQ CRC32 and SSSE3 and AVX2 Adler-32, compiled with GCC target attributes and picked at runtime for the
+processor, the rest of the file keeps the baseline instruction set*/
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(LODEPNG_NO_SIMD)
+#define LODEPNG_X86_DISPATCH
+#include <immintrin.h>
+#endif /*__x86_64__*/
+
 #define VERSION_STRING "20120623"
 
 /*
@@ -53,17 +67,62 @@ with the "LODEPNG_COMPILE_" #defines divide this up further in an intermixed way
 name, so that you can easily change them to others related to your platform in
 this one location if needed. Everything else in the code calls these.*/
 
+#if defined(LODEPNG_COMPILE_PNG) && defined(LODEPNG_COMPILE_DECODER)
+#define LODEPNG_ALLOCATOR
+#if defined(_MSC_VER)
+#define LODEPNG_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define LODEPNG_THREAD_LOCAL __thread
+#else
+#define LODEPNG_THREAD_LOCAL /*without thread local storage, only one thread may decode with an allocator*/
+#endif
+
+/*the allocator of the lodepng_decode_rows call running on this thread, 0 for malloc, realloc and free*/
+static LODEPNG_THREAD_LOCAL const LodePNGAllocator* call_allocator = 0;
+#endif /*defined(LODEPNG_COMPILE_PNG) && defined(LODEPNG_COMPILE_DECODER)*/
+
 static void* mymalloc(size_t size)
 {
+#ifdef LODEPNG_ALLOCATOR
+  if(call_allocator) return call_allocator->allocate(call_allocator->context, size);
+#endif /*LODEPNG_ALLOCATOR*/
   return malloc(size);
 }
 
 static void* myrealloc(void* ptr, size_t new_size)
 {
+#ifdef LODEPNG_ALLOCATOR
+  if(call_allocator) return call_allocator->reallocate(call_allocator->context, ptr, new_size);
+#endif /*LODEPNG_ALLOCATOR*/
   return realloc(ptr, new_size);
 }
 
 static void myfree(void* ptr)
+{
+#ifdef LODEPNG_ALLOCATOR
+  if(call_allocator)
+  {
+    call_allocator->deallocate(call_allocator->context, ptr);
+    return;
+  }
+#endif /*LODEPNG_ALLOCATOR*/
+  free(ptr);
+}
+
+/*The memory that outlives a call, what a LodePNGInfo or LodePNGColorMode keeps
+and the chunks given to the user, never goes to the allocator of the call.*/
+
+static void* heapmalloc(size_t size)
+{
+  return malloc(size);
+}
+
+static void* heaprealloc(void* ptr, size_t new_size)
+{
+  return realloc(ptr, new_size);
+}
+
+static void heapfree(void* ptr)
 {
   free(ptr);
 }
@@ -285,6 +344,24 @@ static void ucvector_init_buffer(ucvector* p, unsigned char* buffer, size_t size
 }
 #endif /*LODEPNG_COMPILE_ZLIB*/
 
+#ifdef LODEPNG_COMPILE_ENCODER
+/*
+Loops of the encoder over independent items: function is called for ranges of [0, n) of about chunk items, by
+the parallel_for of the settings if there is one, otherwise once for all of them on the calling thread.
+*/
+typedef void (*ParallelRange)(void* context, size_t begin, size_t end);
+
+static void parallelFor(const LodePNGCompressSettings* settings, ParallelRange function, void* context, size_t n,
+                        size_t chunk)
+{
+  if(settings->parallel_for && settings->threads != 1)
+  {
+    settings->parallel_for(function, context, n, chunk, settings->threads);
+  }
+  else function(context, 0, n);
+}
+#endif /*LODEPNG_COMPILE_ENCODER*/
+
 #ifdef LODEPNG_COMPILE_ENCODER
 /*returns 1 if success, 0 if failure ==> nothing done*/
 static unsigned ucvector_push_back(ucvector* p, unsigned char c)
@@ -303,7 +380,7 @@ static unsigned ucvector_push_back(ucvector* p, unsigned char c)
 /*returns 1 if success, 0 if failure ==> nothing done*/
 static unsigned string_resize(char** out, size_t size)
 {
-  char* data = (char*)myrealloc(*out, size + 1);
+  char* data = (char*)heaprealloc(*out, size + 1);
   if(data)
   {
     data[size] = 0; /*null termination char*/
@@ -322,7 +399,7 @@ static void string_init(char** out)
 /*free the above pair again*/
 static void string_cleanup(char** out)
 {
-  myfree(*out);
+  heapfree(*out);
   *out = NULL;
 }
 
@@ -364,6 +441,14 @@ static void lodepng_add32bitInt(ucvector* buffer, unsigned value)
 }
 #endif /*LODEPNG_COMPILE_ENCODER*/
 
+/*highest instruction set level of the checksums, see lodepng_checksum_simd*/
+static unsigned checksum_simd = 2;
+
+void lodepng_checksum_simd(unsigned level)
+{
+  checksum_simd = level;
+}
+
 /* ////////////////////////////////////////////////////////////////////////// */
 /* / File IO                                                                / */
 /* ////////////////////////////////////////////////////////////////////////// */
@@ -445,23 +530,67 @@ static void addBitsToStreamReversed(size_t* bitpointer, ucvector* bitstream, uns
 
 #ifdef LODEPNG_COMPILE_DECODER
 
-#define READBIT(bitpointer, bitstream) ((bitstream[bitpointer >> 3] >> (bitpointer & 0x7)) & (unsigned char)1)
+/*
+Bit reader of the inflator. Deflate packs bits lsb first, so a little endian word of the stream holds them in
+order: ensureBits loads the 64-bit word at the byte of bp and shifts out the bits of that byte already read,
+which leaves at least 57 bits in the buffer, enough for a length code, a distance code and their extra bits.
+Past the end of the data it reads zeros, bp then goes beyond bitsize, which the callers check.
+*/
+typedef struct BitReader
+{
+  const unsigned char* data;
+  size_t size; /*size of data in bytes*/
+  size_t bitsize; /*size of data in bits*/
+  size_t bp; /*position of the next bit*/
+  unsigned long long buffer; /*the bits from bp on*/
+} BitReader;
 
-static unsigned char readBitFromStream(size_t* bitpointer, const unsigned char* bitstream)
+static void BitReader_init(BitReader* reader, const unsigned char* data, size_t size)
 {
-  unsigned char result = (unsigned char)(READBIT(*bitpointer, bitstream));
-  (*bitpointer)++;
-  return result;
+  reader->data = data;
+  reader->size = size;
+  reader->bitsize = size * 8;
+  reader->bp = 0;
+  reader->buffer = 0;
 }
 
-static unsigned readBitsFromStream(size_t* bitpointer, const unsigned char* bitstream, size_t nbits)
+/*makes 57 bits available to peekBits, advanceBits and readBits*/
+static void ensureBits(BitReader* reader)
 {
-  unsigned result = 0, i;
-  for(i = 0; i < nbits; i++)
+  size_t start = reader->bp >> 3;
+  unsigned long long word = 0;
+  if(start + 8 <= reader->size)
   {
-    result += ((unsigned)READBIT(*bitpointer, bitstream)) << i;
-    (*bitpointer)++;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(&word, &reader->data[start], 8);
+#else /*little endian*/
+    unsigned i;
+    for(i = 0; i < 8; i++) word |= (unsigned long long)reader->data[start + i] << (8 * i);
+#endif /*little endian*/
+  }
+  else
+  {
+    size_t i;
+    for(i = 0; start + i < reader->size; i++) word |= (unsigned long long)reader->data[start + i] << (8 * i);
   }
+  reader->buffer = word >> (reader->bp & 7);
+}
+
+static unsigned peekBits(const BitReader* reader, unsigned nbits)
+{
+  return (unsigned)(reader->buffer & ((1ull << nbits) - 1u));
+}
+
+static void advanceBits(BitReader* reader, unsigned nbits)
+{
+  reader->buffer >>= nbits;
+  reader->bp += nbits;
+}
+
+static unsigned readBits(BitReader* reader, unsigned nbits)
+{
+  unsigned result = peekBits(reader, nbits);
+  advanceBits(reader, nbits);
   return result;
 }
 #endif /*LODEPNG_COMPILE_DECODER*/
@@ -511,7 +640,8 @@ Huffman tree struct, containing multiple representations of the tree
 */
 typedef struct HuffmanTree
 {
-  unsigned* tree2d;
+  unsigned char* table_len; /*decoder lookup table: length of the code at these bits, see HuffmanTree_makeTable*/
+  unsigned short* table_value; /*decoder lookup table: symbol, or start of the secondary table*/
   unsigned* tree1d;
   unsigned* lengths; /*the lengths of the codes of the 1d-tree*/
   unsigned maxbitlen; /*maximum number of bits a single code can get*/
@@ -533,78 +663,20 @@ static void HuffmanTree_draw(HuffmanTree* tree)
 
 static void HuffmanTree_init(HuffmanTree* tree)
 {
-  tree->tree2d = 0;
+  tree->table_len = 0;
+  tree->table_value = 0;
   tree->tree1d = 0;
   tree->lengths = 0;
 }
 
 static void HuffmanTree_cleanup(HuffmanTree* tree)
 {
-  myfree(tree->tree2d);
+  myfree(tree->table_len);
+  myfree(tree->table_value);
   myfree(tree->tree1d);
   myfree(tree->lengths);
 }
 
-/*the tree representation used by the decoder. return value is error*/
-static unsigned HuffmanTree_make2DTree(HuffmanTree* tree)
-{
-  unsigned nodefilled = 0; /*up to which node it is filled*/
-  unsigned treepos = 0; /*position in the tree (1 of the numcodes columns)*/
-  unsigned n, i;
-
-  tree->tree2d = (unsigned*)mymalloc(tree->numcodes * 2 * sizeof(unsigned));
-  if(!tree->tree2d) return 83; /*alloc fail*/
-
-  /*
-  convert tree1d[] to tree2d[][]. In the 2D array, a value of 32767 means
-  uninited, a value >= numcodes is an address to another bit, a value < numcodes
-  is a code. The 2 rows are the 2 possible bit values (0 or 1), there are as
-  many columns as codes - 1.
-  A good huffmann tree has N * 2 - 1 nodes, of which N - 1 are internal nodes.
-  Here, the internal nodes are stored (what their 0 and 1 option point to).
-  There is only memory for such good tree currently, if there are more nodes
-  (due to too long length codes), error 55 will happen
-  */
-  for(n = 0; n < tree->numcodes * 2; n++)
-  {
-    tree->tree2d[n] = 32767; /*32767 here means the tree2d isn't filled there yet*/
-  }
-
-  for(n = 0; n < tree->numcodes; n++) /*the codes*/
-  {
-    for(i = 0; i < tree->lengths[n]; i++) /*the bits for this code*/
-    {
-      unsigned char bit = (unsigned char)((tree->tree1d[n] >> (tree->lengths[n] - i - 1)) & 1);
-      if(treepos > tree->numcodes - 2) return 55; /*oversubscribed, see comment in lodepng_error_text*/
-      if(tree->tree2d[2 * treepos + bit] == 32767) /*not yet filled in*/
-      {
-        if(i + 1 == tree->lengths[n]) /*last bit*/
-        {
-          tree->tree2d[2 * treepos + bit] = n; /*put the current code in it*/
-          treepos = 0;
-        }
-        else
-        {
-          /*put address of the next step in here, first that address has to be found of course
-          (it's just nodefilled + 1)...*/
-          nodefilled++;
-          /*addresses encoded with numcodes added to it*/
-          tree->tree2d[2 * treepos + bit] = nodefilled + tree->numcodes;
-          treepos = nodefilled;
-        }
-      }
-      else treepos = tree->tree2d[2 * treepos + bit] - tree->numcodes;
-    }
-  }
-
-  for(n = 0;  n < tree->numcodes * 2; n++)
-  {
-    if(tree->tree2d[n] == 32767) tree->tree2d[n] = 0; /*remove possible remaining 32767's*/
-  }
-
-  return 0;
-}
-
 /*
 Second step for the ...makeFromLengths and ...makeFromFrequencies functions.
 numcodes, lengths and maxbitlen must already be filled in correctly. return
@@ -645,9 +717,114 @@ static unsigned HuffmanTree_makeFromLengths2(HuffmanTree* tree)
   uivector_cleanup(&blcount);
   uivector_cleanup(&nextcode);
 
-  if(!error) return HuffmanTree_make2DTree(tree);
-  else return error;
+  return error;
+}
+
+#ifdef LODEPNG_COMPILE_DECODER
+
+/*bits of the first decoding step, codes up to this long take a single table lookup*/
+#define FIRSTBITS 9u
+/*symbol of bit sequences no code starts with*/
+#define INVALIDSYMBOL 65535u
+
+static unsigned reverseBits(unsigned bits, unsigned num)
+{
+  unsigned i, result = 0;
+  for(i = 0; i < num; i++) result |= ((bits >> (num - i - 1u)) & 1u) << i;
+  return result;
+}
+
+/*
+The lookup tables used by the decoder, from tree1d and lengths. return value is error.
+The head table is indexed by the next FIRSTBITS bits of the stream (in stream order, so the codes are bit
+reversed). A code of at most FIRSTBITS bits fills every entry it is a prefix of with its length and symbol.
+Longer codes share an entry with their first FIRSTBITS bits, which holds the longest of them and points to a
+secondary table indexed by the bits after those. Bits no code starts with (incomplete trees) decode to
+INVALIDSYMBOL, codes that overlap (oversubscribed trees) are error 55.
+*/
+static unsigned HuffmanTree_makeTable(HuffmanTree* tree)
+{
+  static const unsigned headsize = 1u << FIRSTBITS;
+  static const unsigned mask = (1u << FIRSTBITS) - 1u;
+  unsigned maxlens[1u << FIRSTBITS];
+  size_t i, pointer, size;
+
+  for(i = 0; i < headsize; i++) maxlens[i] = 0;
+  for(i = 0; i < tree->numcodes; i++)
+  {
+    unsigned l = tree->lengths[i];
+    unsigned index;
+    if(l <= FIRSTBITS) continue;
+    index = reverseBits(tree->tree1d[i] >> (l - FIRSTBITS), FIRSTBITS);
+    if(maxlens[index] < l) maxlens[index] = l;
+  }
+
+  size = headsize;
+  for(i = 0; i < headsize; i++)
+  {
+    if(maxlens[i] > FIRSTBITS) size += (size_t)1 << (maxlens[i] - FIRSTBITS);
+  }
+  tree->table_len = (unsigned char*)mymalloc(size * sizeof(*tree->table_len));
+  tree->table_value = (unsigned short*)mymalloc(size * sizeof(*tree->table_value));
+  if(!tree->table_len || !tree->table_value) return 83; /*alloc fail*/
+  /*16 is longer than any code: not filled in yet*/
+  for(i = 0; i < size; i++) tree->table_len[i] = 16;
+
+  pointer = headsize;
+  for(i = 0; i < headsize; i++)
+  {
+    unsigned l = maxlens[i];
+    if(l <= FIRSTBITS) continue;
+    tree->table_len[i] = (unsigned char)l;
+    tree->table_value[i] = (unsigned short)pointer;
+    pointer += (size_t)1 << (l - FIRSTBITS);
+  }
+
+  for(i = 0; i < tree->numcodes; i++)
+  {
+    unsigned l = tree->lengths[i];
+    unsigned reverse, j, num;
+    if(l == 0) continue;
+    reverse = reverseBits(tree->tree1d[i], l);
+    if(l <= FIRSTBITS)
+    {
+      num = 1u << (FIRSTBITS - l);
+      for(j = 0; j < num; j++)
+      {
+        unsigned index = reverse | (j << l);
+        if(tree->table_len[index] != 16) return 55; /*oversubscribed, see comment in lodepng_error_text*/
+        tree->table_len[index] = (unsigned char)l;
+        tree->table_value[index] = (unsigned short)i;
+      }
+    }
+    else
+    {
+      unsigned index = reverse & mask;
+      unsigned tablelen = tree->table_len[index] - FIRSTBITS;
+      unsigned start = tree->table_value[index];
+      num = 1u << (tablelen - (l - FIRSTBITS));
+      for(j = 0; j < num; j++)
+      {
+        unsigned index2 = start + ((reverse >> FIRSTBITS) | (j << (l - FIRSTBITS)));
+        if(tree->table_len[index2] != 16) return 55; /*oversubscribed, see comment in lodepng_error_text*/
+        tree->table_len[index2] = (unsigned char)l;
+        tree->table_value[index2] = (unsigned short)i;
+      }
+    }
+  }
+
+  /*the lengths of the unused entries keep the reader within the 57 bits of a step: below FIRSTBITS in the
+  head table, the secondary tables only ever take their own length minus FIRSTBITS*/
+  for(i = 0; i < size; i++)
+  {
+    if(tree->table_len[i] != 16) continue;
+    tree->table_len[i] = (unsigned char)(i < headsize ? 1 : FIRSTBITS + 1);
+    tree->table_value[i] = INVALIDSYMBOL;
+  }
+
+  return 0;
 }
+#endif /*LODEPNG_COMPILE_DECODER*/
 
 /*
 given the code lengths (as stored in the PNG file), generate the tree as defined
@@ -663,7 +840,12 @@ static unsigned HuffmanTree_makeFromLengths(HuffmanTree* tree, const unsigned* b
   for(i = 0; i < numcodes; i++) tree->lengths[i] = bitlen[i];
   tree->numcodes = (unsigned)numcodes; /*number of symbols*/
   tree->maxbitlen = maxbitlen;
+#ifdef LODEPNG_COMPILE_DECODER
+  CERROR_TRY_RETURN(HuffmanTree_makeFromLengths2(tree));
+  return HuffmanTree_makeTable(tree);
+#else /*LODEPNG_COMPILE_DECODER*/
   return HuffmanTree_makeFromLengths2(tree);
+#endif /*LODEPNG_COMPILE_DECODER*/
 }
 
 #ifdef LODEPNG_COMPILE_ENCODER
@@ -928,27 +1110,24 @@ static unsigned generateFixedDistanceTree(HuffmanTree* tree)
 #ifdef LODEPNG_COMPILE_DECODER
 
 /*
-returns the code, or (unsigned)(-1) if error happened
-inbitlength is the length of the complete buffer, in bits (so its byte length times 8)
+returns the symbol, INVALIDSYMBOL for bits that aren't a code of the tree.
+takes at most 15 bits, the caller makes them available with ensureBits
 */
-static unsigned huffmanDecodeSymbol(const unsigned char* in, size_t* bp,
-                                    const HuffmanTree* codetree, size_t inbitlength)
+static unsigned huffmanDecodeSymbol(BitReader* reader, const HuffmanTree* codetree)
 {
-  unsigned treepos = 0, ct;
-  for(;;)
+  unsigned code = peekBits(reader, FIRSTBITS);
+  unsigned l = codetree->table_len[code];
+  unsigned value = codetree->table_value[code];
+  if(l <= FIRSTBITS)
   {
-    if(*bp >= inbitlength) return (unsigned)(-1); /*error: end of input memory reached without endcode*/
-    /*
-    decode the symbol from the tree. The "readBitFromStream" code is inlined in
-    the expression below because this is the biggest bottleneck while decoding
-    */
-    ct = codetree->tree2d[(treepos << 1) + READBIT(*bp, in)];
-    (*bp)++;
-    if(ct < codetree->numcodes) return ct; /*the symbol is decoded, return it*/
-    else treepos = ct - codetree->numcodes; /*symbol not yet decoded, instead move tree position*/
-
-    if(treepos >= codetree->numcodes) return (unsigned)(-1); /*error: it appeared outside the codetree*/
+    advanceBits(reader, l);
+    return value;
   }
+  /*longer code: the entry points to the secondary table of the bits after the first FIRSTBITS*/
+  advanceBits(reader, FIRSTBITS);
+  value += peekBits(reader, l - FIRSTBITS);
+  advanceBits(reader, codetree->table_len[value] - FIRSTBITS);
+  return codetree->table_value[value];
 }
 #endif /*LODEPNG_COMPILE_DECODER*/
 
@@ -967,13 +1146,11 @@ static void getTreeInflateFixed(HuffmanTree* tree_ll, HuffmanTree* tree_d)
 }
 
 /*get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
-static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
-                                      const unsigned char* in, size_t* bp, size_t inlength)
+static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d, BitReader* reader)
 {
   /*make sure that length values that aren't filled in will be 0, or a wrong tree will be generated*/
   unsigned error = 0;
   unsigned n, HLIT, HDIST, HCLEN, i;
-  size_t inbitlength = inlength * 8;
 
   /*see comments in deflateDynamic for explanation of the context and these variables, it is analogous*/
   unsigned* bitlen_ll = 0; /*lit,len code lengths*/
@@ -982,14 +1159,15 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
   unsigned* bitlen_cl = 0;
   HuffmanTree tree_cl; /*the code tree for code length codes (the huffman tree for compressed huffman trees)*/
 
-  if((*bp) >> 3 >= inlength - 2) return 49; /*error: the bit pointer is or will go past the memory*/
+  if(reader->bp >> 3 >= reader->size - 2) return 49; /*error: the bit pointer is or will go past the memory*/
 
+  ensureBits(reader);
   /*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already*/
-  HLIT =  readBitsFromStream(bp, in, 5) + 257;
+  HLIT =  readBits(reader, 5) + 257;
   /*number of distance codes. Unlike the spec, the value 1 is added to it here already*/
-  HDIST = readBitsFromStream(bp, in, 5) + 1;
+  HDIST = readBits(reader, 5) + 1;
   /*number of code length codes. Unlike the spec, the value 4 is added to it here already*/
-  HCLEN = readBitsFromStream(bp, in, 4) + 4;
+  HCLEN = readBits(reader, 4) + 4;
 
   HuffmanTree_init(&tree_cl);
 
@@ -1000,9 +1178,10 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
     bitlen_cl = (unsigned*)mymalloc(NUM_CODE_LENGTH_CODES * sizeof(unsigned));
     if(!bitlen_cl) ERROR_BREAK(83 /*alloc fail*/);
 
+    ensureBits(reader);
     for(i = 0; i < NUM_CODE_LENGTH_CODES; i++)
     {
-      if(i < HCLEN) bitlen_cl[CLCL_ORDER[i]] = readBitsFromStream(bp, in, 3);
+      if(i < HCLEN) bitlen_cl[CLCL_ORDER[i]] = readBits(reader, 3);
       else bitlen_cl[CLCL_ORDER[i]] = 0; /*if not, it must stay 0*/
     }
 
@@ -1020,7 +1199,9 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
     i = 0;
     while(i < HLIT + HDIST)
     {
-      unsigned code = huffmanDecodeSymbol(in, bp, &tree_cl, inbitlength);
+      unsigned code;
+      ensureBits(reader); /*a code of at most 7 bits and at most 7 extra bits*/
+      code = huffmanDecodeSymbol(reader, &tree_cl);
       if(code <= 15) /*a length code*/
       {
         if(i < HLIT) bitlen_ll[i] = code;
@@ -1032,10 +1213,10 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
         unsigned replength = 3; /*read in the 2 bits that indicate repeat length (3-6)*/
         unsigned value; /*set value to the previous code*/
 
-        if(*bp >= inbitlength) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
+        if(reader->bp >= reader->bitsize) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
         if (i == 0) ERROR_BREAK(54); /*can't repeat previous if i is 0*/
 
-        replength += readBitsFromStream(bp, in, 2);
+        replength += readBits(reader, 2);
 
         if(i < HLIT + 1) value = bitlen_ll[i - 1];
         else value = bitlen_d[i - HLIT - 1];
@@ -1051,9 +1232,9 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
       else if(code == 17) /*repeat "0" 3-10 times*/
       {
         unsigned replength = 3; /*read in the bits that indicate repeat length*/
-        if(*bp >= inbitlength) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
+        if(reader->bp >= reader->bitsize) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
 
-        replength += readBitsFromStream(bp, in, 3);
+        replength += readBits(reader, 3);
 
         /*repeat this value in the next lengths*/
         for(n = 0; n < replength; n++)
@@ -1068,9 +1249,9 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
       else if(code == 18) /*repeat "0" 11-138 times*/
       {
         unsigned replength = 11; /*read in the bits that indicate repeat length*/
-        if(*bp >= inbitlength) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
+        if(reader->bp >= reader->bitsize) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
 
-        replength += readBitsFromStream(bp, in, 7);
+        replength += readBits(reader, 7);
 
         /*repeat this value in the next lengths*/
         for(n = 0; n < replength; n++)
@@ -1082,17 +1263,14 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
           i++;
         }
       }
-      else /*if(code == (unsigned)(-1))*/ /*huffmanDecodeSymbol returns (unsigned)(-1) in case of error*/
+      else /*if(code == INVALIDSYMBOL)*/
       {
-        if(code == (unsigned)(-1))
-        {
-          /*return error code 10 or 11 depending on the situation that happened in huffmanDecodeSymbol
-          (10=no endcode, 11=wrong jump outside of tree)*/
-          error = (*bp) > inbitlength ? 10 : 11;
-        }
-        else error = 16; /*unexisting code, this can never happen*/
+        /*return error code 10 or 11 depending on the situation that happened in huffmanDecodeSymbol
+        (10=no endcode, 11=wrong jump outside of tree)*/
+        error = reader->bp > reader->bitsize ? 10 : 11;
         break;
       }
+      if(reader->bp > reader->bitsize) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
     }
     if(error) break;
 
@@ -1114,14 +1292,69 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
   return error;
 }
 
+/*room kept after pos in the out buffer: the longest match (258) plus the overshoot of its 8 byte copies*/
+#define INFLATE_SLACK (258 + 8)
+
+/*
+Copy of a match of length bytes at distance back, which may overlap what it writes. Distances of 8 or more
+copy 8 bytes at a time: each step reads bytes that are already written. They write up to 7 bytes past the
+end, which the INFLATE_SLACK room takes.
+*/
+static void copyMatch(unsigned char* out, size_t pos, size_t distance, size_t length)
+{
+  unsigned char* dst = &out[pos];
+  const unsigned char* src = &out[pos - distance];
+  size_t i;
+  if(distance >= 8)
+  {
+    for(i = 0; i < length; i += 8) memcpy(&dst[i], &src[i], 8);
+  }
+  else if(distance == 1) memset(dst, *src, length);
+  else
+  {
+    for(i = 0; i < length; i++) dst[i] = src[i];
+  }
+}
+
+/*
+Where the inflater writes: without a stream, out grows to hold all of the output. With one, out is a window of
+the output: once it's full, all but its last 32768 bytes (the farthest a match reaches back) go to flush and
+those move to the front, so out stays around its initial size.
+*/
+typedef struct InflateStream
+{
+  unsigned (*flush)(void* context, const unsigned char* data, size_t size); /*returns error*/
+  void* context;
+} InflateStream;
+
+/*size of the out window of a stream: flushes of 96K, and room for a stored block after what's kept*/
+#define INFLATE_STREAM_SIZE 131072
+
+/*make room for size bytes at pos in out, returns error*/
+static unsigned inflateReserve(ucvector* out, size_t* pos, size_t size, const InflateStream* stream)
+{
+  if((*pos) + size <= out->size) return 0;
+  if(stream && (*pos) > 32768)
+  {
+    size_t done = (*pos) - 32768;
+    unsigned error = stream->flush(stream->context, out->data, done);
+    if(error) return error;
+    memmove(out->data, &out->data[done], 32768);
+    (*pos) = 32768;
+    if((*pos) + size <= out->size) return 0;
+  }
+  /*reserve more room at once*/
+  if(!ucvector_resize(out, ((*pos) + size) * 2)) return 83; /*alloc fail*/
+  return 0;
+}
+
 /*inflate a block with dynamic of fixed Huffman tree*/
-static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size_t* bp,
-                                    size_t* pos, size_t inlength, unsigned btype)
+static unsigned inflateHuffmanBlock(ucvector* out, BitReader* reader, size_t* pos, unsigned btype,
+                                    const InflateStream* stream)
 {
   unsigned error = 0;
   HuffmanTree tree_ll; /*the huffman tree for literal and length codes*/
   HuffmanTree tree_d; /*the huffman tree for distance codes*/
-  size_t inbitlength = inlength * 8;
 
   HuffmanTree_init(&tree_ll);
   HuffmanTree_init(&tree_d);
@@ -1129,87 +1362,68 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
   if(btype == 1) getTreeInflateFixed(&tree_ll, &tree_d);
   else if(btype == 2)
   {
-    error = getTreeInflateDynamic(&tree_ll, &tree_d, in, bp, inlength);
+    error = getTreeInflateDynamic(&tree_ll, &tree_d, reader);
   }
 
   while(!error) /*decode all symbols until end reached, breaks at end code*/
   {
+    unsigned code_ll;
+    error = inflateReserve(out, pos, INFLATE_SLACK, stream);
+    if(error) break;
+
+    /*the 57 bits hold a length code, a distance code and their extra bits (15 + 5 + 15 + 13)*/
+    ensureBits(reader);
     /*code_ll is literal, length or end code*/
-    unsigned code_ll = huffmanDecodeSymbol(in, bp, &tree_ll, inbitlength);
+    code_ll = huffmanDecodeSymbol(reader, &tree_ll);
     if(code_ll <= 255) /*literal symbol*/
     {
-      if((*pos) >= out->size)
-      {
-        /*reserve more room at once*/
-        if(!ucvector_resize(out, ((*pos) + 1) * 2)) ERROR_BREAK(83 /*alloc fail*/);
-      }
-      out->data[(*pos)] = (unsigned char)(code_ll);
-      (*pos)++;
+      out->data[(*pos)++] = (unsigned char)code_ll;
     }
     else if(code_ll >= FIRST_LENGTH_CODE_INDEX && code_ll <= LAST_LENGTH_CODE_INDEX) /*length code*/
     {
-      unsigned code_d, distance;
-      unsigned numextrabits_l, numextrabits_d; /*extra bits for length and distance*/
-      size_t start, forward, backward, length;
+      unsigned code_d, distance, length;
 
-      /*part 1: get length base*/
+      /*part 1: get length base, plus the value of its extra bits*/
       length = LENGTHBASE[code_ll - FIRST_LENGTH_CODE_INDEX];
+      length += readBits(reader, LENGTHEXTRA[code_ll - FIRST_LENGTH_CODE_INDEX]);
 
-      /*part 2: get extra bits and add the value of that to length*/
-      numextrabits_l = LENGTHEXTRA[code_ll - FIRST_LENGTH_CODE_INDEX];
-      if(*bp >= inbitlength) ERROR_BREAK(51); /*error, bit pointer will jump past memory*/
-      length += readBitsFromStream(bp, in, numextrabits_l);
-
-      /*part 3: get distance code*/
-      code_d = huffmanDecodeSymbol(in, bp, &tree_d, inbitlength);
+      /*part 2: get distance code*/
+      code_d = huffmanDecodeSymbol(reader, &tree_d);
       if(code_d > 29)
       {
-        if(code_ll == (unsigned)(-1)) /*huffmanDecodeSymbol returns (unsigned)(-1) in case of error*/
+        if(code_d == INVALIDSYMBOL)
         {
           /*return error code 10 or 11 depending on the situation that happened in huffmanDecodeSymbol
           (10=no endcode, 11=wrong jump outside of tree)*/
-          error = (*bp) > inlength * 8 ? 10 : 11;
+          error = reader->bp > reader->bitsize ? 10 : 11;
         }
         else error = 18; /*error: invalid distance code (30-31 are never used)*/
         break;
       }
-      distance = DISTANCEBASE[code_d];
 
-      /*part 4: get extra bits from distance*/
-      numextrabits_d = DISTANCEEXTRA[code_d];
-      if(*bp >= inbitlength) ERROR_BREAK(51); /*error, bit pointer will jump past memory*/
-
-      distance += readBitsFromStream(bp, in, numextrabits_d);
-
-      /*part 5: fill in all the out[n] values based on the length and dist*/
-      start = (*pos);
-      if(distance > start) ERROR_BREAK(52); /*too long backward distance*/
-      backward = start - distance;
-      if((*pos) + length >= out->size)
-      {
-        /*reserve more room at once*/
-        if(!ucvector_resize(out, ((*pos) + length) * 2)) ERROR_BREAK(83 /*alloc fail*/);
-      }
+      /*part 3: get distance base, plus the value of its extra bits*/
+      distance = DISTANCEBASE[code_d];
+      distance += readBits(reader, DISTANCEEXTRA[code_d]);
+      if(reader->bp > reader->bitsize) ERROR_BREAK(51); /*error, bit pointer will jump past memory*/
 
-      for(forward = 0; forward < length; forward++)
-      {
-        out->data[(*pos)] = out->data[backward];
-        (*pos)++;
-        backward++;
-        if(backward >= start) backward = start - distance;
-      }
+      /*part 4: fill in all the out[n] values based on the length and dist*/
+      if(distance > (*pos)) ERROR_BREAK(52); /*too long backward distance*/
+      copyMatch(out->data, *pos, distance, length);
+      (*pos) += length;
     }
     else if(code_ll == 256)
     {
+      if(reader->bp > reader->bitsize) error = 10; /*error: the end code was read past the input*/
       break; /*end code, break the loop*/
     }
-    else /*if(code == (unsigned)(-1))*/ /*huffmanDecodeSymbol returns (unsigned)(-1) in case of error*/
+    else /*if(code_ll == INVALIDSYMBOL)*/ /*or one of the unused codes 286 and 287*/
     {
       /*return error code 10 or 11 depending on the situation that happened in huffmanDecodeSymbol
       (10=no endcode, 11=wrong jump outside of tree)*/
-      error = (*bp) > inlength * 8 ? 10 : 11;
+      error = reader->bp > reader->bitsize ? 10 : 11;
       break;
     }
+    if(reader->bp > reader->bitsize) ERROR_BREAK(10); /*error: end of input memory reached without endcode*/
   }
 
   HuffmanTree_cleanup(&tree_ll);
@@ -1218,42 +1432,47 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
   return error;
 }
 
-static unsigned inflateNoCompression(ucvector* out, const unsigned char* in, size_t* bp, size_t* pos, size_t inlength)
+static unsigned inflateNoCompression(ucvector* out, BitReader* reader, size_t* pos, const InflateStream* stream)
 {
   /*go to first boundary of byte*/
-  size_t p;
-  unsigned LEN, NLEN, n, error = 0;
-  while(((*bp) & 0x7) != 0) (*bp)++;
-  p = (*bp) / 8; /*byte position*/
+  size_t p = (reader->bp + 7) / 8; /*byte position*/
+  unsigned LEN, NLEN;
+  const unsigned char* in = reader->data;
 
   /*read LEN (2 bytes) and NLEN (2 bytes)*/
-  if(p >= inlength - 4) return 52; /*error, bit pointer will jump past memory*/
+  if(p >= reader->size - 4) return 52; /*error, bit pointer will jump past memory*/
   LEN = in[p] + 256 * in[p + 1]; p += 2;
   NLEN = in[p] + 256 * in[p + 1]; p += 2;
 
   /*check if 16-bit NLEN is really the one's complement of LEN*/
   if(LEN + NLEN != 65535) return 21; /*error: NLEN is not one's complement of LEN*/
 
-  if((*pos) + LEN >= out->size)
+  /*read the literal data: LEN bytes are now stored in the out buffer*/
+  if(p + LEN > reader->size) return 23; /*error: reading outside of in buffer*/
+  if(stream)
+  {
+    unsigned error = inflateReserve(out, pos, LEN, stream);
+    if(error) return error;
+  }
+  else if((*pos) + LEN >= out->size)
   {
     if(!ucvector_resize(out, (*pos) + LEN)) return 83; /*alloc fail*/
   }
+  memcpy(&out->data[*pos], &in[p], LEN);
+  (*pos) += LEN;
+  p += LEN;
 
-  /*read the literal data: LEN bytes are now stored in the out buffer*/
-  if(p + LEN > inlength) return 23; /*error: reading outside of in buffer*/
-  for(n = 0; n < LEN; n++) out->data[(*pos)++] = in[p++];
-
-  (*bp) = p * 8;
+  reader->bp = p * 8;
 
-  return error;
+  return 0;
 }
 
+/*inflate into out, or through the out window to stream if it isn't NULL*/
 static unsigned lodepng_inflatev(ucvector* out,
                                  const unsigned char* in, size_t insize,
-                                 const LodePNGDecompressSettings* settings)
+                                 const LodePNGDecompressSettings* settings, const InflateStream* stream)
 {
-  /*bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte)*/
-  size_t bp = 0;
+  BitReader reader;
   unsigned BFINAL = 0;
   size_t pos = 0; /*byte position in the out buffer*/
 
@@ -1261,21 +1480,30 @@ static unsigned lodepng_inflatev(ucvector* out,
 
   (void)settings;
 
+  BitReader_init(&reader, in, insize);
+
   while(!BFINAL)
   {
     unsigned BTYPE;
-    if(bp + 2 >= insize * 8) return 52; /*error, bit pointer will jump past memory*/
-    BFINAL = readBitFromStream(&bp, in);
-    BTYPE = 1 * readBitFromStream(&bp, in);
-    BTYPE += 2 * readBitFromStream(&bp, in);
+    if(reader.bp + 2 >= reader.bitsize) return 52; /*error, bit pointer will jump past memory*/
+    ensureBits(&reader);
+    BFINAL = readBits(&reader, 1);
+    BTYPE = readBits(&reader, 2);
 
     if(BTYPE == 3) return 20; /*error: invalid BTYPE*/
-    else if(BTYPE == 0) error = inflateNoCompression(out, in, &bp, &pos, insize); /*no compression*/
-    else error = inflateHuffmanBlock(out, in, &bp, &pos, insize, BTYPE); /*compression, BTYPE 01 or 10*/
+    else if(BTYPE == 0) error = inflateNoCompression(out, &reader, &pos, stream); /*no compression*/
+    else error = inflateHuffmanBlock(out, &reader, &pos, BTYPE, stream); /*compression, BTYPE 01 or 10*/
 
     if(error) return error;
   }
 
+  if(stream)
+  {
+    error = stream->flush(stream->context, out->data, pos);
+    if(error) return error;
+    pos = 0;
+  }
+
   /*Only now we know the true size of out, resize it to that*/
   if(!ucvector_resize(out, pos)) error = 83; /*alloc fail*/
 
@@ -1297,7 +1525,7 @@ unsigned lodepng_inflate(unsigned char** out, size_t* outsize,
     unsigned error;
     ucvector v;
     ucvector_init_buffer(&v, *out, *outsize);
-    error = lodepng_inflatev(&v, in, insize, settings);
+    error = lodepng_inflatev(&v, in, insize, settings, 0);
     *out = v.data;
     *outsize = v.size;
     return error;
@@ -1322,25 +1550,37 @@ static void addHuffmanSymbol(size_t* bp, ucvector* compressed, unsigned code, un
   addBitsToStreamReversed(bp, compressed, code, bitlen);
 }
 
-/*search the index in the array, that has the largest value smaller than or equal to the given value,
-given array must be sorted (if no value is smaller, it returns the size of the given array)*/
-static size_t searchCodeIndex(const unsigned* array, size_t array_size, size_t value)
+/*position of the highest set bit, v must not be 0*/
+static unsigned floorLog2(unsigned v)
 {
-  /*linear search implementation*/
-  /*for(size_t i = 1; i < array_size; i++) if(array[i] > value) return i - 1;
-  return array_size - 1;*/
+#ifdef __GNUC__
+  return 31u - (unsigned)__builtin_clz(v);
+#else /*__GNUC__*/
+  unsigned result = 0;
+  while(v >>= 1) result++;
+  return result;
+#endif /*__GNUC__*/
+}
 
-  /*binary search implementation (not that much faster) (precondition: array_size > 0)*/
-  size_t left  = 1;
-  size_t right = array_size - 1;
-  while(left <= right)
-  {
-    size_t mid = (left + right) / 2;
-    if(array[mid] <= value) left = mid + 1; /*the value to find is more to the right*/
-    else if(array[mid - 1] > value) right = mid - 1; /*the value to find is more to the left*/
-    else return mid - 1;
-  }
-  return array_size - 1;
+/*
+Index in LENGTHBASE and DISTANCEBASE of a length of 3 to 258 and of a distance of 1 to 32768. Past the first
+few, each power of two range has 4 length codes and 2 distance codes, picked by the bits after the highest.
+*/
+static unsigned lengthCodeIndex(size_t length)
+{
+  unsigned l = (unsigned)length - 3u, b;
+  if(l < 8) return l;
+  if(length == 258) return 28;
+  b = floorLog2(l);
+  return 4 * (b - 1) + ((l >> (b - 2)) & 3u);
+}
+
+static unsigned distanceCodeIndex(size_t distance)
+{
+  unsigned d = (unsigned)distance - 1u, b;
+  if(d < 4) return d;
+  b = floorLog2(d);
+  return 2 * b + ((d >> (b - 1)) & 1u);
 }
 
 static void addLengthDistance(uivector* values, size_t length, size_t distance)
@@ -1351,9 +1591,9 @@ static void addLengthDistance(uivector* values, size_t length, size_t distance)
   257-285: length/distance pair (length code, followed by extra length bits, distance code, extra distance bits)
   286-287: invalid*/
 
-  unsigned length_code = (unsigned)searchCodeIndex(LENGTHBASE, 29, length);
+  unsigned length_code = lengthCodeIndex(length);
   unsigned extra_length = (unsigned)(length - LENGTHBASE[length_code]);
-  unsigned dist_code = (unsigned)searchCodeIndex(DISTANCEBASE, 30, distance);
+  unsigned dist_code = distanceCodeIndex(distance);
   unsigned extra_distance = (unsigned)(distance - DISTANCEBASE[dist_code]);
 
   uivector_push_back(values, length_code + FIRST_LENGTH_CODE_INDEX);
@@ -1379,6 +1619,9 @@ combinations of bytes can give, the higher it is the more memory is needed, but
 if it's too low the advantage of hashing is gone.
 */
 
+/*hash values of the fast LZ77, a table of 2^15 last positions is 256K and stays in cache*/
+#define FAST_HASH_BITS 15
+
 typedef struct Hash
 {
   int* head; /*hash value to head circular pos*/
@@ -1386,11 +1629,25 @@ typedef struct Hash
   /*circular pos to prev circular pos*/
   unsigned short* chain;
   unsigned short* zeros;
+  size_t* last; /*fast LZ77 only: hash value to last pos + 1, 0 if none*/
 } Hash;
 
-static unsigned hash_init(Hash* hash, unsigned windowsize)
+static unsigned hash_init(Hash* hash, unsigned windowsize, unsigned fast)
 {
   unsigned i;
+  hash->head = 0;
+  hash->val = 0;
+  hash->chain = 0;
+  hash->zeros = 0;
+  hash->last = 0;
+  if(fast)
+  {
+    hash->last = (size_t*)mymalloc(sizeof(size_t) << FAST_HASH_BITS);
+    if(!hash->last) return 83; /*alloc fail*/
+    for(i = 0; i < (1u << FAST_HASH_BITS); i++) hash->last[i] = 0;
+    return 0;
+  }
+
   hash->head = (int*)mymalloc(sizeof(int) * HASH_NUM_VALUES);
   hash->val = (int*)mymalloc(sizeof(int) * windowsize);
   hash->chain = (unsigned short*)mymalloc(sizeof(unsigned short) * windowsize);
@@ -1412,6 +1669,7 @@ static void hash_cleanup(Hash* hash)
   myfree(hash->val);
   myfree(hash->chain);
   myfree(hash->zeros);
+  myfree(hash->last);
 }
 
 static unsigned getHash(const unsigned char* data, size_t size, size_t pos)
@@ -1621,6 +1879,110 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
   return error;
 }
 
+static unsigned readWord(const unsigned char* p)
+{
+  unsigned result;
+  memcpy(&result, p, 4);
+  return result;
+}
+
+/*hash of the fast LZ77: the 4 bytes at p, multiplied by a 32-bit golden ratio constant, top bits*/
+static unsigned fastHash(const unsigned char* p)
+{
+  return (readWord(p) * 2654435761u) >> (32 - FAST_HASH_BITS);
+}
+
+/*number of equal bytes of a and b, up to bend. Compares 8 bytes at a time where the byte order allows*/
+static size_t matchLength(const unsigned char* a, const unsigned char* b, const unsigned char* bend)
+{
+  const unsigned char* bstart = b;
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  while(b + 8 <= bend)
+  {
+    unsigned long long x, y;
+    memcpy(&x, a, 8);
+    memcpy(&y, b, 8);
+    /*the lowest set bit of the difference is in the first byte that differs*/
+    if(x != y) return (size_t)(b - bstart) + (__builtin_ctzll(x ^ y) >> 3);
+    a += 8;
+    b += 8;
+  }
+#endif /*__GNUC__ little endian*/
+  while(b != bend && *a == *b)
+  {
+    a++;
+    b++;
+  }
+  return (size_t)(b - bstart);
+}
+
+/*
+Fast LZ77 (LodePNGCompressSettings.fast). The hash of the 4 bytes at each position looks up the last position
+with the same hash, one probe instead of a chain walk. A match there is taken as is (greedy, no lazy
+evaluation), its length found by comparing words. Every position is hashed, also inside matches, so the table
+always holds the most recent occurrence. Same output format as encodeLZ77, matches are at least 4 long.
+*/
+static unsigned encodeLZ77Fast(uivector* out, Hash* hash,
+                               const unsigned char* in, size_t inpos, size_t insize, unsigned windowsize)
+{
+  size_t pos = inpos;
+  while(pos < insize)
+  {
+    size_t length = 0, offset = 0;
+    if(pos + 4 <= insize)
+    {
+      unsigned word = readWord(&in[pos]);
+      unsigned hashval = fastHash(&in[pos]);
+      size_t candidate = hash->last[hashval];
+      hash->last[hashval] = pos + 1;
+      if(candidate != 0 && pos - (candidate - 1) <= windowsize && readWord(&in[candidate - 1]) == word)
+      {
+        const unsigned char* end = &in[insize < pos + MAX_SUPPORTED_DEFLATE_LENGTH ?
+                                       insize : pos + MAX_SUPPORTED_DEFLATE_LENGTH];
+        offset = pos - (candidate - 1);
+        length = 4 + matchLength(&in[candidate + 3], &in[pos + 4], end);
+      }
+    }
+
+    if(length == 0)
+    {
+      if(!uivector_push_back(out, in[pos])) return 83; /*alloc fail*/
+      pos++;
+      continue;
+    }
+
+    addLengthDistance(out, length, offset);
+    for(pos++, length--; length > 0; pos++, length--)
+    {
+      if(pos + 4 <= insize) hash->last[fastHash(&in[pos])] = pos + 1;
+    }
+  }
+  return 0;
+}
+
+/*
+Put the positions of in[start..end) in the hash as the LZ77 functions would have, without encoding them. This
+primes the window of a chunk that is deflated on its own with the data before it.
+*/
+static void hash_prime(Hash* hash, const unsigned char* in, size_t start, size_t end,
+                       unsigned windowsize, unsigned fast)
+{
+  size_t pos;
+  for(pos = start; pos < end; pos++)
+  {
+    if(fast)
+    {
+      if(pos + 4 <= end) hash->last[fastHash(&in[pos])] = pos + 1;
+    }
+    else
+    {
+      unsigned hashval = getHash(in, end, pos);
+      updateHashChain(hash, pos, hashval, windowsize);
+      if(windowsize >= 8192 && hashval == 0) hash->zeros[pos % windowsize] = countZeros(in, end, pos);
+    }
+  }
+}
+
 /* /////////////////////////////////////////////////////////////////////////// */
 
 static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize)
@@ -1755,7 +2117,8 @@ static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash,
   {
     if(settings->use_lz77)
     {
-      error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize); /*LZ77 encoded*/
+      if(settings->fast) error = encodeLZ77Fast(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize);
+      else error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize); /*LZ77 encoded*/
       if(error) break;
     }
     else
@@ -1960,7 +2323,8 @@ static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash,
   {
     uivector lz77_encoded;
     uivector_init(&lz77_encoded);
-    error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize);
+    if(settings->fast) error = encodeLZ77Fast(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize);
+    else error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize);
     if(!error) writeLZ77data(bp, out, &lz77_encoded, &tree_ll, &tree_d);
     uivector_cleanup(&lz77_encoded);
   }
@@ -1981,6 +2345,41 @@ static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash,
   return error;
 }
 
+/*
+deflate in[start..end) as blocks of the settings' btype, appending at bit bp of out. final sets BFINAL on the
+last block. LZ77 refers back to the positions in hash, which may be from before start (see hash_prime).
+*/
+static unsigned deflateBlocks(ucvector* out, size_t* bp, Hash* hash, const unsigned char* in,
+                              size_t start, size_t end, const LodePNGCompressSettings* settings, int final)
+{
+  unsigned error = 0;
+  size_t i, blocksize, numdeflateblocks;
+  size_t insize = end - start;
+
+  if(settings->btype == 1) blocksize = insize;
+  else /*if(settings->btype == 2)*/
+  {
+    blocksize = insize / 8 + 8;
+    if(blocksize < 65535) blocksize = 65535;
+  }
+
+  numdeflateblocks = (insize + blocksize - 1) / blocksize;
+  if(numdeflateblocks == 0) numdeflateblocks = 1;
+
+  for(i = 0; i < numdeflateblocks && !error; i++)
+  {
+    int last = final && i == numdeflateblocks - 1;
+    size_t blockstart = start + i * blocksize;
+    size_t blockend = blockstart + blocksize;
+    if(blockend > end) blockend = end;
+
+    if(settings->btype == 1) error = deflateFixed(out, bp, hash, in, blockstart, blockend, settings, last);
+    else if(settings->btype == 2) error = deflateDynamic(out, bp, hash, in, blockstart, blockend, settings, last);
+  }
+
+  return error;
+}
+
 static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
                                  const LodePNGCompressSettings* settings)
 {
@@ -1999,7 +2398,6 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
   {
 #endif /*LODEPNG_CUSTOM_ZLIB_ENCODER == 2*/
     unsigned error = 0;
-    size_t i, blocksize, numdeflateblocks;
     size_t bp = 0; /*the bit pointer*/
     Hash hash;
 
@@ -2007,29 +2405,8 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
 
     if(settings->btype == 0) return deflateNoCompression(out, in, insize);
 
-    if(settings->btype == 1) blocksize = insize;
-    else /*if(settings->btype == 2)*/
-    {
-      blocksize = insize / 8 + 8;
-      if(blocksize < 65535) blocksize = 65535;
-    }
-
-    numdeflateblocks = (insize + blocksize - 1) / blocksize;
-    if(numdeflateblocks == 0) numdeflateblocks = 1;
-
-    error = hash_init(&hash, settings->windowsize);
-    if(error) return error;
-
-    for(i = 0; i < numdeflateblocks && !error; i++)
-    {
-      int final = i == numdeflateblocks - 1;
-      size_t start = i * blocksize;
-      size_t end = start + blocksize;
-      if(end > insize) end = insize;
-
-      if(settings->btype == 1) error = deflateFixed(out, &bp, &hash, in, start, end, settings, final);
-      else if(settings->btype == 2) error = deflateDynamic(out, &bp, &hash, in, start, end, settings, final);
-    }
+    error = hash_init(&hash, settings->windowsize, settings->fast);
+    if(!error) error = deflateBlocks(out, &bp, &hash, in, 0, insize, settings, 1);
 
     hash_cleanup(&hash);
 
@@ -2058,7 +2435,7 @@ unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
 /* / Adler32                                                                  */
 /* ////////////////////////////////////////////////////////////////////////// */
 
-static unsigned update_adler32(unsigned adler, const unsigned char* data, unsigned len)
+static unsigned update_adler32_scalar(unsigned adler, const unsigned char* data, size_t len)
 {
    unsigned s1 = adler & 0xffff;
    unsigned s2 = (adler >> 16) & 0xffff;
@@ -2066,7 +2443,7 @@ static unsigned update_adler32(unsigned adler, const unsigned char* data, unsign
   while(len > 0)
   {
     /*at least 5550 sums can be done before the sums overflow, saving a lot of module divisions*/
-    unsigned amount = len > 5550 ? 5550 : len;
+    unsigned amount = len > 5550 ? 5550 : (unsigned)len;
     len -= amount;
     while(amount > 0)
     {
@@ -2081,18 +2458,157 @@ static unsigned update_adler32(unsigned adler, const unsigned char* data, unsign
   return (s2 << 16) | s1;
 }
 
+#ifdef LODEPNG_X86_DISPATCH
+/*
+The vector versions take 32 bytes per step: s1 gets their sum (psadbw), s2 the bytes weighted by 32 down to 1
+(pmaddubsw) plus 32 times s1 as it was before the step. 173 steps are 5536 bytes, the most before s2 can pass
+2^32, then both are reduced.
+*/
+#define ADLER32_STEPS 173
+
+static unsigned sum32x4(__m128i v)
+{
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return (unsigned)_mm_cvtsi128_si32(v);
+}
+
+__attribute__((target("ssse3")))
+static unsigned update_adler32_ssse3(unsigned adler, const unsigned char* data, size_t len)
+{
+  unsigned s1 = adler & 0xffff;
+  unsigned s2 = (adler >> 16) & 0xffff;
+  size_t steps = len / 32;
+  const __m128i taps1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+  const __m128i taps2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_set1_epi16(1);
+
+  while(steps > 0)
+  {
+    unsigned n = steps > ADLER32_STEPS ? ADLER32_STEPS : (unsigned)steps;
+    __m128i prev = zero, sum1 = zero, sum2 = zero;
+    steps -= n;
+    len -= 32 * (size_t)n;
+    s2 += s1 * 32 * n;
+    while(n > 0)
+    {
+      __m128i bytes1 = _mm_loadu_si128((const __m128i*)data);
+      __m128i bytes2 = _mm_loadu_si128((const __m128i*)(data + 16));
+      prev = _mm_add_epi32(prev, sum1);
+      sum1 = _mm_add_epi32(sum1, _mm_sad_epu8(bytes1, zero));
+      sum1 = _mm_add_epi32(sum1, _mm_sad_epu8(bytes2, zero));
+      sum2 = _mm_add_epi32(sum2, _mm_madd_epi16(_mm_maddubs_epi16(bytes1, taps1), ones));
+      sum2 = _mm_add_epi32(sum2, _mm_madd_epi16(_mm_maddubs_epi16(bytes2, taps2), ones));
+      data += 32;
+      n--;
+    }
+    sum2 = _mm_add_epi32(sum2, _mm_slli_epi32(prev, 5));
+    s1 = (s1 + sum32x4(sum1)) % 65521;
+    s2 = (s2 + sum32x4(sum2)) % 65521;
+  }
+
+  return update_adler32_scalar((s2 << 16) | s1, data, len);
+}
+
+__attribute__((target("avx2")))
+static unsigned update_adler32_avx2(unsigned adler, const unsigned char* data, size_t len)
+{
+  unsigned s1 = adler & 0xffff;
+  unsigned s2 = (adler >> 16) & 0xffff;
+  size_t steps = len / 32;
+  const __m256i taps = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+                                        16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i ones = _mm256_set1_epi16(1);
+
+  while(steps > 0)
+  {
+    unsigned n = steps > ADLER32_STEPS ? ADLER32_STEPS : (unsigned)steps;
+    __m256i prev = zero, sum1 = zero, sum2 = zero;
+    steps -= n;
+    len -= 32 * (size_t)n;
+    s2 += s1 * 32 * n;
+    while(n > 0)
+    {
+      __m256i bytes = _mm256_loadu_si256((const __m256i*)data);
+      prev = _mm256_add_epi32(prev, sum1);
+      sum1 = _mm256_add_epi32(sum1, _mm256_sad_epu8(bytes, zero));
+      sum2 = _mm256_add_epi32(sum2, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, taps), ones));
+      data += 32;
+      n--;
+    }
+    sum2 = _mm256_add_epi32(sum2, _mm256_slli_epi32(prev, 5));
+    s1 = (s1 + sum32x4(_mm_add_epi32(_mm256_castsi256_si128(sum1), _mm256_extracti128_si256(sum1, 1)))) % 65521;
+    s2 = (s2 + sum32x4(_mm_add_epi32(_mm256_castsi256_si128(sum2), _mm256_extracti128_si256(sum2, 1)))) % 65521;
+  }
+
+  return update_adler32_scalar((s2 << 16) | s1, data, len);
+}
+#endif /*LODEPNG_X86_DISPATCH*/
+
+static unsigned update_adler32(unsigned adler, const unsigned char* data, size_t len)
+{
+#ifdef LODEPNG_X86_DISPATCH
+  if(len >= 64)
+  {
+    if(checksum_simd >= 2 && __builtin_cpu_supports("avx2")) return update_adler32_avx2(adler, data, len);
+    if(checksum_simd >= 1 && __builtin_cpu_supports("ssse3")) return update_adler32_ssse3(adler, data, len);
+  }
+#endif /*LODEPNG_X86_DISPATCH*/
+  return update_adler32_scalar(adler, data, len);
+}
+
 /*Return the adler32 of the bytes data[0..len-1]*/
-static unsigned adler32(const unsigned char* data, unsigned len)
+static unsigned adler32(const unsigned char* data, size_t len)
 {
   return update_adler32(1L, data, len);
 }
 
+unsigned lodepng_adler32(const unsigned char* data, size_t len)
+{
+  return adler32(data, len);
+}
+
 /* ////////////////////////////////////////////////////////////////////////// */
 /* / Zlib                                                                   / */
 /* ////////////////////////////////////////////////////////////////////////// */
 
 #ifdef LODEPNG_COMPILE_DECODER
 
+/*check the 2 byte zlib header, returns error*/
+static unsigned zlib_check_header(const unsigned char* in, size_t insize)
+{
+  unsigned CM, CINFO, FDICT;
+
+  if(insize < 2) return 53; /*error, size of zlib data too small*/
+  /*read information from zlib header*/
+  if((in[0] * 256 + in[1]) % 31 != 0)
+  {
+    /*error: 256 * in[0] + in[1] must be a multiple of 31, the FCHECK value is supposed to be made that way*/
+    return 24;
+  }
+
+  CM = in[0] & 15;
+  CINFO = (in[0] >> 4) & 15;
+  /*FCHECK = in[1] & 31;*/ /*FCHECK is already tested above*/
+  FDICT = (in[1] >> 5) & 1;
+  /*FLEVEL = (in[1] >> 6) & 3;*/ /*FLEVEL is not used here*/
+
+  if(CM != 8 || CINFO > 7)
+  {
+    /*error: only compression method 8: inflate with sliding window of 32k is supported by the PNG spec*/
+    return 25;
+  }
+  if(FDICT != 0)
+  {
+    /*error: the specification of PNG says about the zlib stream:
+      "The additional flags shall not specify a preset dictionary."*/
+    return 26;
+  }
+  return 0;
+}
+
 unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
                                  size_t insize, const LodePNGDecompressSettings* settings)
 {
@@ -2104,34 +2620,8 @@ unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const uns
   else
   {
 #endif /*LODEPNG_CUSTOM_ZLIB_DECODER == 1*/
-    unsigned error = 0;
-    unsigned CM, CINFO, FDICT;
-
-    if(insize < 2) return 53; /*error, size of zlib data too small*/
-    /*read information from zlib header*/
-    if((in[0] * 256 + in[1]) % 31 != 0)
-    {
-      /*error: 256 * in[0] + in[1] must be a multiple of 31, the FCHECK value is supposed to be made that way*/
-      return 24;
-    }
-
-    CM = in[0] & 15;
-    CINFO = (in[0] >> 4) & 15;
-    /*FCHECK = in[1] & 31;*/ /*FCHECK is already tested above*/
-    FDICT = (in[1] >> 5) & 1;
-    /*FLEVEL = (in[1] >> 6) & 3;*/ /*FLEVEL is not used here*/
-
-    if(CM != 8 || CINFO > 7)
-    {
-      /*error: only compression method 8: inflate with sliding window of 32k is supported by the PNG spec*/
-      return 25;
-    }
-    if(FDICT != 0)
-    {
-      /*error: the specification of PNG says about the zlib stream:
-        "The additional flags shall not specify a preset dictionary."*/
-      return 26;
-    }
+    unsigned error = zlib_check_header(in, insize);
+    if(error) return error;
 
     error = lodepng_inflate(out, outsize, in + 2, insize - 2, settings);
     if(error) return error;
@@ -2139,7 +2629,7 @@ unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const uns
     if(!settings->ignore_adler32)
     {
       unsigned ADLER32 = lodepng_read32bitInt(&in[insize - 4]);
-      unsigned checksum = adler32(*out, (unsigned)(*outsize));
+      unsigned checksum = adler32(*out, *outsize);
       if(checksum != ADLER32) return 58; /*error, adler checksum not correct, data must be corrupted*/
     }
 
@@ -2149,10 +2639,162 @@ unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const uns
 #endif /*LODEPNG_CUSTOM_ZLIB_DECODER == 1*/
 }
 
+/*the adler32 of a streamed zlib decompression, taken on the way to the stream of the caller*/
+typedef struct ZlibStream
+{
+  const InflateStream* stream;
+  unsigned adler;
+  unsigned check;
+} ZlibStream;
+
+static unsigned zlibStreamFlush(void* context, const unsigned char* data, size_t size)
+{
+  ZlibStream* zlib = (ZlibStream*)context;
+  if(zlib->check) zlib->adler = update_adler32(zlib->adler, data, size);
+  return zlib->stream->flush(zlib->stream->context, data, size);
+}
+
+/*zlib decompression of in to stream with a window of INFLATE_STREAM_SIZE bytes, ignores custom_decoder*/
+static unsigned zlib_decompress_stream(const unsigned char* in, size_t insize,
+                                       const LodePNGDecompressSettings* settings, const InflateStream* stream)
+{
+  ucvector window;
+  ZlibStream zlib;
+  InflateStream checked;
+  unsigned error = zlib_check_header(in, insize);
+  if(error) return error;
+
+  zlib.stream = stream;
+  zlib.adler = 1;
+  zlib.check = !settings->ignore_adler32;
+  checked.flush = zlibStreamFlush;
+  checked.context = &zlib;
+
+  ucvector_init(&window);
+  if(!ucvector_resize(&window, INFLATE_STREAM_SIZE)) error = 83; /*alloc fail*/
+  if(!error) error = lodepng_inflatev(&window, in + 2, insize - 2, settings, &checked);
+  ucvector_cleanup(&window);
+
+  /*error, adler checksum not correct, data must be corrupted*/
+  if(!error && zlib.check && zlib.adler != lodepng_read32bitInt(&in[insize - 4])) error = 58;
+  return error;
+}
+
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 #ifdef LODEPNG_COMPILE_ENCODER
 
+/*adler32 of the concatenation of data with adler1 and len2 bytes of data with adler2, as zlib's adler32_combine*/
+static unsigned adler32_combine(unsigned adler1, unsigned adler2, size_t len2)
+{
+  unsigned rem = (unsigned)(len2 % 65521);
+  unsigned long long sum1 = adler1 & 0xffff;
+  unsigned long long sum2 = (rem * sum1) % 65521;
+  sum1 += (adler2 & 0xffff) + 65521 - 1;
+  sum2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + 65521 - rem;
+  if(sum1 >= 65521) sum1 -= 65521;
+  if(sum1 >= 65521) sum1 -= 65521;
+  if(sum2 >= 2 * 65521) sum2 -= 2 * 65521;
+  if(sum2 >= 65521) sum2 -= 65521;
+  return (unsigned)((sum2 << 16) | sum1);
+}
+
+/*input bytes per chunk of the parallel deflate*/
+#define DEFLATE_CHUNK_SIZE 262144
+
+/*
+Parallel deflate, the way pigz does it. The input is cut in chunks, each deflated on its own with its LZ77
+window primed with the window before it, so they compress almost as one stream. All but the last end with an
+empty stored block (BFINAL 0), which pads them to a byte boundary, so they concatenate into one valid deflate
+stream. Every chunk also gets its adler32, combined at the end.
+*/
+typedef struct DeflateChunk
+{
+  ucvector out;
+  unsigned adler;
+  unsigned error;
+} DeflateChunk;
+
+typedef struct DeflateChunks
+{
+  const unsigned char* in;
+  size_t insize;
+  const LodePNGCompressSettings* settings;
+  DeflateChunk* chunks;
+} DeflateChunks;
+
+static void deflateChunkRange(void* context, size_t begin, size_t end)
+{
+  DeflateChunks* job = (DeflateChunks*)context;
+  const LodePNGCompressSettings* settings = job->settings;
+  size_t i;
+  for(i = begin; i < end; i++)
+  {
+    DeflateChunk* chunk = &job->chunks[i];
+    size_t start = i * DEFLATE_CHUNK_SIZE;
+    size_t stop = start + DEFLATE_CHUNK_SIZE < job->insize ? start + DEFLATE_CHUNK_SIZE : job->insize;
+    size_t window = start < settings->windowsize ? start : settings->windowsize;
+    size_t bp = 0;
+    int final = stop == job->insize;
+    Hash hash;
+
+    chunk->error = hash_init(&hash, settings->windowsize, settings->fast);
+    if(!chunk->error)
+    {
+      hash_prime(&hash, job->in, start - window, start, settings->windowsize, settings->fast);
+      chunk->error = deflateBlocks(&chunk->out, &bp, &hash, job->in, start, stop, settings, final);
+    }
+    hash_cleanup(&hash);
+
+    if(!chunk->error && !final)
+    {
+      /*empty stored block: BFINAL 0, BTYPE 00, padding to the byte, LEN 0 and NLEN 65535*/
+      addBitsToStream(&bp, &chunk->out, 0, 3);
+      ucvector_push_back(&chunk->out, 0);
+      ucvector_push_back(&chunk->out, 0);
+      ucvector_push_back(&chunk->out, 255);
+      ucvector_push_back(&chunk->out, 255);
+    }
+    chunk->adler = adler32(&job->in[start], stop - start);
+  }
+}
+
+static unsigned deflateParallel(ucvector* out, unsigned* adler, const unsigned char* in, size_t insize,
+                                const LodePNGCompressSettings* settings)
+{
+  DeflateChunks job;
+  size_t numchunks = (insize + DEFLATE_CHUNK_SIZE - 1) / DEFLATE_CHUNK_SIZE;
+  size_t i;
+  unsigned error = 0;
+
+  job.in = in;
+  job.insize = insize;
+  job.settings = settings;
+  job.chunks = (DeflateChunk*)mymalloc(numchunks * sizeof(DeflateChunk));
+  if(!job.chunks) return 83; /*alloc fail*/
+  for(i = 0; i < numchunks; i++) ucvector_init(&job.chunks[i].out);
+
+  parallelFor(settings, deflateChunkRange, &job, numchunks, 1);
+
+  *adler = 1;
+  for(i = 0; i < numchunks; i++)
+  {
+    DeflateChunk* chunk = &job.chunks[i];
+    size_t length = (i + 1 < numchunks ? DEFLATE_CHUNK_SIZE : insize - i * DEFLATE_CHUNK_SIZE);
+    if(!error) error = chunk->error;
+    if(!error)
+    {
+      size_t size = out->size;
+      if(!ucvector_resize(out, size + chunk->out.size)) error = 83; /*alloc fail*/
+      else memcpy(&out->data[size], chunk->out.data, chunk->out.size);
+      *adler = adler32_combine(*adler, chunk->adler, length);
+    }
+    ucvector_cleanup(&chunk->out);
+  }
+  myfree(job.chunks);
+  return error;
+}
+
 unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsigned char* in,
                                size_t insize, const LodePNGCompressSettings* settings)
 {
@@ -2186,11 +2828,19 @@ unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsig
     ucvector_push_back(&outv, (unsigned char)(CMFFLG % 256));
 
     ucvector_init(&deflatedata);
-    error = lodepng_deflatev(&deflatedata, in, insize, settings);
+    if(settings->parallel_for && settings->threads != 1 && (settings->btype == 1 || settings->btype == 2) && insize > DEFLATE_CHUNK_SIZE
+       && settings->windowsize <= 32768 && !settings->custom_encoder)
+    {
+      error = deflateParallel(&deflatedata, &ADLER32, in, insize, settings);
+    }
+    else
+    {
+      error = lodepng_deflatev(&deflatedata, in, insize, settings);
+      if(!error) ADLER32 = adler32(in, insize);
+    }
 
     if(!error)
     {
-      ADLER32 = adler32(in, (unsigned)insize);
       for(i = 0; i < deflatedata.size; i++) ucvector_push_back(&outv, deflatedata.data[i]);
       ucvector_cleanup(&deflatedata);
       lodepng_add32bitInt(&outv, ADLER32);
@@ -2239,6 +2889,9 @@ void lodepng_compress_settings_init(LodePNGCompressSettings* settings)
   settings->btype = 2;
   settings->use_lz77 = 1;
   settings->windowsize = DEFAULT_WINDOWSIZE;
+  settings->fast = 0;
+  settings->threads = 1;
+  settings->parallel_for = 0;
 #if LODEPNG_CUSTOM_ZLIB_ENCODER == 0
   settings->custom_encoder = 0;
 #else
@@ -2247,9 +2900,9 @@ void lodepng_compress_settings_init(LodePNGCompressSettings* settings)
 }
 
 #if LODEPNG_CUSTOM_ZLIB_ENCODER == 0
-const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 0};
+const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 0, 0, 1, 0};
 #else
-const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 1};
+const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 1, 0, 1, 0};
 #endif
 
 
@@ -2288,9 +2941,10 @@ const LodePNGDecompressSettings lodepng_default_decompress_settings = {0, 1};
 /* ////////////////////////////////////////////////////////////////////////// */
 
 static unsigned Crc32_crc_table_computed = 0;
-static unsigned Crc32_crc_table[256];
+/*table k is the CRC of a byte followed by k zero bytes, for slicing-by-8*/
+static unsigned Crc32_crc_table[8][256];
 
-/*Make the table for a fast CRC.*/
+/*Make the tables for a fast CRC.*/
 static void Crc32_make_crc_table(void)
 {
   unsigned c, k, n;
@@ -2302,23 +2956,117 @@ static void Crc32_make_crc_table(void)
       if(c & 1) c = 0xedb88320L ^ (c >> 1);
       else c = c >> 1;
     }
-    Crc32_crc_table[n] = c;
+    Crc32_crc_table[0][n] = c;
+  }
+  for(n = 0; n < 256; n++)
+  {
+    for(k = 1; k < 8; k++)
+    {
+      c = Crc32_crc_table[k - 1][n];
+      Crc32_crc_table[k][n] = Crc32_crc_table[0][c & 0xff] ^ (c >> 8);
+    }
   }
   Crc32_crc_table_computed = 1;
 }
 
+#ifdef LODEPNG_X86_DISPATCH
+/*
+CRC of len bytes, a multiple of 16 and at least 64, by folding with carry-less multiplications ("Fast CRC
+Computation for Generic Polynomials Using PCLMULQDQ Instruction", Intel): four 128-bit lanes are folded 64 bytes
+forward at a time, then into one, which a Barrett reduction brings to 32 bits. The constants are powers of x
+modulo the bit-reflected polynomial.
+*/
+__attribute__((target("pclmul,sse4.1")))
+static unsigned Crc32_update_crc_pclmul(const unsigned char* buf, unsigned crc, size_t len)
+{
+  const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+  const __m128i k5 = _mm_set_epi64x(0, 0x0163cd6124LL);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+  const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+  __m128i x1, x2, x3, x4, t;
+
+  x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)buf), _mm_cvtsi32_si128((int)crc));
+  x2 = _mm_loadu_si128((const __m128i*)(buf + 16));
+  x3 = _mm_loadu_si128((const __m128i*)(buf + 32));
+  x4 = _mm_loadu_si128((const __m128i*)(buf + 48));
+  buf += 64;
+  len -= 64;
+
+  while(len >= 64)
+  {
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k1k2, 0x00), _mm_clmulepi64_si128(x1, k1k2, 0x11)),
+                       _mm_loadu_si128((const __m128i*)buf));
+    x2 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x2, k1k2, 0x00), _mm_clmulepi64_si128(x2, k1k2, 0x11)),
+                       _mm_loadu_si128((const __m128i*)(buf + 16)));
+    x3 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x3, k1k2, 0x00), _mm_clmulepi64_si128(x3, k1k2, 0x11)),
+                       _mm_loadu_si128((const __m128i*)(buf + 32)));
+    x4 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x4, k1k2, 0x00), _mm_clmulepi64_si128(x4, k1k2, 0x11)),
+                       _mm_loadu_si128((const __m128i*)(buf + 48)));
+    buf += 64;
+    len -= 64;
+  }
+
+  /*fold the four lanes into one, then the remaining 16 byte blocks*/
+  x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), _mm_clmulepi64_si128(x1, k3k4, 0x11)), x2);
+  x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), _mm_clmulepi64_si128(x1, k3k4, 0x11)), x3);
+  x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), _mm_clmulepi64_si128(x1, k3k4, 0x11)), x4);
+  while(len >= 16)
+  {
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), _mm_clmulepi64_si128(x1, k3k4, 0x11)),
+                       _mm_loadu_si128((const __m128i*)buf));
+    buf += 16;
+    len -= 16;
+  }
+
+  /*128 to 64 bits*/
+  t = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), t);
+  t = _mm_srli_si128(x1, 4);
+  x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k5, 0x00), t);
+
+  /*Barrett reduction to 32 bits*/
+  t = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x10);
+  t = _mm_clmulepi64_si128(_mm_and_si128(t, mask32), poly, 0x00);
+  x1 = _mm_xor_si128(x1, t);
+  return (unsigned)_mm_extract_epi32(x1, 1);
+}
+#endif /*LODEPNG_X86_DISPATCH*/
+
 /*Update a running CRC with the bytes buf[0..len-1]--the CRC should be
 initialized to all 1's, and the transmitted value is the 1's complement of the
 final running CRC (see the crc() routine below).*/
 static unsigned Crc32_update_crc(const unsigned char* buf, unsigned crc, size_t len)
 {
   unsigned c = crc;
-  size_t n;
+
+#ifdef LODEPNG_X86_DISPATCH
+  if(len >= 64 && checksum_simd >= 1 && __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1"))
+  {
+    size_t blocks = len & ~(size_t)15;
+    c = Crc32_update_crc_pclmul(buf, c, blocks);
+    buf += blocks;
+    len -= blocks;
+  }
+#endif /*LODEPNG_X86_DISPATCH*/
 
   if(!Crc32_crc_table_computed) Crc32_make_crc_table();
-  for(n = 0; n < len; n++)
+  /*slicing-by-8: the CRC of 8 bytes at once, the 4 the CRC is xored into and 4 more*/
+  while(len >= 8)
+  {
+    unsigned one = c ^ (buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((unsigned)buf[3] << 24));
+    unsigned two = buf[4] | (buf[5] << 8) | (buf[6] << 16) | ((unsigned)buf[7] << 24);
+    c = Crc32_crc_table[7][one & 0xff] ^ Crc32_crc_table[6][(one >> 8) & 0xff]
+      ^ Crc32_crc_table[5][(one >> 16) & 0xff] ^ Crc32_crc_table[4][one >> 24]
+      ^ Crc32_crc_table[3][two & 0xff] ^ Crc32_crc_table[2][(two >> 8) & 0xff]
+      ^ Crc32_crc_table[1][(two >> 16) & 0xff] ^ Crc32_crc_table[0][two >> 24];
+    buf += 8;
+    len -= 8;
+  }
+  while(len > 0)
   {
-    c = Crc32_crc_table[(c ^ buf[n]) & 0xff] ^ (c >> 8);
+    c = Crc32_crc_table[0][(c ^ *buf++) & 0xff] ^ (c >> 8);
+    len--;
   }
   return c;
 }
@@ -2456,7 +3204,7 @@ unsigned lodepng_chunk_append(unsigned char** out, size_t* outlength, const unsi
   size_t new_length = (*outlength) + total_chunk_length;
   if(new_length < total_chunk_length || new_length < (*outlength)) return 77; /*integer overflow happened*/
 
-  new_buffer = (unsigned char*)myrealloc(*out, new_length);
+  new_buffer = (unsigned char*)heaprealloc(*out, new_length);
   if(!new_buffer) return 83; /*alloc fail*/
   (*out) = new_buffer;
   (*outlength) = new_length;
@@ -2474,7 +3222,7 @@ unsigned lodepng_chunk_create(unsigned char** out, size_t* outlength, unsigned l
   unsigned char *chunk, *new_buffer;
   size_t new_length = (*outlength) + length + 12;
   if(new_length < length + 12 || new_length < (*outlength)) return 77; /*integer overflow happened*/
-  new_buffer = (unsigned char*)myrealloc(*out, new_length);
+  new_buffer = (unsigned char*)heaprealloc(*out, new_length);
   if(!new_buffer) return 83; /*alloc fail*/
   (*out) = new_buffer;
   (*outlength) = new_length;
@@ -2560,7 +3308,7 @@ unsigned lodepng_color_mode_copy(LodePNGColorMode* dest, const LodePNGColorMode*
   *dest = *source;
   if(source->palette)
   {
-    dest->palette = (unsigned char*)mymalloc(source->palettesize * 4);
+    dest->palette = (unsigned char*)heapmalloc(source->palettesize * 4);
     if(!dest->palette && source->palettesize) return 83; /*alloc fail*/
     for(i = 0; i < source->palettesize * 4; i++) dest->palette[i] = source->palette[i];
   }
@@ -2589,7 +3337,7 @@ static int lodepng_color_mode_equal(const LodePNGColorMode* a, const LodePNGColo
 
 void lodepng_palette_clear(LodePNGColorMode* info)
 {
-  if(info->palette) myfree(info->palette);
+  if(info->palette) heapfree(info->palette);
   info->palettesize = 0;
 }
 
@@ -2603,7 +3351,7 @@ unsigned lodepng_palette_add(LodePNGColorMode* info,
   {
     /*allocated data must be at least 4* palettesize (for 4 color bytes)*/
     size_t alloc_size = info->palettesize == 0 ? 4 : info->palettesize * 4 * 2;
-    data = (unsigned char*)myrealloc(info->palette, alloc_size);
+    data = (unsigned char*)heaprealloc(info->palette, alloc_size);
     if(!data) return 83; /*alloc fail*/
     else info->palette = data;
   }
@@ -2680,7 +3428,7 @@ static void LodePNGUnknownChunks_init(LodePNGInfo* info)
 static void LodePNGUnknownChunks_cleanup(LodePNGInfo* info)
 {
   unsigned i;
-  for(i = 0; i < 3; i++) myfree(info->unknown_chunks_data[i]);
+  for(i = 0; i < 3; i++) heapfree(info->unknown_chunks_data[i]);
 }
 
 static unsigned LodePNGUnknownChunks_copy(LodePNGInfo* dest, const LodePNGInfo* src)
@@ -2693,7 +3441,7 @@ static unsigned LodePNGUnknownChunks_copy(LodePNGInfo* dest, const LodePNGInfo*
   {
     size_t j;
     dest->unknown_chunks_size[i] = src->unknown_chunks_size[i];
-    dest->unknown_chunks_data[i] = (unsigned char*)mymalloc(src->unknown_chunks_size[i]);
+    dest->unknown_chunks_data[i] = (unsigned char*)heapmalloc(src->unknown_chunks_size[i]);
     if(!dest->unknown_chunks_data[i] && dest->unknown_chunks_size[i]) return 83; /*alloc fail*/
     for(j = 0; j < src->unknown_chunks_size[i]; j++)
     {
@@ -2721,8 +3469,8 @@ static void LodePNGText_cleanup(LodePNGInfo* info)
     string_cleanup(&info->text_keys[i]);
     string_cleanup(&info->text_strings[i]);
   }
-  myfree(info->text_keys);
-  myfree(info->text_strings);
+  heapfree(info->text_keys);
+  heapfree(info->text_strings);
 }
 
 static unsigned LodePNGText_copy(LodePNGInfo* dest, const LodePNGInfo* source)
@@ -2745,12 +3493,12 @@ void lodepng_clear_text(LodePNGInfo* info)
 
 unsigned lodepng_add_text(LodePNGInfo* info, const char* key, const char* str)
 {
-  char** new_keys = (char**)(myrealloc(info->text_keys, sizeof(char*) * (info->text_num + 1)));
-  char** new_strings = (char**)(myrealloc(info->text_strings, sizeof(char*) * (info->text_num + 1)));
+  char** new_keys = (char**)(heaprealloc(info->text_keys, sizeof(char*) * (info->text_num + 1)));
+  char** new_strings = (char**)(heaprealloc(info->text_strings, sizeof(char*) * (info->text_num + 1)));
   if(!new_keys || !new_strings)
   {
-    myfree(new_keys);
-    myfree(new_strings);
+    heapfree(new_keys);
+    heapfree(new_strings);
     return 83; /*alloc fail*/
   }
 
@@ -2788,10 +3536,10 @@ static void LodePNGIText_cleanup(LodePNGInfo* info)
     string_cleanup(&info->itext_transkeys[i]);
     string_cleanup(&info->itext_strings[i]);
   }
-  myfree(info->itext_keys);
-  myfree(info->itext_langtags);
-  myfree(info->itext_transkeys);
-  myfree(info->itext_strings);
+  heapfree(info->itext_keys);
+  heapfree(info->itext_langtags);
+  heapfree(info->itext_transkeys);
+  heapfree(info->itext_strings);
 }
 
 static unsigned LodePNGIText_copy(LodePNGInfo* dest, const LodePNGInfo* source)
@@ -2818,16 +3566,16 @@ void lodepng_clear_itext(LodePNGInfo* info)
 unsigned lodepng_add_itext(LodePNGInfo* info, const char* key, const char* langtag,
                            const char* transkey, const char* str)
 {
-  char** new_keys = (char**)(myrealloc(info->itext_keys, sizeof(char*) * (info->itext_num + 1)));
-  char** new_langtags = (char**)(myrealloc(info->itext_langtags, sizeof(char*) * (info->itext_num + 1)));
-  char** new_transkeys = (char**)(myrealloc(info->itext_transkeys, sizeof(char*) * (info->itext_num + 1)));
-  char** new_strings = (char**)(myrealloc(info->itext_strings, sizeof(char*) * (info->itext_num + 1)));
+  char** new_keys = (char**)(heaprealloc(info->itext_keys, sizeof(char*) * (info->itext_num + 1)));
+  char** new_langtags = (char**)(heaprealloc(info->itext_langtags, sizeof(char*) * (info->itext_num + 1)));
+  char** new_transkeys = (char**)(heaprealloc(info->itext_transkeys, sizeof(char*) * (info->itext_num + 1)));
+  char** new_strings = (char**)(heaprealloc(info->itext_strings, sizeof(char*) * (info->itext_num + 1)));
   if(!new_keys || !new_langtags || !new_transkeys || !new_strings)
   {
-    myfree(new_keys);
-    myfree(new_langtags);
-    myfree(new_transkeys);
-    myfree(new_strings);
+    heapfree(new_keys);
+    heapfree(new_langtags);
+    heapfree(new_transkeys);
+    heapfree(new_strings);
     return 83; /*alloc fail*/
   }
 
@@ -3832,8 +4580,137 @@ unsigned lodepng_inspect(unsigned* w, unsigned* h, LodePNGState* state,
   return state->error;
 }
 
+#ifdef LODEPNG_SSE2
+/*
+SSE2 unfiltering. Sub, Average and Paeth depend on the pixel to the left, so for 3 and 4 byte pixels
+(RGB8 and RGBA8) they go one pixel per step with all its channels in one register. Up has no such
+dependency and goes 16 bytes per step for any pixel size. Pixels are moved with memcpy since 3 byte
+ones can't be stored wider: recon may be scanline, the byte after the pixel isn't read yet.
+*/
+static __m128i loadPixelSSE2(const unsigned char* p, size_t bytewidth)
+{
+  int v;
+  if(bytewidth == 4) memcpy(&v, p, 4);
+  else v = p[0] | (p[1] << 8) | (p[2] << 16);
+  return _mm_cvtsi32_si128(v);
+}
+
+static void storePixelSSE2(unsigned char* p, __m128i x, size_t bytewidth)
+{
+  int v = _mm_cvtsi128_si32(x);
+  if(bytewidth == 4) memcpy(p, &v, 4);
+  else
+  {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+  }
+}
+
+static void unfilterUpSSE2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                           size_t length)
+{
+  size_t i = 0;
+  for(; i + 16 <= length; i += 16)
+  {
+    __m128i x = _mm_loadu_si128((const __m128i*)&scanline[i]);
+    __m128i b = _mm_loadu_si128((const __m128i*)&precon[i]);
+    _mm_storeu_si128((__m128i*)&recon[i], _mm_add_epi8(x, b));
+  }
+  for(; i < length; i++) recon[i] = scanline[i] + precon[i];
+}
+
+static void unfilterSubSSE2(unsigned char* recon, const unsigned char* scanline, size_t bytewidth, size_t length)
+{
+  __m128i a = _mm_setzero_si128();
+  size_t i;
+  for(i = 0; i < length; i += bytewidth)
+  {
+    a = _mm_add_epi8(a, loadPixelSSE2(&scanline[i], bytewidth));
+    storePixelSSE2(&recon[i], a, bytewidth);
+  }
+}
+
+static void unfilterAverageSSE2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                size_t bytewidth, size_t length)
+{
+  /*_mm_avg_epu8 rounds up, the filter rounds down: subtract the carry of odd sums*/
+  const __m128i one = _mm_set1_epi8(1);
+  __m128i a = _mm_setzero_si128();
+  size_t i;
+  for(i = 0; i < length; i += bytewidth)
+  {
+    __m128i b = loadPixelSSE2(&precon[i], bytewidth);
+    __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+    a = _mm_add_epi8(avg, loadPixelSSE2(&scanline[i], bytewidth));
+    storePixelSSE2(&recon[i], a, bytewidth);
+  }
+}
+
+static __m128i abs16SSE2(__m128i x)
+{
+  return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+static __m128i selectSSE2(__m128i mask, __m128i t, __m128i f)
+{
+  return _mm_or_si128(_mm_and_si128(mask, t), _mm_andnot_si128(mask, f));
+}
+
+static void unfilterPaethSSE2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                              size_t bytewidth, size_t length)
+{
+  /*same predictor and tie order as paethPredictor in 16 bit lanes; a = c = 0 on the first pixel gives precon*/
+  const __m128i zero = _mm_setzero_si128();
+  __m128i a = zero, c = zero;
+  size_t i;
+  for(i = 0; i < length; i += bytewidth)
+  {
+    __m128i b = _mm_unpacklo_epi8(loadPixelSSE2(&precon[i], bytewidth), zero);
+    __m128i pa = abs16SSE2(_mm_sub_epi16(b, c));
+    __m128i pb = abs16SSE2(_mm_sub_epi16(a, c));
+    __m128i pc = abs16SSE2(_mm_sub_epi16(_mm_add_epi16(a, b), _mm_add_epi16(c, c)));
+    __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+    __m128i predicted = selectSSE2(_mm_cmpeq_epi16(pa, smallest), a,
+                                   selectSSE2(_mm_cmpeq_epi16(pb, smallest), b, c));
+    __m128i x = _mm_add_epi8(_mm_packus_epi16(predicted, predicted), loadPixelSSE2(&scanline[i], bytewidth));
+    storePixelSSE2(&recon[i], x, bytewidth);
+    a = _mm_unpacklo_epi8(x, zero);
+    c = b;
+  }
+}
+
+/*returns 1 if the scanline was unfiltered here, 0 to leave it to the scalar code*/
+static unsigned unfilterScanlineSSE2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                     size_t bytewidth, unsigned char filterType, size_t length)
+{
+  if(filterType == 2 && precon)
+  {
+    unfilterUpSSE2(recon, scanline, precon, length);
+    return 1;
+  }
+  if(bytewidth == 4)
+  {
+    if(filterType == 1) unfilterSubSSE2(recon, scanline, 4, length);
+    else if(filterType == 3 && precon) unfilterAverageSSE2(recon, scanline, precon, 4, length);
+    else if(filterType == 4 && precon) unfilterPaethSSE2(recon, scanline, precon, 4, length);
+    else return 0;
+    return 1;
+  }
+  if(bytewidth == 3)
+  {
+    if(filterType == 1) unfilterSubSSE2(recon, scanline, 3, length);
+    else if(filterType == 3 && precon) unfilterAverageSSE2(recon, scanline, precon, 3, length);
+    else if(filterType == 4 && precon) unfilterPaethSSE2(recon, scanline, precon, 3, length);
+    else return 0;
+    return 1;
+  }
+  return 0;
+}
+#endif /*LODEPNG_SSE2*/
+
 static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
-                                 size_t bytewidth, unsigned char filterType, size_t length)
+                                 size_t bytewidth, unsigned char filterType, size_t length, unsigned simd)
 {
   /*
   For PNG filter method 0
@@ -3842,9 +4719,15 @@ static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scan
   precon is the previous unfiltered scanline, recon the result, scanline the current one
   the incoming scanlines do NOT include the filtertype byte, that one is given in the parameter filterType instead
   recon and scanline MAY be the same memory address! precon must be disjoint.
+  simd allows the SSE2 kernels if they're compiled in, they give the same result.
   */
 
   size_t i;
+#ifdef LODEPNG_SSE2
+  if(simd && unfilterScanlineSSE2(recon, scanline, precon, bytewidth, filterType, length)) return 0;
+#else /*LODEPNG_SSE2*/
+  (void)simd;
+#endif /*LODEPNG_SSE2*/
   switch(filterType)
   {
     case 0:
@@ -3906,7 +4789,8 @@ static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scan
   return 0;
 }
 
-static unsigned unfilter(unsigned char* out, const unsigned char* in, unsigned w, unsigned h, unsigned bpp)
+static unsigned unfilter(unsigned char* out, const unsigned char* in, unsigned w, unsigned h, unsigned bpp,
+                         unsigned simd)
 {
   /*
   For PNG filter method 0
@@ -3929,7 +4813,8 @@ static unsigned unfilter(unsigned char* out, const unsigned char* in, unsigned w
     size_t inindex = (1 + linebytes) * y; /*the extra filterbyte added to each row*/
     unsigned char filterType = in[inindex];
 
-    CERROR_TRY_RETURN(unfilterScanline(&out[outindex], &in[inindex + 1], prevline, bytewidth, filterType, linebytes));
+    CERROR_TRY_RETURN(unfilterScanline(&out[outindex], &in[inindex + 1], prevline, bytewidth, filterType, linebytes,
+                                        simd));
 
     prevline = &out[outindex];
   }
@@ -4022,7 +4907,8 @@ static void removePaddingBits(unsigned char* out, const unsigned char* in,
 the IDAT chunks (with filter index bytes and possible padding bits)
 return value is error*/
 static unsigned postProcessScanlines(unsigned char* out, unsigned char* in,
-                                     unsigned w, unsigned h, const LodePNGInfo* info_png)
+                                     unsigned w, unsigned h, const LodePNGInfo* info_png,
+                                     const LodePNGDecoderSettings* settings)
 {
   /*
   This function converts the filtered-padded-interlaced data into pure 2D image buffer with the PNG's colortype.
@@ -4038,11 +4924,11 @@ static unsigned postProcessScanlines(unsigned char* out, unsigned char* in,
   {
     if(bpp < 8 && w * bpp != ((w * bpp + 7) / 8) * 8)
     {
-      CERROR_TRY_RETURN(unfilter(in, in, w, h, bpp));
+      CERROR_TRY_RETURN(unfilter(in, in, w, h, bpp, settings->simd));
       removePaddingBits(out, in, w * bpp, ((w * bpp + 7) / 8) * 8, h);
     }
     /*we can immediatly filter into the out buffer, no other steps needed*/
-    else CERROR_TRY_RETURN(unfilter(out, in, w, h, bpp));
+    else CERROR_TRY_RETURN(unfilter(out, in, w, h, bpp, settings->simd));
   }
   else /*interlace_method is 1 (Adam7)*/
   {
@@ -4053,7 +4939,8 @@ static unsigned postProcessScanlines(unsigned char* out, unsigned char* in,
 
     for(i = 0; i < 7; i++)
     {
-      CERROR_TRY_RETURN(unfilter(&in[padded_passstart[i]], &in[filter_passstart[i]], passw[i], passh[i], bpp));
+      CERROR_TRY_RETURN(unfilter(&in[padded_passstart[i]], &in[filter_passstart[i]], passw[i], passh[i], bpp,
+                                 settings->simd));
       /*TODO: possible efficiency improvement: if in this reduced image the bits fit nicely in 1 scanline,
       move bytes instead of bits or move not at all*/
       if(bpp < 8)
@@ -4071,15 +4958,16 @@ static unsigned postProcessScanlines(unsigned char* out, unsigned char* in,
   return 0;
 }
 
-/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
-static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
-                          LodePNGState* state,
-                          const unsigned char* in, size_t insize)
+/*
+read the header and chunks of a PNG into state->info_png. The data of its IDAT chunks is idatsize bytes at
+*idatdata: the data of the chunk in in if there's only one, else gathered in idat
+*/
+static void readChunks(unsigned* w, unsigned* h, LodePNGState* state, const unsigned char* in, size_t insize,
+                       ucvector* idat, const unsigned char** idatdata, size_t* idatsize)
 {
   unsigned char IEND = 0;
   const unsigned char* chunk;
   size_t i;
-  ucvector idat; /*the data from idat chunks*/
 
   /*for unknown chunk order*/
   unsigned unknown = 0;
@@ -4087,13 +4975,11 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
   unsigned critical_pos = 1; /*1 = after IHDR, 2 = after PLTE, 3 = after IDAT*/
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
-  /*provide some proper output values if error will happen*/
-  *out = 0;
-
+  *idatdata = 0;
+  *idatsize = 0;
   state->error = lodepng_inspect(w, h, state, in, insize); /*reads header and resets other parameters in state->info_png*/
   if(state->error) return;
 
-  ucvector_init(&idat);
   chunk = &in[33]; /*first byte of the first chunk after the header*/
 
   /*loop through the chunks, ignoring unknown chunks and stopping at IEND chunk.
@@ -4121,9 +5007,19 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     /*IDAT chunk, containing compressed image data*/
     if(lodepng_chunk_type_equals(chunk, "IDAT"))
     {
-      size_t oldsize = idat.size;
-      if(!ucvector_resize(&idat, oldsize + chunkLength)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
-      for(i = 0; i < chunkLength; i++) idat.data[oldsize + i] = data[i];
+      if(*idatsize == 0) *idatdata = data;
+      else
+      {
+        if(idat->size == 0)
+        {
+          if(!ucvector_resize(idat, *idatsize)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
+          memcpy(idat->data, *idatdata, *idatsize);
+        }
+        if(!ucvector_resize(idat, *idatsize + chunkLength)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
+        memcpy(&idat->data[*idatsize], data, chunkLength);
+        *idatdata = idat->data;
+      }
+      *idatsize += chunkLength;
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
       critical_pos = 3;
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
@@ -4137,9 +5033,9 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     else if(lodepng_chunk_type_equals(chunk, "PLTE"))
     {
       unsigned pos = 0;
-      if(state->info_png.color.palette) myfree(state->info_png.color.palette);
+      if(state->info_png.color.palette) heapfree(state->info_png.color.palette);
       state->info_png.color.palettesize = chunkLength / 3;
-      state->info_png.color.palette = (unsigned char*)mymalloc(4 * state->info_png.color.palettesize);
+      state->info_png.color.palette = (unsigned char*)heapmalloc(4 * state->info_png.color.palettesize);
       if(!state->info_png.color.palette && state->info_png.color.palettesize)
       {
         state->info_png.color.palettesize = 0;
@@ -4441,6 +5337,22 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
 
     if(!IEND) chunk = lodepng_chunk_next_const(chunk);
   }
+}
+
+/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
+static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
+                          LodePNGState* state,
+                          const unsigned char* in, size_t insize)
+{
+  ucvector idat; /*the data from idat chunks if there's more than one*/
+  const unsigned char* idatdata;
+  size_t idatsize;
+
+  /*provide some proper output values if error will happen*/
+  *out = 0;
+
+  ucvector_init(&idat);
+  readChunks(w, h, state, in, insize, &idat, &idatdata, &idatsize);
 
   if(!state->error)
   {
@@ -4455,8 +5367,8 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     if(!state->error)
     {
       /*decompress with the Zlib decompressor*/
-      state->error = lodepng_zlib_decompress(&scanlines.data, &scanlines.size, idat.data,
-                                             idat.size, &state->decoder.zlibsettings);
+      state->error = lodepng_zlib_decompress(&scanlines.data, &scanlines.size, idatdata,
+                                             idatsize, &state->decoder.zlibsettings);
     }
 
     if(!state->error)
@@ -4465,7 +5377,8 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
       ucvector_init(&outv);
       if(!ucvector_resizev(&outv,
           lodepng_get_raw_size(*w, *h, &state->info_png.color), 0)) state->error = 83; /*alloc fail*/
-      if(!state->error) state->error = postProcessScanlines(outv.data, scanlines.data, *w, *h, &state->info_png);
+      if(!state->error) state->error = postProcessScanlines(outv.data, scanlines.data, *w, *h, &state->info_png,
+                                                           &state->decoder);
       *out = outv.data;
     }
     ucvector_cleanup(&scanlines);
@@ -4518,6 +5431,569 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
   return state->error;
 }
 
+/*the rows of a PNG on their way to the callback: cropped to the region, converted and box filtered*/
+typedef struct RowDecoder
+{
+  LodePNGState* state;
+  unsigned bpp; /*of the PNG*/
+  unsigned region_x, region_y, region_w, region_h;
+  unsigned scale_w, scale_h; /*size of the image handed out*/
+  int convert; /*rows go through lodepng_convert to info_raw*/
+  int scale; /*rows go through the box filter*/
+  ucvector region; /*the columns of the region, when they don't start at a byte*/
+  ucvector converted; /*a row of the region in info_raw, also the output row of the box filter*/
+  unsigned long long* sums; /*box filter sums of the output row, per channel*/
+  unsigned y; /*of the next PNG row*/
+  int done; /*the last row of the region is handed out*/
+  int early; /*the region ends above the last row, the inflater stops there without checking the Adler-32*/
+  LodePNGRowCallback callback;
+  void* user;
+
+  /*streaming: the scanline being inflated and the unfiltered row above it*/
+  size_t linebytes, bytewidth;
+  ucvector scanline; /*filter type byte and filtered row, filled by the inflater*/
+  size_t filled; /*bytes of scanline filled*/
+  ucvector rows; /*the row being unfiltered and the one above it, alternately*/
+} RowDecoder;
+
+static void rowDecoder_init(RowDecoder* rows)
+{
+  ucvector_init(&rows->region);
+  ucvector_init(&rows->converted);
+  rows->sums = 0;
+  ucvector_init(&rows->scanline);
+  ucvector_init(&rows->rows);
+}
+
+static void rowDecoder_cleanup(RowDecoder* rows)
+{
+  ucvector_cleanup(&rows->region);
+  ucvector_cleanup(&rows->converted);
+  myfree(rows->sums);
+  ucvector_cleanup(&rows->scanline);
+  ucvector_cleanup(&rows->rows);
+}
+
+/*set up the rows of a w * h PNG whose chunks are read into state->info_png, returns error*/
+static unsigned rowDecoder_start(RowDecoder* rows, LodePNGState* state, unsigned w, unsigned h,
+                                 LodePNGRowCallback callback, void* user)
+{
+  const LodePNGDecoderSettings* settings = &state->decoder;
+  unsigned error;
+
+  rows->state = state;
+  rows->bpp = lodepng_get_bpp(&state->info_png.color);
+  rows->y = 0;
+  rows->callback = callback;
+  rows->user = user;
+  rows->filled = 0;
+
+  /*the same color handling as lodepng_decode*/
+  rows->convert = 0;
+  if(!settings->color_convert)
+  {
+    error = lodepng_color_mode_copy(&state->info_raw, &state->info_png.color);
+    if(error) return error;
+  }
+  else if(!lodepng_color_mode_equal(&state->info_raw, &state->info_png.color))
+  {
+    if(!(state->info_raw.colortype == LCT_RGB || state->info_raw.colortype == LCT_RGBA)
+       && !(state->info_raw.bitdepth == 8))
+    {
+      return 56; /*unsupported color mode conversion*/
+    }
+    rows->convert = 1;
+  }
+
+  if(settings->region_w == 0 || settings->region_h == 0)
+  {
+    rows->region_x = rows->region_y = 0;
+    rows->region_w = w;
+    rows->region_h = h;
+  }
+  else
+  {
+    /*error: the region isn't inside the image*/
+    if(settings->region_x > w || settings->region_w > w - settings->region_x) return 88;
+    if(settings->region_y > h || settings->region_h > h - settings->region_y) return 88;
+    rows->region_x = settings->region_x;
+    rows->region_y = settings->region_y;
+    rows->region_w = settings->region_w;
+    rows->region_h = settings->region_h;
+  }
+  rows->done = rows->region_w == 0 || rows->region_h == 0;
+  rows->early = rows->region_y + rows->region_h < h;
+
+  rows->scale_w = settings->scale_w ? settings->scale_w : rows->region_w;
+  rows->scale_h = settings->scale_h ? settings->scale_h : rows->region_h;
+  rows->scale = rows->scale_w != rows->region_w || rows->scale_h != rows->region_h;
+  if(rows->scale)
+  {
+    /*error: the box filter only shrinks*/
+    if(rows->scale_w > rows->region_w || rows->scale_h > rows->region_h) return 89;
+    /*error: the box filter averages 8 or 16 bit channels*/
+    if(state->info_raw.colortype == LCT_PALETTE || state->info_raw.bitdepth < 8) return 90;
+    rows->sums = (unsigned long long*)mymalloc(rows->scale_w * lodepng_get_channels(&state->info_raw)
+                                               * sizeof(unsigned long long));
+    if(!rows->sums) return 83; /*alloc fail*/
+    memset(rows->sums, 0, rows->scale_w * lodepng_get_channels(&state->info_raw) * sizeof(unsigned long long));
+  }
+
+  if(!ucvector_resize(&rows->region, ((size_t)rows->region_w * rows->bpp + 7) / 8)) return 83; /*alloc fail*/
+  if(!ucvector_resize(&rows->converted, lodepng_get_raw_size(rows->region_w, 1, &state->info_raw)))
+  {
+    return 83; /*alloc fail*/
+  }
+  return 0;
+}
+
+/*hand out a row, the callback allocates with malloc whatever the allocator of the call*/
+static unsigned rowDecoder_callback(RowDecoder* rows, const unsigned char* row, unsigned y, unsigned w)
+{
+  const LodePNGAllocator* allocator = call_allocator;
+  unsigned error;
+  call_allocator = 0;
+  error = rows->callback(rows->user, row, y, w);
+  call_allocator = allocator;
+  return error;
+}
+
+/*add row ry of the region to the box filter, and hand out the output row once its last row is in*/
+static unsigned rowDecoder_box(RowDecoder* rows, const unsigned char* in, unsigned ry)
+{
+  const LodePNGColorMode* mode = &rows->state->info_raw;
+  size_t channels = lodepng_get_channels(mode), bytes = mode->bitdepth / 8;
+  unsigned oy = (unsigned)((unsigned long long)ry * rows->scale_h / rows->region_h);
+  unsigned long long oybegin, oyend;
+  unsigned x, ox;
+  size_t c;
+
+  /*output column ox sums the columns whose x * scale_w / region_w is ox, from ceil(ox * region_w / scale_w)*/
+  for(ox = 0, x = 0; ox < rows->scale_w; ox++)
+  {
+    unsigned long long* sum = &rows->sums[ox * channels];
+    unsigned xend = (unsigned)(((unsigned long long)(ox + 1) * rows->region_w + rows->scale_w - 1) / rows->scale_w);
+    const unsigned char* p = &in[x * channels * bytes];
+    if(bytes == 1 && channels == 4)
+    {
+      /*RGBA8, the importance maps*/
+      for(; x < xend; x++, p += 4)
+      {
+        sum[0] += p[0]; sum[1] += p[1]; sum[2] += p[2]; sum[3] += p[3];
+      }
+    }
+    for(; x < xend; x++, p += channels * bytes)
+    {
+      if(bytes == 1) for(c = 0; c < channels; c++) sum[c] += p[c];
+      else for(c = 0; c < channels; c++) sum[c] += 256u * p[2 * c] + p[2 * c + 1];
+    }
+  }
+
+  /*likewise output row oy averages the rows whose ry * scale_h / region_h is oy*/
+  oybegin = ((unsigned long long)oy * rows->region_h + rows->scale_h - 1) / rows->scale_h;
+  oyend = ((unsigned long long)(oy + 1) * rows->region_h + rows->scale_h - 1) / rows->scale_h;
+  if(ry + 1 < oyend) return 0;
+
+  for(ox = 0; ox < rows->scale_w; ox++)
+  {
+    unsigned long long xbegin = ((unsigned long long)ox * rows->region_w + rows->scale_w - 1) / rows->scale_w;
+    unsigned long long xend = ((unsigned long long)(ox + 1) * rows->region_w + rows->scale_w - 1) / rows->scale_w;
+    unsigned long long count = (xend - xbegin) * (oyend - oybegin);
+    unsigned long long* sum = &rows->sums[ox * channels];
+    unsigned char* p = &rows->converted.data[ox * channels * bytes];
+    for(c = 0; c < channels; c++)
+    {
+      unsigned value = (unsigned)((sum[c] + count / 2) / count);
+      if(bytes == 1) p[c] = (unsigned char)value;
+      else
+      {
+        p[2 * c] = (unsigned char)(value >> 8);
+        p[2 * c + 1] = (unsigned char)value;
+      }
+      sum[c] = 0;
+    }
+  }
+  return rowDecoder_callback(rows, rows->converted.data, oy, rows->scale_w);
+}
+
+/*the next row of the PNG, unfiltered and in the PNG's color type, on to the callback if it's in the region*/
+static unsigned rowDecoder_row(RowDecoder* rows, const unsigned char* row)
+{
+  unsigned y = rows->y++;
+  const unsigned char* in = row;
+  unsigned error;
+
+  /*rows above the region were only needed to unfilter the ones below*/
+  if(y < rows->region_y || rows->done) return 0;
+
+  if(rows->region_x != 0)
+  {
+    size_t bit = (size_t)rows->region_x * rows->bpp;
+    if(bit % 8 == 0) in = &row[bit / 8];
+    else
+    {
+      /*pixels of less than 8 bits, shift the columns of the region to the start of a byte*/
+      size_t obp = 0, i, bits = (size_t)rows->region_w * rows->bpp;
+      rows->region.data[rows->region.size - 1] = 0;
+      for(i = 0; i < bits; i++) setBitOfReversedStream(&obp, rows->region.data, readBitFromReversedStream(&bit, row));
+      in = rows->region.data;
+    }
+  }
+  if(rows->convert)
+  {
+    error = lodepng_convert(rows->converted.data, in, &rows->state->info_raw, &rows->state->info_png.color,
+                            rows->region_w, 1);
+    if(error) return error;
+    in = rows->converted.data;
+  }
+
+  if(rows->scale) error = rowDecoder_box(rows, in, y - rows->region_y);
+  else error = rowDecoder_callback(rows, in, y - rows->region_y, rows->region_w);
+  if(error) return error; /*not done, so the error isn't taken for the early stop*/
+  if(y + 1 == rows->region_y + rows->region_h) rows->done = 1;
+  return 0;
+}
+
+#ifdef LODEPNG_COMPILE_ZLIB
+/*unfilter the rows the inflated bytes complete, stops the inflater with 1 once a region that ends early is done*/
+static unsigned rowDecoder_flush(void* context, const unsigned char* data, size_t size)
+{
+  RowDecoder* rows = (RowDecoder*)context;
+  size_t scanlinebytes = rows->linebytes + 1;
+  while(size > 0 && !rows->done)
+  {
+    const unsigned char* scanline;
+    unsigned char* recon = &rows->rows.data[(rows->y & 1) * rows->linebytes];
+    const unsigned char* precon = rows->y == 0 ? 0 : &rows->rows.data[((rows->y + 1) & 1) * rows->linebytes];
+    unsigned error;
+
+    if(rows->filled == 0 && size >= scanlinebytes)
+    {
+      /*the whole scanline is in the window, unfilter it from there*/
+      scanline = data;
+      data += scanlinebytes;
+      size -= scanlinebytes;
+    }
+    else
+    {
+      size_t amount = scanlinebytes - rows->filled;
+      if(amount > size) amount = size;
+      memcpy(&rows->scanline.data[rows->filled], data, amount);
+      rows->filled += amount;
+      data += amount;
+      size -= amount;
+      if(rows->filled < scanlinebytes) break;
+      rows->filled = 0;
+      scanline = rows->scanline.data;
+    }
+
+    error = unfilterScanline(recon, &scanline[1], precon, rows->bytewidth, scanline[0], rows->linebytes,
+                             rows->state->decoder.simd);
+    if(!error) error = rowDecoder_row(rows, recon);
+    if(error) return error;
+  }
+  return rows->done && rows->early ? 1 : 0;
+}
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
+/*lodepng_decode_rows of an image that can't be streamed: decode it whole, then hand out its rows*/
+static unsigned decodeRowsWhole(unsigned w, unsigned h, LodePNGState* state, const unsigned char* in,
+                                size_t insize, RowDecoder* rows, LodePNGRowCallback callback, void* user)
+{
+  unsigned char* image = 0;
+  ucvector row;
+  unsigned y, w2, h2;
+  size_t linebits;
+  unsigned error;
+
+  decodeGeneric(&image, &w2, &h2, state, in, insize);
+  error = state->error;
+  if(!error) error = rowDecoder_start(rows, state, w, h, callback, user);
+
+  linebits = (size_t)w * rows->bpp;
+  ucvector_init(&row);
+  if(!error && !ucvector_resize(&row, (linebits + 7) / 8)) error = 83; /*alloc fail*/
+  for(y = 0; !error && !rows->done; y++)
+  {
+    if(linebits % 8 == 0) error = rowDecoder_row(rows, &image[y * linebits / 8]);
+    else
+    {
+      /*rows of less than 8 bit pixels aren't byte aligned in the image, pad them like the streamed ones*/
+      size_t ibp = y * linebits, obp = 0, i;
+      row.data[row.size - 1] = 0;
+      for(i = 0; i < linebits; i++) setBitOfReversedStream(&obp, row.data, readBitFromReversedStream(&ibp, image));
+      error = rowDecoder_row(rows, row.data);
+    }
+  }
+  ucvector_cleanup(&row);
+  myfree(image);
+  return error;
+}
+
+unsigned lodepng_decode_rows(unsigned* w, unsigned* h, LodePNGState* state, const unsigned char* in,
+                             size_t insize, LodePNGRowCallback callback, void* user)
+{
+  RowDecoder rows;
+  int whole = 1, custom = 1;
+  const LodePNGAllocator* previous = call_allocator;
+
+  state->error = lodepng_inspect(w, h, state, in, insize);
+  if(state->error) return state->error;
+#ifdef LODEPNG_COMPILE_ZLIB
+  custom = 0;
+#if LODEPNG_CUSTOM_ZLIB_DECODER == 1
+  if(state->decoder.zlibsettings.custom_decoder) custom = 1;
+#endif /*LODEPNG_CUSTOM_ZLIB_DECODER == 1*/
+  /*Adam7 spreads every row over the passes, and a custom decoder gives the data at once*/
+  whole = state->info_png.interlace_method != 0 || custom;
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
+  /*a custom decoder allocates the data it gives with its own malloc, lodepng frees it*/
+  if(!custom) call_allocator = state->decoder.allocator;
+  rowDecoder_init(&rows);
+  if(whole) state->error = decodeRowsWhole(*w, *h, state, in, insize, &rows, callback, user);
+#ifdef LODEPNG_COMPILE_ZLIB
+  else
+  {
+    ucvector idat;
+    const unsigned char* idatdata;
+    size_t idatsize;
+    InflateStream stream;
+
+    ucvector_init(&idat);
+    readChunks(w, h, state, in, insize, &idat, &idatdata, &idatsize);
+    if(!state->error) state->error = rowDecoder_start(&rows, state, *w, *h, callback, user);
+    if(!state->error)
+    {
+      rows.linebytes = ((size_t)(*w) * rows.bpp + 7) / 8;
+      rows.bytewidth = (rows.bpp + 7) / 8;
+      if(!ucvector_resize(&rows.scanline, rows.linebytes + 1) || !ucvector_resize(&rows.rows, 2 * rows.linebytes))
+      {
+        state->error = 83; /*alloc fail*/
+      }
+    }
+    if(!state->error && !rows.done)
+    {
+      stream.flush = rowDecoder_flush;
+      stream.context = &rows;
+      /*once a region above the last row is done the rest isn't inflated, nor its Adler-32 checked*/
+      state->error = zlib_decompress_stream(idatdata, idatsize, &state->decoder.zlibsettings, &stream);
+      if(rows.done && rows.early) state->error = 0;
+      else if(!state->error && !rows.done) state->error = 87; /*error: the image data ends before the last row*/
+    }
+    ucvector_cleanup(&idat);
+  }
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
+  if(!state->error)
+  {
+    *w = rows.scale_w;
+    *h = rows.scale_h;
+  }
+  rowDecoder_cleanup(&rows);
+  call_allocator = previous;
+  return state->error;
+}
+
+/*the buffer of lodepng_decode_into*/
+typedef struct DecodeBuffer
+{
+  LodePNGState* state;
+  unsigned char* out;
+  size_t outsize;
+} DecodeBuffer;
+
+static unsigned decodeBufferRow(void* user, const unsigned char* row, unsigned y, unsigned w)
+{
+  DecodeBuffer* buffer = (DecodeBuffer*)user;
+  size_t linebits = (size_t)w * lodepng_get_bpp(&buffer->state->info_raw);
+  size_t obp = y * linebits, ibp = 0, i;
+
+  if(((y + 1) * linebits + 7) / 8 > buffer->outsize) return 91; /*error: the output buffer is too small*/
+  if(linebits % 8 == 0) memcpy(&buffer->out[obp / 8], row, linebits / 8);
+  else
+  {
+    /*pixels of less than 8 bits, the rows are packed without padding like lodepng_decode*/
+    for(i = 0; i < linebits; i++) setBitOfReversedStream(&obp, buffer->out, readBitFromReversedStream(&ibp, row));
+    /*zero the bits after the row, the padding of the last one*/
+    if(obp % 8 != 0) buffer->out[obp / 8] &= (unsigned char)(0xff << (8 - obp % 8));
+  }
+  return 0;
+}
+
+unsigned lodepng_decode_into(unsigned char* out, size_t outsize, unsigned* w, unsigned* h,
+                             LodePNGState* state, const unsigned char* in, size_t insize)
+{
+  DecodeBuffer buffer;
+  buffer.state = state;
+  buffer.out = out;
+  buffer.outsize = outsize;
+  return lodepng_decode_rows(w, h, state, in, insize, decodeBufferRow, &buffer);
+}
+
+/*Every allocation of an arena starts with its size and its offset in an endless block, in 16 bytes to keep the
+alignment of malloc. The endless block is where the allocations would be if data were big enough for all of them,
+the most of it in use at once is the size data needs for the same allocations next time.*/
+typedef struct ArenaHeader
+{
+  size_t size;
+  size_t offset;
+} ArenaHeader;
+
+#define ARENA_HEADER 16
+#define ARENA_SIZE(size) (ARENA_HEADER + (((size) + 15) & ~(size_t)15))
+#define ARENA_NONE ((size_t)(-1)) /*endlesslast once the last allocation is freed*/
+
+void lodepng_arena_init(LodePNGArena* arena)
+{
+  arena->data = 0;
+  arena->size = arena->used = 0;
+  arena->last = 0;
+  arena->live = 0;
+  arena->endless = arena->peak = 0;
+  arena->endlesslast = ARENA_NONE;
+  arena->mallocs = 0;
+}
+
+void lodepng_arena_cleanup(LodePNGArena* arena)
+{
+  free(arena->data);
+  lodepng_arena_init(arena);
+}
+
+static int arena_in_data(const LodePNGArena* arena, const unsigned char* p)
+{
+  return p >= arena->data && p < arena->data + arena->size;
+}
+
+/*room for an allocation of size bytes, after the last one in data or else from malloc*/
+static ArenaHeader* arena_place(LodePNGArena* arena, size_t size)
+{
+  if(arena->size - arena->used >= ARENA_SIZE(size))
+  {
+    arena->last = &arena->data[arena->used];
+    arena->used += ARENA_SIZE(size);
+    return (ArenaHeader*)arena->last;
+  }
+  arena->mallocs++;
+  return (ArenaHeader*)malloc(ARENA_SIZE(size));
+}
+
+/*give the room of an allocation back, only the last one in data goes back, the others wait for the reuse*/
+static void arena_release(LodePNGArena* arena, unsigned char* p)
+{
+  if(!arena_in_data(arena, p)) free(p);
+  else if(p == arena->last)
+  {
+    arena->used = (size_t)(p - arena->data);
+    arena->last = 0;
+  }
+}
+
+static void arena_endless_allocate(LodePNGArena* arena, ArenaHeader* header, size_t size)
+{
+  header->size = size;
+  header->offset = arena->endlesslast = arena->endless;
+  arena->endless += ARENA_SIZE(size);
+  if(arena->endless > arena->peak) arena->peak = arena->endless;
+}
+
+static void* arena_allocate(void* context, size_t size)
+{
+  LodePNGArena* arena = (LodePNGArena*)context;
+  ArenaHeader* header;
+  if(size > ARENA_NONE / 2) return 0; /*ARENA_SIZE would overflow*/
+  header = arena_place(arena, size);
+  if(!header) return 0;
+  arena_endless_allocate(arena, header, size);
+  arena->live++;
+  return (unsigned char*)header + ARENA_HEADER;
+}
+
+static void arena_deallocate(void* context, void* ptr)
+{
+  LodePNGArena* arena = (LodePNGArena*)context;
+  ArenaHeader* header;
+  if(!ptr) return;
+  header = (ArenaHeader*)((unsigned char*)ptr - ARENA_HEADER);
+  if(header->offset == arena->endlesslast)
+  {
+    arena->endless = header->offset;
+    arena->endlesslast = ARENA_NONE;
+  }
+  arena_release(arena, (unsigned char*)header);
+
+  if(--arena->live == 0)
+  {
+    /*everything is freed, start over in a block big enough for all of it*/
+    arena->used = arena->endless = 0;
+    arena->last = 0;
+    arena->endlesslast = ARENA_NONE;
+    if(arena->peak > arena->size)
+    {
+      free(arena->data);
+      arena->data = (unsigned char*)malloc(arena->peak);
+      arena->mallocs++;
+      arena->size = arena->data ? arena->peak : 0;
+    }
+  }
+}
+
+static void* arena_reallocate(void* context, void* ptr, size_t size)
+{
+  LodePNGArena* arena = (LodePNGArena*)context;
+  unsigned char* p;
+  ArenaHeader* header;
+  ArenaHeader* moved;
+  size_t offset;
+  int endlesslast;
+  if(!ptr) return arena_allocate(context, size);
+  if(size > ARENA_NONE / 2) return 0; /*ARENA_SIZE would overflow*/
+  p = (unsigned char*)ptr - ARENA_HEADER;
+  header = (ArenaHeader*)p;
+  offset = header->offset;
+  endlesslast = offset == arena->endlesslast;
+
+  if(p == arena->last && arena->size - (size_t)(p - arena->data) >= ARENA_SIZE(size))
+  {
+    /*the last one in data grows or shrinks in place*/
+    arena->used = (size_t)(p - arena->data) + ARENA_SIZE(size);
+    moved = header;
+  }
+  else if(endlesslast && !arena_in_data(arena, p))
+  {
+    moved = (ArenaHeader*)realloc(p, ARENA_SIZE(size));
+    arena->mallocs++;
+    if(!moved) return 0;
+  }
+  else
+  {
+    moved = arena_place(arena, size);
+    if(!moved) return 0;
+    memcpy((unsigned char*)moved + ARENA_HEADER, ptr, header->size < size ? header->size : size);
+    arena_release(arena, p);
+  }
+
+  /*in the endless block the last one grows or shrinks in place, the others move to its end*/
+  if(endlesslast)
+  {
+    moved->size = size;
+    moved->offset = offset;
+    arena->endless = offset + ARENA_SIZE(size);
+    if(arena->endless > arena->peak) arena->peak = arena->endless;
+  }
+  else arena_endless_allocate(arena, moved, size);
+  return (unsigned char*)moved + ARENA_HEADER;
+}
+
+void lodepng_arena_allocator(LodePNGAllocator* allocator, LodePNGArena* arena)
+{
+  allocator->allocate = arena_allocate;
+  allocator->reallocate = arena_reallocate;
+  allocator->deallocate = arena_deallocate;
+  allocator->context = arena;
+}
+
 unsigned lodepng_decode_memory(unsigned char** out, unsigned* w, unsigned* h, const unsigned char* in,
                                size_t insize, LodePNGColorType colortype, unsigned bitdepth)
 {
@@ -4573,6 +6049,10 @@ void lodepng_decoder_settings_init(LodePNGDecoderSettings* settings)
   settings->remember_unknown_chunks = 0;
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
   settings->ignore_crc = 0;
+  settings->simd = 1;
+  settings->region_x = settings->region_y = settings->region_w = settings->region_h = 0;
+  settings->scale_w = settings->scale_h = 0;
+  settings->allocator = 0;
   lodepng_decompress_settings_init(&settings->zlibsettings);
 }
 
@@ -4955,6 +6435,80 @@ static void filterScanline(unsigned char* out, const unsigned char* scanline, co
   }
 }
 
+typedef struct FilterRows
+{
+  unsigned char* out;
+  const unsigned char* in;
+  size_t linebytes;
+  size_t bytewidth;
+  unsigned error;
+} FilterRows;
+
+/*minimum sum of absolute differences filtering of the rows begin to end*/
+static void filterAdaptiveRange(void* context, size_t begin, size_t end)
+{
+  FilterRows* rows = (FilterRows*)context;
+  size_t linebytes = rows->linebytes;
+  const unsigned char* prevline = begin == 0 ? 0 : &rows->in[(begin - 1) * linebytes];
+  size_t sum[5];
+  ucvector attempt[5]; /*five filtering attempts, one for each filter type*/
+  size_t smallest = 0;
+  unsigned type, bestType = 0;
+  size_t x, y;
+  unsigned error = 0;
+
+  for(type = 0; type < 5; type++) ucvector_init(&attempt[type]);
+
+  for(type = 0; type < 5; type++)
+  {
+    if(!ucvector_resize(&attempt[type], linebytes)) ERROR_BREAK(83 /*alloc fail*/);
+  }
+
+  if(!error)
+  {
+    for(y = begin; y < end; y++)
+    {
+      /*try the 5 filter types*/
+      for(type = 0; type < 5; type++)
+      {
+        filterScanline(attempt[type].data, &rows->in[y * linebytes], prevline, linebytes, rows->bytewidth, type);
+
+        /*calculate the sum of the result*/
+        sum[type] = 0;
+        /*note that not all pixels are checked to speed this up while still having probably the best choice*/
+        for(x = 0; x < attempt[type].size; x+=3)
+        {
+          /*For differences, each byte should be treated as signed, values above 127 are negative
+          (converted to signed char). Filtertype 0 isn't a difference though, so use unsigned there.
+          This means filtertype 0 is almost never chosen, but that is justified.*/
+          if(type == 0) sum[type] += (unsigned char)(attempt[type].data[x]);
+          else
+          {
+            signed char s = (signed char)(attempt[type].data[x]);
+            sum[type] += s < 0 ? -s : s;
+          }
+        }
+
+        /*check if this is smallest sum (or if type == 0 it's the first case so always store the values)*/
+        if(type == 0 || sum[type] < smallest)
+        {
+          bestType = type;
+          smallest = sum[type];
+        }
+      }
+
+      prevline = &rows->in[y * linebytes];
+
+      /*now fill the out values*/
+      rows->out[y * (linebytes + 1)] = bestType; /*the first byte of a scanline will be the filter type*/
+      for(x = 0; x < linebytes; x++) rows->out[y * (linebytes + 1) + 1 + x] = attempt[bestType].data[x];
+    }
+  }
+
+  for(type = 0; type < 5; type++) ucvector_cleanup(&attempt[type]);
+  if(error) rows->error = error;
+}
+
 static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w, unsigned h,
                        const LodePNGColorMode* info, const LodePNGEncoderSettings* settings)
 {
@@ -4989,61 +6543,15 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
   if((!heuristic_zero && settings->filter_strategy == LFS_HEURISTIC)||
       settings->filter_strategy == LFS_MINSUM)
   {
-    /*adaptive filtering*/
-    size_t sum[5];
-    ucvector attempt[5]; /*five filtering attempts, one for each filter type*/
-    size_t smallest = 0;
-    unsigned type, bestType = 0;
-
-    for(type = 0; type < 5; type++) ucvector_init(&attempt[type]);
-
-    for(type = 0; type < 5; type++)
-    {
-      if(!ucvector_resize(&attempt[type], linebytes)) ERROR_BREAK(83 /*alloc fail*/);
-    }
-
-    if(!error)
-    {
-      for(y = 0; y < h; y++)
-      {
-        /*try the 5 filter types*/
-        for(type = 0; type < 5; type++)
-        {
-          filterScanline(attempt[type].data, &in[y * linebytes], prevline, linebytes, bytewidth, type);
-
-          /*calculate the sum of the result*/
-          sum[type] = 0;
-          /*note that not all pixels are checked to speed this up while still having probably the best choice*/
-          for(x = 0; x < attempt[type].size; x+=3)
-          {
-            /*For differences, each byte should be treated as signed, values above 127 are negative
-            (converted to signed char). Filtertype 0 isn't a difference though, so use unsigned there.
-            This means filtertype 0 is almost never chosen, but that is justified.*/
-            if(type == 0) sum[type] += (unsigned char)(attempt[type].data[x]);
-            else
-            {
-              signed char s = (signed char)(attempt[type].data[x]);
-              sum[type] += s < 0 ? -s : s;
-            }
-          }
-
-          /*check if this is smallest sum (or if type == 0 it's the first case so always store the values)*/
-          if(type == 0 || sum[type] < smallest)
-          {
-            bestType = type;
-            smallest = sum[type];
-          }
-        }
-
-        prevline = &in[y * linebytes];
-
-        /*now fill the out values*/
-        out[y * (linebytes + 1)] = bestType; /*the first byte of a scanline will be the filter type*/
-        for(x = 0; x < linebytes; x++) out[y * (linebytes + 1) + 1 + x] = attempt[bestType].data[x];
-      }
-    }
-
-    for(type = 0; type < 5; type++) ucvector_cleanup(&attempt[type]);
+    /*adaptive filtering, the rows are independent so they are split over the threads*/
+    FilterRows rows;
+    rows.out = out;
+    rows.in = in;
+    rows.linebytes = linebytes;
+    rows.bytewidth = bytewidth;
+    rows.error = 0;
+    parallelFor(&settings->zlibsettings, filterAdaptiveRange, &rows, h, 16);
+    error = rows.error;
   }
   else if((heuristic_zero && settings->filter_strategy == LFS_HEURISTIC)||
       settings->filter_strategy == LFS_ZERO)
@@ -5689,6 +7197,11 @@ const char* lodepng_error_text(unsigned code)
     case 84: return "given image too small to contain all pixels to be encoded";
     case 85: return "internal color conversion bug";
     case 86: return "impossible offset in lz77 encoding (internal bug)";
+    case 87: return "the image data ends before the last row";
+    case 88: return "the decode region isn't inside the image";
+    case 89: return "the box filter scale is larger than the decode region";
+    case 90: return "the box filter needs 8 or 16 bit channels, not palette or less than 8 bit output";
+    case 91: return "the output buffer is too small for the image";
   }
   return "unknown error code";
 }
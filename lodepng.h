@@ -295,6 +295,17 @@ typedef struct LodePNGCompressSettings /*deflate = compress*/
   unsigned use_lz77; /*whether or not to use LZ77. Should be 1 for proper compression.*/
   unsigned windowsize; /*the maximum is 32768, higher gives more compression but is slower. Typical value: 2048.*/
   unsigned custom_encoder; /*use custom encoder if LODEPNG_CUSTOM_ZLIB_DECODER and LODEPNG_COMPILE_ZLIB are enabled*/
+  /*speed over size: one hash probe per position and greedy matching instead of hash chains and lazy matching.
+  Several times faster, somewhat larger output. Default: 0*/
+  unsigned fast;
+  /*deflate chunks of the data on this many threads, 0 for one per processor. The chunks are primed with the
+  window before them and form one stream, slightly larger than with 1 thread. Needs parallel_for. Default: 1*/
+  unsigned threads;
+  /*LodePNG has no threads of its own: this calls function on ranges [begin, end) of about chunk items that
+  cover [0, n), on threads threads, and returns when all are done. NULL runs them on the calling thread.
+  Default: NULL*/
+  void (*parallel_for)(void (*function)(void* context, size_t begin, size_t end), void* context, size_t n,
+                       size_t chunk, unsigned threads);
 } LodePNGCompressSettings;
 
 extern const LodePNGCompressSettings lodepng_default_compress_settings;
@@ -502,6 +513,21 @@ unsigned lodepng_convert(unsigned char* out, const unsigned char* in,
 
 
 #ifdef LODEPNG_COMPILE_DECODER
+/*
+Allocator of the memory that lodepng_decode_rows and lodepng_decode_into allocate and free again before they
+return: the inflate window, Huffman trees, rows, the image of an interlaced PNG. What ends up in the state, like
+the palette and texts, and what the row callback allocates stay on malloc. The functions get context back. Each
+thread has its own allocator of the call in progress, so threads can decode at once with their own allocators.
+See LodePNGArena for one that reuses its memory from one decode to the next.
+*/
+typedef struct LodePNGAllocator
+{
+  void* (*allocate)(void* context, size_t size);
+  void* (*reallocate)(void* context, void* ptr, size_t size); /*like realloc, ptr may be 0*/
+  void (*deallocate)(void* context, void* ptr); /*like free, ptr may be 0*/
+  void* context;
+} LodePNGAllocator;
+
 /*
 Settings for the decoder. This contains settings for the PNG and the Zlib
 decoder, but not the Info settings from the Info structs.
@@ -512,6 +538,19 @@ typedef struct LodePNGDecoderSettings
 
   unsigned ignore_crc; /*ignore CRC checksums*/
   unsigned color_convert; /*whether to convert the PNG to the color type you want. Default: yes*/
+  unsigned simd; /*use the SSE2 unfilter kernels if compiled in (x86, see LODEPNG_NO_SIMD), same result. Default: yes*/
+
+  /*for lodepng_decode_rows: only hand out the rows and columns of this rectangle. Rows above it are unfiltered
+  (the filters refer to the row above) but not converted, rows below it aren't even inflated, so the Adler-32
+  of the zlib stream is only checked when the region reaches the last row. A region_w or region_h of 0 is the
+  whole image. Default: 0*/
+  unsigned region_x, region_y, region_w, region_h;
+  /*for lodepng_decode_rows: shrink the region to this size with a box filter, each output pixel the average of
+  the pixels that fall in it. 0 keeps the size of the region. Needs an output of 8 or 16 bit channels. Default: 0*/
+  unsigned scale_w, scale_h;
+  /*for lodepng_decode_rows and lodepng_decode_into: the allocator of their temporary memory, 0 for malloc. Not
+  used with a custom zlib decoder, which allocates its output itself. Default: 0*/
+  const LodePNGAllocator* allocator;
 
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
   unsigned read_text_chunks; /*if false but remember_unknown_chunks is true, they're stored in the unknown chunks*/
@@ -617,6 +656,60 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
                         LodePNGState* state,
                         const unsigned char* in, size_t insize);
 
+/*
+Called by lodepng_decode_rows with the rows of the image in order, y from 0 to h - 1, in the color type of
+state->info_raw. With a region or scale in the decoder settings, these are the rows and size of the output.
+Rows of pixels under 8 bits are padded to a whole byte. row is only valid during the call.
+A nonzero return stops the decoding, lodepng_decode_rows returns it as its error.
+*/
+typedef unsigned (*LodePNGRowCallback)(void* user, const unsigned char* row, unsigned y, unsigned w);
+
+/*
+Same as lodepng_decode, but the image goes row by row to callback instead of into one buffer. Inflating,
+unfiltering and color conversion run as the rows come, so beside in only the 32K deflate window and a few rows
+are in memory, plus a copy of the compressed data if it's split over several IDAT chunks. Interlaced images and
+custom zlib decoders can't go row by row, they are decoded whole first. See region and scale in
+LodePNGDecoderSettings to decode a part or a smaller image, w and h are then set to the size of the output.
+*/
+unsigned lodepng_decode_rows(unsigned* w, unsigned* h,
+                             LodePNGState* state,
+                             const unsigned char* in, size_t insize,
+                             LodePNGRowCallback callback, void* user);
+
+/*
+Same as lodepng_decode, but into out, a buffer of outsize bytes the caller owns, such as a mapped pixel buffer
+of OpenGL. It goes through lodepng_decode_rows, so the image is never in memory twice and the region and scale
+settings apply. out needs lodepng_get_raw_size(w, h, &state->info_raw) bytes for the w and h of the output, the
+ones of lodepng_inspect without region or scale. Error 91 if it's smaller, and then out holds the rows that fit.
+*/
+unsigned lodepng_decode_into(unsigned char* out, size_t outsize, unsigned* w, unsigned* h,
+                             LodePNGState* state,
+                             const unsigned char* in, size_t insize);
+
+/*
+An allocator that decodes frame after frame in the same memory. Allocations go one after the other in a block,
+the last one grows and shrinks in place (the inflate window grows by doubling), and the block is reused from its
+start once everything in it is freed, as it is at the end of each decode. What doesn't fit goes to malloc, and
+the block then grows to what the same allocations need, so from the second frame of the same size on there are
+no more mallocs. The fields are the arena's own, mallocs counts its calls to malloc and realloc.
+*/
+typedef struct LodePNGArena
+{
+  unsigned char* data; /*the block*/
+  size_t size; /*of data*/
+  size_t used; /*bytes of data up to the end of the last allocation*/
+  unsigned char* last; /*the last allocation in data, 0 once it's freed*/
+  size_t live; /*allocations not freed yet*/
+  size_t endless, endlesslast; /*used and the offset of the last allocation, if data had no end*/
+  size_t peak; /*most of endless at once, the size of data from the next reuse on*/
+  size_t mallocs;
+} LodePNGArena;
+
+void lodepng_arena_init(LodePNGArena* arena);
+void lodepng_arena_cleanup(LodePNGArena* arena); /*frees data, all of its allocations must be freed*/
+/*set allocator to allocate from arena, both must outlive the decodes that use it*/
+void lodepng_arena_allocator(LodePNGAllocator* allocator, LodePNGArena* arena);
+
 /*
 Read the PNG header, but not the actual data. This returns only the information
 that is in the header chunk of the PNG, such as width, height and color type. The
@@ -700,6 +793,13 @@ unsigned lodepng_chunk_create(unsigned char** out, size_t* outlength, unsigned l
 unsigned lodepng_crc32(const unsigned char* buf, size_t len);
 #endif /*LODEPNG_COMPILE_PNG*/
 
+/*
+Highest instruction set lodepng_crc32 and lodepng_adler32 may use, for benchmarks: 0 is the portable code
+(slicing-by-8 CRC32, scalar Adler-32), 1 adds PCLMULQDQ CRC32 and SSSE3 Adler-32, 2 AVX2 Adler-32. The best the
+processor has up to it is picked at runtime, all give the same checksums. Default: 2
+*/
+void lodepng_checksum_simd(unsigned level);
+
 
 #ifdef LODEPNG_COMPILE_ZLIB
 /*
@@ -708,6 +808,9 @@ buffer. It cannot be used to create gzip files however, and it only supports the
 part of zlib that is required for PNG, it does not support dictionaries.
 */
 
+/*Calculate the Adler-32 of buffer, the checksum of zlib*/
+unsigned lodepng_adler32(const unsigned char* buf, size_t len);
+
 #ifdef LODEPNG_COMPILE_DECODER
 /*Inflate a buffer. Inflate is the decompression step of deflate. Out buffer must be freed after use.*/
 unsigned lodepng_inflate(unsigned char** out, size_t* outsize,
@@ -855,7 +958,7 @@ TODO:
 [X] converting color to 16-bit per channel types
 [ ] read all public PNG chunk types (but never let the color profile and gamma ones touch RGB values)
 [ ] make sure encoder generates no chunks with size > (2^31)-1
-[ ] partial decoding (stream processing)
+[X] partial decoding (stream processing)
 [X] let the "isFullyOpaque" function check color keys and transparent palettes too
 [X] better name for the variables "codes", "codesD", "codelengthcodes", "clcl" and "lldl"
 [ ] don't stop decoding on errors like 69, 57, 58 (make warnings)
@@ -7,6 +7,8 @@
 #include <climits>
 #include <iostream>
 #include <cstdio>
+#include <cstring>
+#include <cstdlib>
 #include <fstream>
 #include <sstream>
 #include <ctime>
@@ -16,80 +18,477 @@ using namespace std;
 
 #include "PoissonDiskSampler.hpp"
 #include "Timer.hpp"
+#include "SampleRing.hpp"
+#include "SampleFile.hpp"
+#include "Trace.hpp"
+#include "GpuTimer.hpp"
+#include "Probe.hpp"
+#include "PerfCounters.hpp"
+#include "TileStats.hpp"
+#include "Benchmark.hpp"
+#include "CpuSamplers.hpp"
+#include "lodepng.h"
 
-void runExp(const size_t& w, const size_t& h, const size_t& nd,
-            const float& r, FILE* logfile){
-  PoissonDiskSampler* oglr = new PoissonDiskSampler(w,h,nd,r);
+//Optional outputs of an experiment
+struct ExpOptions{
+  SampleRing* ring;  //stream the samples while sampling
+  string outfile;    //save the samples to a sample file
+  bool compress;     //delta code the sample file
+  TraceWriter* trace;//record every iteration
+  bool gputimer;     //time the phases with GL timestamp queries
+  bool perf;         //hardware counters per phase
+  bool mem;          //print the memory of every buffer
+  size_t budget;     //plan the storage for this many bytes, 0 for none
+  string heatmap;    //prefix of the per-tile dart statistics
+  size_t tilesize;
+
+  ExpOptions():ring(NULL),compress(false),trace(NULL),gputimer(false),
+               perf(false),mem(false),budget(0),tilesize(32){}
+};
+
+static const char* phase_names[4] = {"generate", "throw", "conflict",
+                                     "compact"};
+
+//Statistics of one iteration
+struct IterStats{
+  double start;      //trace time of the iteration start
+  double phases[4];  //generate, throw, conflict, compact
+  size_t darts;
+  size_t accepted;
+  size_t emptypixels;
+};
+
+//Record an iteration, its phases and the sampler statistics
+static void traceIteration(TraceWriter& trace, const size_t& itr,
+                           const IterStats& st){
+  TraceWriter::Args args;
+  args.push_back(make_pair("iteration", (double)itr));
+  args.push_back(make_pair("darts", (double)st.darts));
+  args.push_back(make_pair("accepted", (double)st.accepted));
+  args.push_back(make_pair("empty pixels", (double)st.emptypixels));
+
+  double t = st.start;
+  for(size_t i=0; i < 4; i++){
+    trace.complete(phase_names[i], t, st.phases[i], TraceWriter::Args(), 2);
+    t += st.phases[i];
+  }
+  trace.complete("iteration", st.start, t-st.start, args, 1);
+  trace.counter("darts", st.start, TraceWriter::Args(args.begin()+1,
+                                                     args.begin()+3));
+  trace.counter("empty pixels", st.start, TraceWriter::Args(args.begin()+3,
+                                                            args.end()));
+}
+
+//End of a phase: a timestamp query, or a full sync for the CPU timers
+static inline void endPhase(GpuTimer* gputimer, const size_t& phase){
+  if(gputimer != NULL){
+    gputimer->mark(phase);
+  }
+  else{
+    glFinish();
+  }
+}
+
+static inline void startCounters(PerfCounters* perf){
+  if(perf != NULL){
+    perf->start();
+  }
+}
+
+static inline void stopCounters(PerfCounters* perf,
+                                PerfCounters::Counts& counts){
+  if(perf != NULL){
+    counts += perf->stop();
+  }
+}
+
+//Hardware counters of the decoding of a png, repeated reps times
+static void perfDecode(const string& filename, const size_t& reps,
+                       FILE* logfile){
+  vector<unsigned char> png;
+  lodepng::load_file(png, filename);
+  if(png.empty()){
+    perror(filename.c_str());
+    return;
+  }
+
+  PerfCounters perf;
+  Timer timer;
+  double elapsed = 0;
+  unsigned int w = 0, h = 0;
+  for(size_t i=0; i < reps; i++){
+    vector<unsigned char> image;
+    timer.start();
+    perf.start();
+    unsigned int error;
+    {
+      PROBE_ZONE("lodepng_decode");
+      error = lodepng::decode(image, w, h, png);
+    }
+    perf.stop();
+    elapsed += timer.stop();
+    assert(error == 0);
+  }
+
+  double npixels = (double)w*h*reps;
+  fprintf(logfile, "#decode %s %ux%u %.3f ms %.3f MPixel/s "
+          "%.3f png bytes/pixel\n", filename.c_str(), w, h,
+          elapsed*1000/reps, npixels/elapsed*1e-6, png.size()/((double)w*h));
+  PerfCounters::report(logfile, "decode", perf.total(), npixels);
+}
+
+void runExp(const SampleRunConfig& cfg, FILE* logfile,
+            const ExpOptions& opts, SampleRunResult& result){
+  const size_t& w = cfg.width;
+  const size_t& h = cfg.height;
+  const size_t& nd = cfg.ndarts;
+  const float& r = cfg.radius;
+  SampleRing* ring = opts.ring;
+  PoissonDiskSampler* oglr = NULL;
+  if(opts.budget > 0){
+    SamplerPlan plan;
+    //the tiles of a split plan would have to be sampled one after the
+    //other with their borders fixed, a run samples the whole domain at once
+    if(!planMemory(w,h,nd,r,opts.budget,1,plan)){
+      fprintf(stderr, "%lux%lu at r %g does not fit untiled in %.1f MB, "
+              "raise -budget\n", w, h, r, opts.budget/1048576.0);
+      exit(1);
+    }
+    fprintf(logfile, "#plan tile %lux%lu (%lu tiles) %s coordinates, %s\n",
+            plan.tilewidth, plan.tileheight, plan.tiles(),
+            plan.packedcoords ? "packed" : "float",
+            plan.emptylist ? "empty list" : "coverage rejection");
+    oglr = new PoissonDiskSampler(plan);
+  }
+  else{
+    oglr = new PoissonDiskSampler(w,h,nd,r);
+  }
   size_t usedmem = oglr->init();
+  if(cfg.seed != 0){
+    oglr->setSeed(cfg.seed);
+  }
+  if(opts.mem || opts.budget > 0){
+    vector<MemoryItem> items;
+    oglr->memoryUsage(items);
+    printMemory(logfile, items);
+    fprintf(logfile, "#mem %-30s gpu %10.3f MB\n", "measured",
+            usedmem/1048576.0);
+  }
   
   size_t emptypixels = 0;
   size_t itr=0;
   Timer timer;
-  Timer t1,t2,t3;
+  Timer t0,t1,t2,t3;
+  TraceWriter* trace = opts.trace;
 
   for(int i=0; i < 1; i++){
-    double p1=0,p2=0,p3=0;
+    double p0=0,p1=0,p2=0,p3=0;
+    vector<IterStats> stats;
+    if(!opts.heatmap.empty()){
+      oglr->enableTileStats(opts.tilesize);
+    }
     oglr->reset();
     glFinish();
+
+    PerfCounters* perf = opts.perf ? new PerfCounters : NULL;
+    PerfCounters::Counts counts[4];
+
+    GpuTimer* gputimer = NULL;
+    if(opts.gputimer){
+      gputimer = new GpuTimer(4);
+      gputimer->calibrate((trace != NULL) ? trace->now() : 0);
+    }
+
     itr=0;
     timer.start();
     do{
+      IterStats st;
+      st.start = (trace != NULL) ? trace->now() : 0;
+      if(gputimer != NULL){
+        gputimer->begin();
+      }
+      t0.start();
+      startCounters(perf);
+      oglr->generateDarts();
+      endPhase(gputimer, 0);
+      stopCounters(perf, counts[0]);
+      p0+=st.phases[0]=t0.stop();
       t1.start();
+      startCounters(perf);
       oglr->throwDarts();
-      glFinish();
-      p1+=t1.stop();
+      endPhase(gputimer, 1);
+      stopCounters(perf, counts[1]);
+      p1+=st.phases[1]=t1.stop();
       t2.start();
+      startCounters(perf);
       oglr->removeConflict();
-      glFinish();
-      p2+=t2.stop();
+      endPhase(gputimer, 2);
+      stopCounters(perf, counts[2]);
+      p2+=st.phases[2]=t2.stop();
       t3.start();
+      startCounters(perf);
       emptypixels=oglr->collectEmptyPixels();
-      glFinish();
-      p3+=t3.stop();
+      endPhase(gputimer, 3);
+      stopCounters(perf, counts[3]);
+      p3+=st.phases[3]=t3.stop();
+
+      st.darts = oglr->dartsThrown();
+      st.accepted = oglr->dartsAccepted();
+      st.emptypixels = emptypixels;
+      stats.push_back(st);
+
+      if(gputimer != NULL){ //collect the finished queries, no waiting
+        gputimer->poll();
+      }
+      if(ring != NULL){ //hand the new samples to the consumer
+        oglr->publishResults(*ring);
+      }
       itr++;    
     }
     while(emptypixels > 0 && itr < 200 );
     double elapsed = timer.stop();
+    if(emptypixels > 0){ //the set is not maximal
+      fprintf(stderr, "%lux%lu at r %g did not converge in %lu iterations, "
+              "%lu empty pixels left\n", w, h, r, itr, emptypixels);
+    }
+    if(ring != NULL){
+      ring->endRun();
+    }
+
+    //the CPU phase times are meaningless without the syncs
+    if(gputimer != NULL){
+      gputimer->drain();
+      const vector<GpuTimer::Frame>& frames = gputimer->frames();
+      for(size_t f=0; f < frames.size(); f++){
+        IterStats& st = stats[frames[f].id];
+        st.start = gputimer->toSeconds(frames[f].stamps[0]);
+        for(size_t k=0; k < 4; k++){
+          st.phases[k] = gputimer->phaseTime(frames[f], k);
+        }
+      }
+      p0 = gputimer->totalTime(0);
+      p1 = gputimer->totalTime(1);
+      p2 = gputimer->totalTime(2);
+      p3 = gputimer->totalTime(3);
+      delete gputimer;
+    }
+
+    if(trace != NULL){
+      for(size_t k=0; k < stats.size(); k++){
+        traceIteration(*trace, k, stats[k]);
+      }
+    }
     
     //get the results
-    vector<GLfloat> res;
+    vector<GLfloat>& res = result.pts;
     oglr->downloadResults(res);
-    size_t npts = res.size()/2;
-  
-    if (logfile != NULL){
-      // fprintf(logfile,"%ld\t%ld\t%ld\t%f\t%ld\t%ld\t%f\t%f\t%f\t%f\t%f\t%f\n",
-      //         w,h,nd,r,npts,itr,p1*1000,p2*1000,p3*1000,
-      //         elapsed*1000,usedmem/1048576.0,npts/elapsed);
-      cout << npts/elapsed << "pts / sec" << endl;
+    result.iterations = itr;
+    result.elapsed = elapsed;
+    result.phases[0] = p0;
+    result.phases[1] = p1;
+    result.phases[2] = p2;
+    result.phases[3] = p3;
+    result.devicemem = usedmem;
+
+    if(logfile != NULL && perf != NULL){
+      //the host thread only, it waits in glFinish
+      for(size_t k=0; k < 4; k++){
+        PerfCounters::report(logfile, phase_names[k], counts[k],
+                             (double)w*h);
+      }
     }
+    delete perf;
   
-  // //savefile
-  // stringstream fs;
-  // fs << "filename.rps";
-  // cout << fs.str() << endl;
-  // FILE* outfile=fopen(fs.str().c_str(),"wb");
-  // size_t s = fwrite(&res[0], sizeof(res[0]), res.size(),outfile);
-  // assert (s == res.size());
-  // fclose(outfile);
+    if(!opts.heatmap.empty()){
+      TileStats tiles;
+      oglr->tileStats(tiles);
+      saveTileStats(opts.heatmap+".bin", tiles);
+      saveTileHeatmap(opts.heatmap+".png", tiles);
+    }
+
+    //save the samples
+    if(!opts.outfile.empty()){
+      bool ok = writeSampleFile(opts.outfile, res, w, h, r, oglr->getSeed(),
+                                1024, opts.compress);
+      assert(ok);
+    }
   }
   delete oglr;
 }
 
-float computeR(const size_t& n){
-  return 0.7766*sqrt(2.0/(sqrt(3.0)*n));
-}
+//The rasterization sampler, one GL sampler per run
+class PixelPieBackend : public SamplerBackend{
+ public:
+  PixelPieBackend(const ExpOptions& opts):opts_(opts){}
 
-size_t computeN(const float& r){
-  return 2.0/(sqrt(3.0)*pow(r/0.7766,2));
-}
+  string name() const {return "pixelpie";}
+  const char* phaseName(const size_t& i) const{
+    return (i < 4) ? phase_names[i] : NULL;
+  }
+  bool threaded() const {return false;}
+  void run(const SampleRunConfig& cfg, SampleRunResult& res){
+    runExp(cfg, stdout, opts_, res);
+  }
+
+ private:
+  const ExpOptions& opts_;
+};
 
 int main(int argc, char** argv){
   glutInit(&argc,argv);
   glutCreateWindow (""); //create the context
   glewInit();
 
-  float r = 8.5/4096;
-  runExp(4096,4096,computeN(r)/2,r,stdout);
+  //-shm <name> streams the samples into a shared memory ring
+  //-o <file> saves them as a sample file, -z compresses it
+  //-trace <file> saves a per-iteration trace (Chrome trace JSON)
+  //-gputimer times the phases with timestamp queries instead of glFinish
+  //-perf reports hardware counters per phase, -perfpng <file> also
+  //      measures the decoding of a png
+  //-mem prints the memory of every buffer, -budget <MB> plans the
+  //     storage for a memory budget, untiled
+  //-heatmap <prefix> saves per-tile dart statistics (prefix.bin and
+  //     prefix.png), -tile <px> sets the tile size
+  //
+  //Benchmark sweeps, comma separated lists (radii may be written a/b):
+  //-res <sizes> -radius <radii> -darts <fractions of computeN(r)>
+  //-backend <names> -threads <counts> -warmup <n> -reps <n> -seed <s>
+  //backends are pixelpie, bridson and quadtree (CpuSamplers.hpp)
+  //-csv <file> -json <file> save every measured run
+  //-spectrum <size> averages the periodograms of the reps of every
+  //      combination, -spectrumout <prefix> saves them (png and radial)
+  ExpOptions opts;
+  string tracefile;
+  string perfpng;
+  BenchmarkSweep sweep;
+  sweep.resolutions.push_back(4096);
+  sweep.radii.push_back(8.5/4096);
+  sweep.darts.push_back(0.5);
+  sweep.threads.push_back(1);
+  vector<string> backendnames(1, "pixelpie");
+  string csvfile, jsonfile;
+  for(int i=1; i < argc; i++){
+    if(strcmp(argv[i],"-res") == 0 && i+1 < argc){
+      sweep.resolutions = parseSizeList(argv[++i]);
+    }
+    else if(strcmp(argv[i],"-radius") == 0 && i+1 < argc){
+      sweep.radii = parseFloatList(argv[++i]);
+    }
+    else if(strcmp(argv[i],"-darts") == 0 && i+1 < argc){
+      sweep.darts = parseFloatList(argv[++i]);
+    }
+    else if(strcmp(argv[i],"-threads") == 0 && i+1 < argc){
+      sweep.threads = parseSizeList(argv[++i]);
+    }
+    else if(strcmp(argv[i],"-backend") == 0 && i+1 < argc){
+      backendnames.clear();
+      stringstream ss(argv[++i]);
+      string name;
+      while(getline(ss, name, ',')){
+        backendnames.push_back(name);
+      }
+    }
+    else if(strcmp(argv[i],"-warmup") == 0 && i+1 < argc){
+      sweep.warmup = atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i],"-reps") == 0 && i+1 < argc){
+      sweep.reps = atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i],"-seed") == 0 && i+1 < argc){
+      sweep.seed = strtoul(argv[++i], NULL, 10);
+    }
+    else if(strcmp(argv[i],"-spectrum") == 0 && i+1 < argc){
+      sweep.spectrum = atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i],"-spectrumout") == 0 && i+1 < argc){
+      sweep.spectrumprefix = argv[++i];
+    }
+    else if(strcmp(argv[i],"-csv") == 0 && i+1 < argc){
+      csvfile = argv[++i];
+    }
+    else if(strcmp(argv[i],"-json") == 0 && i+1 < argc){
+      jsonfile = argv[++i];
+    }
+    else if(strcmp(argv[i],"-shm") == 0 && i+1 < argc){
+      opts.ring = SampleRing::create(argv[++i], 1<<22);
+      assert(opts.ring != NULL);
+    }
+    else if(strcmp(argv[i],"-o") == 0 && i+1 < argc){
+      opts.outfile = argv[++i];
+    }
+    else if(strcmp(argv[i],"-z") == 0){
+      opts.compress = true;
+    }
+    else if(strcmp(argv[i],"-heatmap") == 0 && i+1 < argc){
+      opts.heatmap = argv[++i];
+    }
+    else if(strcmp(argv[i],"-tile") == 0 && i+1 < argc){
+      opts.tilesize = atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i],"-mem") == 0){
+      opts.mem = true;
+    }
+    else if(strcmp(argv[i],"-budget") == 0 && i+1 < argc){
+      opts.budget = (size_t)(atof(argv[++i])*1048576);
+    }
+    else if(strcmp(argv[i],"-perf") == 0){
+      opts.perf = true;
+    }
+    else if(strcmp(argv[i],"-perfpng") == 0 && i+1 < argc){
+      perfpng = argv[++i];
+    }
+    else if(strcmp(argv[i],"-gputimer") == 0){
+      opts.gputimer = true;
+    }
+    else if(strcmp(argv[i],"-trace") == 0 && i+1 < argc){
+      tracefile = argv[++i];
+      opts.trace = new TraceWriter;
+      opts.trace->threadName(1, "iterations");
+      opts.trace->threadName(2, "phases");
+    }
+  }
+
+  if(!perfpng.empty()){
+    perfDecode(perfpng, 10, stdout);
+  }
+
+  vector<SamplerBackend*> backends;
+  for(size_t i=0; i < backendnames.size(); i++){
+    if(backendnames[i] == "pixelpie"){
+      backends.push_back(new PixelPieBackend(opts));
+    }
+    else if(backendnames[i] == "bridson"){
+      backends.push_back(new BridsonBackend);
+    }
+    else if(backendnames[i] == "quadtree"){
+      backends.push_back(new QuadtreeBackend);
+    }
+    else{
+      fprintf(stderr, "unknown backend %s\n", backendnames[i].c_str());
+    }
+  }
+
+  //backend w h nd r npts itr phase0..3 elapsed(ms) mem(MB) pts/s threads
+  //mindist coverage voids, then with -spectrum a #spectrum line per
+  //combination: backend w h nd r runs peakfreq*r peak lowpower anisotropy
+  vector<BenchmarkRecord> records;
+  runBenchmark(sweep, backends, stdout, records);
+  if(!csvfile.empty()){
+    saveBenchmarkCSV(csvfile, backends, records);
+  }
+  if(!jsonfile.empty()){
+    saveBenchmarkJSON(jsonfile, backends, records);
+  }
+  for(size_t i=0; i < backends.size(); i++){
+    delete backends[i];
+  }
+
+  delete opts.ring; //closes the stream
+  if(opts.trace != NULL){
+    opts.trace->save(tracefile);
+    delete opts.trace;
+  }
+  probeReport(stderr); //only with make PROBES=1
 
   return 0;
 }
@@ -0,0 +1,460 @@
+#include <GL/glew.h>
+#include <GL/glut.h>
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "PoissonDiskSampler.hpp"
+#include "cudaMicrobench.hpp"
+#include "Parallel.hpp"
+#include "Timer.hpp"
+#include "lodepng.h"
+
+// Every stage of the sampler in isolation on fixed inputs. One line per
+// benchmark: name, items and bytes per run, ms per run, items/s, MB/s.
+
+static string only; //run the benchmarks whose name contains this
+
+static bool selected(const char* name){
+  return only.empty() || strstr(name, only.c_str()) != NULL;
+}
+
+static void report(const char* name, const double& items,
+                   const double& bytes, const double& seconds){
+  printf("%-20s\t%.0f\t%.0f\t%.4f\t%.4g\t%.2f\n", name, items, bytes,
+         seconds*1000, items/seconds, bytes/seconds/1048576.0);
+  fflush(stdout);
+}
+
+//Importance map sized test image: smooth ramps plus a fixed pattern,
+//compresses like a real map rather than like noise
+static void makeImportanceMap(const size_t& w, const size_t& h,
+                              vector<unsigned char>& image){
+  image.resize(w*h*4);
+  srand(12345);
+  for(size_t y=0; y < h; y++){
+    for(size_t x=0; x < w; x++){
+      unsigned char* p = &image[(y*w+x)*4];
+      float fx = (float)x/w, fy = (float)y/h;
+      float v = 0.5f+0.25f*sin(12*fx)*cos(9*fy)+0.25f*fx*fy;
+      p[0] = p[1] = p[2] = (unsigned char)(255*v) ^ (rand() & 3);
+      p[3] = 255;
+    }
+  }
+}
+
+static void benchGeneration(const size_t& reps){
+  const size_t w = 4096, h = 4096, ndarts = 1<<18;
+  if(selected("generate/first")){
+    double t = benchDartGeneration(w, h, ndarts, 0, reps);
+    report("generate/first", ndarts, 4.0*ndarts, t);
+  }
+  if(selected("generate/list")){
+    //a list read and a dart written per item
+    double t = benchDartGeneration(w, h, ndarts, w*h/8, reps);
+    report("generate/list", ndarts, 8.0*ndarts, t);
+  }
+}
+
+static void benchCompactions(const size_t& reps){
+  const size_t w = 4096, h = 4096, stride = 8;
+  size_t kept = 0;
+  if(selected("compact/copy_if")){
+    //a texel per pixel, a list entry per empty pixel
+    double t = benchCompaction(w, h, stride, true, reps, kept);
+    report("compact/copy_if", w*h, w*h+4.0*kept, t);
+  }
+  if(selected("compact/remove_if")){
+    size_t n = 2*((w*h+stride-1)/stride);
+    double t = benchCompaction(w, h, stride, false, reps, kept);
+    report("compact/remove_if", n, 5.0*n+4.0*kept, t);
+  }
+}
+
+//Throw and conflict passes of a fixed dart set, then the download
+static void benchRasterization(const size_t& reps){
+  if(!selected("raster/throw") && !selected("raster/conflict") &&
+     !selected("download")){
+    return;
+  }
+  const size_t w = 4096, h = 4096;
+  const float r = 8.5/4096;
+  PoissonDiskSampler sampler(w, h, computeN(r)/2, r);
+  sampler.init();
+  sampler.setSeed(12345);
+
+  //fragments of a disk of radius r, depth or coverage written per dart
+  double fragments = M_PI*r*r*w*h;
+  Timer timer;
+  double tthrow = 0, tconflict = 0;
+  size_t darts = 0;
+  for(size_t i=0; i < reps; i++){
+    sampler.reset();
+    sampler.generateDarts();
+    glFinish();
+    darts = sampler.dartsThrown();
+
+    timer.start();
+    sampler.throwDarts();
+    glFinish();
+    tthrow += timer.stop();
+
+    timer.start();
+    sampler.removeConflict();
+    glFinish();
+    tconflict += timer.stop();
+  }
+  if(selected("raster/throw")){
+    report("raster/throw", darts, 4*fragments*darts, tthrow/reps);
+  }
+  if(selected("raster/conflict")){
+    report("raster/conflict", darts, fragments*sampler.dartsAccepted(),
+           tconflict/reps);
+  }
+
+  if(selected("download")){
+    sampler.reset();
+    sampler.sample();
+    vector<GLfloat> res;
+    double t = 0;
+    for(size_t i=0; i < reps; i++){
+      timer.start();
+      sampler.downloadResults(res);
+      t += timer.stop();
+    }
+    //three vertices of two floats per sample are read back
+    report("download", res.size()/2, 24.0*res.size()/2, t/reps);
+  }
+}
+
+static void benchDedup(const size_t& reps){
+  if(!selected("dedup")){
+    return;
+  }
+  const size_t n = 1<<20;
+  vector<GLfloat> input(n*6);
+  for(size_t i=0; i < n; i++){
+    for(size_t v=0; v < 3; v++){
+      input[i*6+v*2] = (i % 4096)/4096.0f;
+      input[i*6+v*2+1] = (i / 4096)/4096.0f;
+    }
+  }
+
+  Timer timer;
+  double t = 0;
+  for(size_t i=0; i < reps; i++){
+    vector<GLfloat> res(input);
+    timer.start();
+    uniqueSamples(res);
+    t += timer.stop();
+    assert(res.size() == 2*n);
+  }
+  report("dedup", 3*n, input.size()*sizeof(GLfloat), t/reps);
+}
+
+//Row callback of png/decode-rows, compares the row with the image
+static unsigned checkRow(void* user, const unsigned char* row, unsigned y,
+                         unsigned w){
+  const vector<unsigned char>& image = *(const vector<unsigned char>*)user;
+  return memcmp(row, &image[(size_t)y*w*4], w*4) == 0 ? 0 : 1;
+}
+
+//Row callback of png/decode-tile and png/decode-scaled, counts the rows
+static unsigned countRow(void* user, const unsigned char*, unsigned,
+                         unsigned){
+  (*(size_t*)user)++;
+  return 0;
+}
+
+//Allocator of png/alloc-heap, malloc counting its calls
+static size_t heapAllocations = 0;
+
+static void* countMalloc(void*, size_t size){
+  heapAllocations++;
+  return malloc(size);
+}
+
+static void* countRealloc(void*, void* ptr, size_t size){
+  heapAllocations++;
+  return realloc(ptr, size);
+}
+
+static void countFree(void*, void* ptr){
+  free(ptr);
+}
+
+static void benchPNG(const size_t& reps){
+  if(!selected("png/encode") && !selected("png/encode-fast") &&
+     !selected("png/encode-parallel") && !selected("png/decode") &&
+     !selected("png/decode-rows") && !selected("png/decode-into") &&
+     !selected("png/decode-tile") && !selected("png/decode-scaled") &&
+     !selected("png/alloc")){
+    return;
+  }
+  const size_t w = 1024, h = 1024;
+  vector<unsigned char> image,png;
+  makeImportanceMap(w, h, image);
+  Timer timer;
+
+  double t = 0;
+  for(size_t i=0; i < reps; i++){
+    png.clear();
+    timer.start();
+    unsigned error = lodepng::encode(png, image, w, h);
+    t += timer.stop();
+    assert(error == 0);
+  }
+  if(selected("png/encode")){
+    report("png/encode", w*h, image.size(), t/reps);
+  }
+
+  //the settings of the debug dumps: fast deflate, then also on every
+  //processor
+  const char* names[2] = {"png/encode-fast", "png/encode-parallel"};
+  for(size_t k=0; k < 2; k++){
+    if(!selected(names[k])){
+      continue;
+    }
+    t = 0;
+    for(size_t i=0; i < reps; i++){
+      lodepng::State state;
+      state.encoder.zlibsettings.fast = 1;
+      state.encoder.zlibsettings.threads = k == 0 ? 1 : 0;
+      state.encoder.zlibsettings.parallel_for = parallelRanges;
+      vector<unsigned char> fast;
+      timer.start();
+      unsigned error = lodepng::encode(fast, image, w, h, state);
+      t += timer.stop();
+      assert(error == 0);
+    }
+    report(names[k], w*h, image.size(), t/reps);
+  }
+
+  if(selected("png/decode")){
+    t = 0;
+    for(size_t i=0; i < reps; i++){
+      vector<unsigned char> decoded;
+      unsigned dw,dh;
+      timer.start();
+      unsigned error = lodepng::decode(decoded, dw, dh, png);
+      t += timer.stop();
+      assert(error == 0 && decoded == image);
+    }
+    report("png/decode", w*h, image.size(), t/reps);
+  }
+
+  if(selected("png/decode-rows")){
+    //the streamed decode of the importance map loader
+    t = 0;
+    for(size_t i=0; i < reps; i++){
+      lodepng::State state;
+      unsigned dw,dh;
+      timer.start();
+      unsigned error = lodepng_decode_rows(&dw, &dh, &state, &png[0],
+                                           png.size(), checkRow, &image);
+      t += timer.stop();
+      assert(error == 0);
+    }
+    report("png/decode-rows", w*h, image.size(), t/reps);
+  }
+
+  if(selected("png/decode-into")){
+    //into a buffer sized once, like the mapped unpack buffer of the loader
+    vector<unsigned char> decoded(image.size());
+    t = 0;
+    for(size_t i=0; i < reps; i++){
+      lodepng::State state;
+      unsigned dw,dh;
+      timer.start();
+      unsigned error = lodepng_decode_into(&decoded[0], decoded.size(),
+                                           &dw, &dh, &state, &png[0],
+                                           png.size());
+      t += timer.stop();
+      assert(error == 0 && decoded == image);
+    }
+    report("png/decode-into", w*h, image.size(), t/reps);
+  }
+
+  //the map of a quarter size tile in the middle, and the whole map
+  //downscaled to a quarter of its size
+  const char* regions[2] = {"png/decode-tile", "png/decode-scaled"};
+  for(size_t k=0; k < 2; k++){
+    if(!selected(regions[k])){
+      continue;
+    }
+    t = 0;
+    for(size_t i=0; i < reps; i++){
+      lodepng::State state;
+      if(k == 0){
+        state.decoder.region_x = w/4;
+        state.decoder.region_y = h/4;
+        state.decoder.region_w = w/2;
+        state.decoder.region_h = h/2;
+      }else{
+        state.decoder.scale_w = w/4;
+        state.decoder.scale_h = h/4;
+      }
+      unsigned dw,dh;
+      size_t rows = 0;
+      timer.start();
+      unsigned error = lodepng_decode_rows(&dw, &dh, &state, &png[0],
+                                           png.size(), countRow, &rows);
+      t += timer.stop();
+      assert(error == 0 && rows == dh);
+    }
+    report(regions[k], w*h, image.size(), t/reps);
+  }
+
+  //frame after frame into the same buffer, the items are the mallocs and
+  //reallocs of a frame after the first: on the heap and from an arena
+  const char* allocs[2] = {"png/alloc-heap", "png/alloc-arena"};
+  for(size_t k=0; k < 2; k++){
+    if(!selected(allocs[k])){
+      continue;
+    }
+    LodePNGArena arena;
+    lodepng_arena_init(&arena);
+    LodePNGAllocator allocator;
+    if(k == 0){
+      allocator.allocate = countMalloc;
+      allocator.reallocate = countRealloc;
+      allocator.deallocate = countFree;
+      allocator.context = NULL;
+    }
+    else{
+      lodepng_arena_allocator(&allocator, &arena);
+    }
+    vector<unsigned char> decoded(image.size());
+    size_t mallocs = 0;
+    t = 0;
+    for(size_t i=0; i <= reps; i++){
+      lodepng::State state;
+      state.decoder.allocator = &allocator;
+      unsigned dw,dh;
+      size_t before = k == 0 ? heapAllocations : arena.mallocs;
+      timer.start();
+      unsigned error = lodepng_decode_into(&decoded[0], decoded.size(),
+                                           &dw, &dh, &state, &png[0],
+                                           png.size());
+      double frame = timer.stop();
+      assert(error == 0 && decoded == image);
+      if(i > 0){ //the first one warms the arena up
+        t += frame;
+        mallocs += (k == 0 ? heapAllocations : arena.mallocs) - before;
+      }
+    }
+    report(allocs[k], (double)mallocs/reps, image.size(), t/reps);
+    lodepng_arena_cleanup(&arena);
+  }
+}
+
+//Decode of the map stored as RGBA8 and as RGB8, the SSE2 unfilter
+//kernels against the scalar ones
+static void benchPNGUnfilter(const size_t& reps){
+  const char* names[4] = {"png/rgba8/sse2", "png/rgba8/scalar",
+                          "png/rgb8/sse2", "png/rgb8/scalar"};
+  if(!selected(names[0]) && !selected(names[1]) &&
+     !selected(names[2]) && !selected(names[3])){
+    return;
+  }
+  const size_t w = 1024, h = 1024;
+  vector<unsigned char> rgba;
+  makeImportanceMap(w, h, rgba);
+  Timer timer;
+
+  for(size_t k=0; k < 4; k++){
+    if(!selected(names[k])){
+      continue;
+    }
+    LodePNGColorType type = k < 2 ? LCT_RGBA : LCT_RGB;
+    size_t channels = k < 2 ? 4 : 3;
+    vector<unsigned char> image(w*h*channels), png;
+    for(size_t i=0; i < w*h; i++){
+      memcpy(&image[i*channels], &rgba[i*4], channels);
+    }
+    //keep the color type, the map is grey and would be stored as such
+    lodepng::State encoder;
+    encoder.info_raw.colortype = type;
+    encoder.info_png.color.colortype = type;
+    encoder.encoder.auto_convert = LAC_NO;
+    unsigned error = lodepng::encode(png, image, w, h, encoder);
+    assert(error == 0);
+
+    double t = 0;
+    for(size_t i=0; i < reps; i++){
+      lodepng::State decoder;
+      decoder.decoder.color_convert = 0;
+      decoder.decoder.simd = k % 2 == 0;
+      vector<unsigned char> decoded;
+      unsigned dw,dh;
+      timer.start();
+      error = lodepng::decode(decoded, dw, dh, decoder, png);
+      t += timer.stop();
+      assert(error == 0 && decoded == image);
+    }
+    report(names[k], w*h, image.size(), t/reps);
+  }
+}
+
+//CRC32 and Adler-32 of the map's pixels at every checksum level:
+//PCLMULQDQ CRC32 and AVX2 or SSSE3 Adler-32 against the portable code
+static void benchChecksums(const size_t& reps){
+  const char* names[5] = {"crc32/pclmul", "crc32/slice8",
+                          "adler32/avx2", "adler32/ssse3", "adler32/scalar"};
+  const unsigned levels[5] = {1, 0, 2, 1, 0};
+  const size_t w = 1024, h = 1024;
+  vector<unsigned char> image;
+  makeImportanceMap(w, h, image);
+  Timer timer;
+
+  for(size_t k=0; k < 5; k++){
+    if(!selected(names[k])){
+      continue;
+    }
+    lodepng_checksum_simd(levels[k]);
+    double t = 0;
+    volatile unsigned checksum = 0;
+    for(size_t i=0; i < reps; i++){
+      timer.start();
+      checksum += k < 2 ? lodepng_crc32(&image[0], image.size())
+                        : lodepng_adler32(&image[0], image.size());
+      t += timer.stop();
+    }
+    report(names[k], image.size(), image.size(), t/reps);
+  }
+  lodepng_checksum_simd(2);
+}
+
+int main(int argc, char** argv){
+  //-reps <n> runs per benchmark, -only <name> filters by substring
+  size_t reps = 20;
+  for(int i=1; i < argc; i++){
+    if(strcmp(argv[i],"-reps") == 0 && i+1 < argc){
+      reps = max(atoi(argv[++i]), 1);
+    }
+    else if(strcmp(argv[i],"-only") == 0 && i+1 < argc){
+      only = argv[++i];
+    }
+  }
+
+  glutInit(&argc,argv);
+  glutCreateWindow (""); //create the context
+  glewInit();
+
+  printf("#name\titems\tbytes\tms\titems/s\tMB/s\n");
+  //the GL sampler first, it sets up the cuda device for interop
+  benchRasterization(reps);
+  benchGeneration(reps);
+  benchCompactions(reps);
+  benchDedup(reps);
+  benchPNG(reps);
+  benchPNGUnfilter(reps);
+  benchChecksums(reps);
+  return 0;
+}
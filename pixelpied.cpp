@@ -0,0 +1,60 @@
+#include <GL/glew.h>
+#include <GL/glut.h>
+
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+using namespace std;
+
+#include "SamplingServer.hpp"
+#include "Probe.hpp"
+
+static SamplingServer* server = NULL;
+
+static void onSignal(int){
+  if(server != NULL) server->stop();
+}
+
+static void usage(const char* prog){
+  cerr << "usage: " << prog << " [-s socket] [-q maxqueue] [-c maxsamplers]"
+       << " [-v]" << endl;
+  exit(1);
+}
+
+int main(int argc, char** argv){
+  glutInit(&argc,argv);
+
+  string socketpath = "/tmp/pixelpie.sock";
+  size_t maxqueue = 64;
+  size_t maxsamplers = 4;
+  bool verify = false; //-v checks every result
+  for(int i=1; i < argc; i++){
+    if(strcmp(argv[i],"-v") == 0){
+      verify = true;
+      continue;
+    }
+    if(i+1 >= argc) usage(argv[0]);
+    if(strcmp(argv[i],"-s") == 0) socketpath = argv[++i];
+    else if(strcmp(argv[i],"-q") == 0) maxqueue = atoi(argv[++i]);
+    else if(strcmp(argv[i],"-c") == 0) maxsamplers = atoi(argv[++i]);
+    else usage(argv[0]);
+  }
+  if(maxqueue == 0 || maxsamplers == 0) usage(argv[0]);
+
+  glutCreateWindow (""); //create the context, it stays on this thread
+  glewInit();
+
+  server = new SamplingServer(socketpath, maxqueue, maxsamplers, verify);
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  cout << "pixelpied listening on " << socketpath << endl;
+  server->run();
+
+  delete server;
+  server = NULL;
+  probeReport(stderr); //only with make PROBES=1
+  return 0;
+}
@@ -0,0 +1,96 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+#include "SampleSet.hpp"
+#include "Timer.hpp"
+
+//Plain dart throwing on the index grid, enough for benchmark inputs
+static void makeSamples(const float& r, vector<float>& pts){
+  const float cell = r/sqrt(2.0f);
+  const long g = (long)ceil(1.0f/cell);
+  vector<long> grid(g*g, -1);
+  srand(12345);
+  size_t tries = 40.0/(r*r);
+  for(size_t t=0; t < tries; t++){
+    float x = rand()/(RAND_MAX+1.0f), y = rand()/(RAND_MAX+1.0f);
+    long cx = x/cell, cy = y/cell;
+    if(grid[cy*g+cx] >= 0) continue;
+    bool ok = true;
+    for(long j=max(cy-2,0L); ok && j <= min(cy+2,g-1); j++){
+      for(long i=max(cx-2,0L); ok && i <= min(cx+2,g-1); i++){
+        long k = grid[j*g+i];
+        if(k < 0) continue;
+        float dx = pts[2*k]-x, dy = pts[2*k+1]-y;
+        ok = dx*dx+dy*dy >= r*r;
+      }
+    }
+    if(ok){
+      grid[cy*g+cx] = pts.size()/2;
+      pts.push_back(x);
+      pts.push_back(y);
+    }
+  }
+}
+
+int main(int argc, char** argv){
+  float r = (argc > 1) ? atof(argv[1]) : 1.0f/1024;
+  size_t nq = (argc > 2) ? atoi(argv[2]) : 1000000;
+
+  vector<float> pts;
+  makeSamples(r, pts);
+
+  Timer timer;
+  SampleSet set;
+  timer.start();
+  set.build(pts, r);
+  double tb = timer.stop();
+  printf("samples %lu  r %g  build %.2f ms  (%.1f Mpts/s)\n",
+         set.size(), r, tb*1000, set.size()/tb*1e-6);
+
+  vector<float> q(2*nq);
+  for(size_t i=0; i < 2*nq; i++){
+    q[i] = rand()/(RAND_MAX+1.0f);
+  }
+
+  const float radii[] = {r, 2*r, 4*r};
+  for(size_t j=0; j < 3; j++){
+    vector<uint32_t> ids;
+    timer.start();
+    for(size_t i=0; i < nq; i++){
+      ids.clear();
+      set.radiusQuery(q[2*i], q[2*i+1], radii[j], ids);
+    }
+    double ts = timer.stop();
+
+    vector<uint32_t> offsets;
+    timer.start();
+    set.radiusQueryBatch(&q[0], nq, radii[j], offsets, ids);
+    double tbatch = timer.stop();
+    printf("radius %gr: %.2f Mq/s single, %.2f Mq/s batch, %.2f hits/q\n",
+           radii[j]/r, nq/ts*1e-6, nq/tbatch*1e-6, ids.size()*1.0/nq);
+  }
+
+  const size_t ks[] = {1, 8, 32};
+  for(size_t j=0; j < 3; j++){
+    size_t k = ks[j];
+    vector<uint32_t> ids(k*nq);
+    vector<float> d2(k*nq);
+    timer.start();
+    for(size_t i=0; i < nq; i++){
+      set.knnQuery(q[2*i], q[2*i+1], k, &ids[i*k], &d2[i*k]);
+    }
+    double ts = timer.stop();
+    timer.start();
+    set.knnQueryBatch(&q[0], nq, k, &ids[0], &d2[0]);
+    double tbatch = timer.stop();
+    printf("knn k=%lu: %.2f Mq/s single, %.2f Mq/s batch\n",
+           k, nq/ts*1e-6, nq/tbatch*1e-6);
+  }
+  return 0;
+}
@@ -0,0 +1,94 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "SampleFile.hpp"
+#include "Spectrum.hpp"
+#include "Timer.hpp"
+
+// Averaged periodogram of sample files (uniformpixelpie -o)
+static void usage(const char* prog){
+  fprintf(stderr, "usage: %s [-size n] [-windows n] [-threads n] "
+          "[-direct|-fft] [-o prefix] files.pps...\n", prog);
+  exit(1);
+}
+
+int main(int argc, char** argv){
+  //-size <n> frequencies per side, -windows <n> per side of a set (by
+  //default from the radius), -o <prefix> saves prefix.png, prefix.txt
+  size_t size = 128, windows = 0, threads = 0;
+  PowerSpectrum::Method method = PowerSpectrum::AUTO;
+  string prefix;
+  vector<string> files;
+  for(int i=1; i < argc; i++){
+    if(strcmp(argv[i],"-size") == 0 && i+1 < argc){
+      size = atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i],"-windows") == 0 && i+1 < argc){
+      windows = atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i],"-threads") == 0 && i+1 < argc){
+      threads = atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i],"-direct") == 0){
+      method = PowerSpectrum::DIRECT;
+    }
+    else if(strcmp(argv[i],"-fft") == 0){
+      method = PowerSpectrum::FFT;
+    }
+    else if(strcmp(argv[i],"-o") == 0 && i+1 < argc){
+      prefix = argv[++i];
+    }
+    else if(argv[i][0] == '-'){
+      usage(argv[0]);
+    }
+    else{
+      files.push_back(argv[i]);
+    }
+  }
+  if(files.empty() || size < 2){
+    usage(argv[0]);
+  }
+
+  //the windows follow the radius of the first file
+  PowerSpectrum* spectrum = NULL;
+  float r = 0;
+  Timer timer;
+  timer.start();
+  for(size_t f=0; f < files.size(); f++){
+    SampleFileReader reader;
+    if(!reader.open(files[f])){
+      fprintf(stderr, "%s: not a sample file\n", files[f].c_str());
+      continue;
+    }
+    if(spectrum == NULL){
+      r = reader.header().radius;
+      spectrum = new PowerSpectrum(size, windows ? windows :
+                                   PowerSpectrum::windowsFor(size, r),
+                                   threads);
+    }
+    vector<float> pts;
+    reader.readAll(pts);
+    spectrum->add(pts, method);
+  }
+  if(spectrum == NULL){
+    return 1;
+  }
+  double elapsed = timer.stop();
+
+  SpectralQuality q = spectrum->quality(r);
+  printf("#files\tr\truns\twindows\tpeakfreq*r\tpeak\tlowpower\t"
+         "anisotropy_db\tseconds\n");
+  printf("%lu\t%f\t%lu\t%lu\t%f\t%f\t%f\t%f\t%f\n", files.size(), r,
+         q.runs, spectrum->windows(), q.peakfreq, q.peak, q.lowpower,
+         q.anisotropy, elapsed);
+  if(!prefix.empty()){
+    spectrum->savePeriodogram(prefix+".png");
+    spectrum->saveRadial(prefix+".txt", r);
+  }
+  delete spectrum;
+  return 0;
+}